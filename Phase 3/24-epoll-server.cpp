@@ -38,6 +38,11 @@ else:
 - delete client fd from epoll, close fd, break
 - else: echo data
 - write buffer back to client
+
+--splice mode (zero-copy echo):
+- one pipe for the whole server, created at startup
+- splice client -> pipe, then pipe -> client: the bytes never enter user space
+- like the write() path, a short send drops the rest (drained into /dev/null so the pipe stays clean)
 */
 
 // epoll_server.cpp
@@ -51,13 +56,51 @@ else:
 #include <cerrno>
 
 #define MAX_EVENTS 64
+#define SPLICE_CHUNK 65536
 
 void set_nonblocking(int fd) {
     int flags = fcntl(fd, F_GETFL, 0);
     fcntl(fd, F_SETFL, flags | O_NONBLOCK);
 }
 
-int main() {
+// Echo whatever is waiting on client_fd through the pipe, without copying it.
+// Returns bytes read, 0 on disconnect, -1 with errno set (EAGAIN = drained).
+ssize_t splice_echo(int client_fd, int pipe_fds[2], int devnull_fd) {
+    ssize_t n = splice(client_fd, nullptr, pipe_fds[1], nullptr, SPLICE_CHUNK,
+                       SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    if (n <= 0) return n;
+    
+    ssize_t left = n;
+    while (left > 0) {
+        ssize_t out = splice(pipe_fds[0], nullptr, client_fd, nullptr, left,
+                             SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (out <= 0) break;
+        left -= out;
+    }
+    
+    // Client not keeping up: discard, the shared pipe must be empty for the next client
+    while (left > 0) {
+        ssize_t out = splice(pipe_fds[0], nullptr, devnull_fd, nullptr, left, SPLICE_F_MOVE);
+        if (out <= 0) break;
+        left -= out;
+    }
+    
+    return n;
+}
+
+int main(int argc, char* argv[]) {
+    bool use_splice = argc > 1 && strcmp(argv[1], "--splice") == 0;
+    
+    int pipe_fds[2] = {-1, -1};
+    int devnull_fd = -1;
+    if (use_splice) {
+        if (pipe2(pipe_fds, O_NONBLOCK) == -1) {
+            std::cerr << "pipe2 failed" << std::endl;
+            return 1;
+        }
+        devnull_fd = open("/dev/null", O_WRONLY);
+    }
+    
     // Create listening socket
     int server_fd = socket(AF_INET, SOCK_STREAM, 0);
     
@@ -92,7 +135,8 @@ int main() {
     }
     
     std::cout << "=== epoll() Server on port 8080 ===" << std::endl;
-    std::cout << "Edge-triggered, non-blocking I/O\n" << std::endl;
+    std::cout << "Edge-triggered, non-blocking I/O" 
+              << (use_splice ? ", zero-copy splice() echo" : "") << "\n" << std::endl;
     
     struct epoll_event events[MAX_EVENTS];
     int client_count = 0;
@@ -142,7 +186,13 @@ int main() {
                 
                 while (true) {
                     char buffer[1024];
-                    ssize_t n = read(client_fd, buffer, sizeof(buffer) - 1);
+                    ssize_t n;
+                    
+                    if (use_splice) {
+                        n = splice_echo(client_fd, pipe_fds, devnull_fd);
+                    } else {
+                        n = read(client_fd, buffer, sizeof(buffer) - 1);
+                    }
                     
                     if (n == -1) {
                         if (errno == EAGAIN || errno == EWOULDBLOCK) {
@@ -164,6 +214,9 @@ int main() {
                         client_count--;
                         break;
                     }
+                    else if (use_splice) {
+                        std::cout << "Spliced " << n << " bytes" << std::endl;
+                    }
                     else {
                         // Echo data
                         buffer[n] = '\0';
@@ -177,5 +230,10 @@ int main() {
     
     close(epoll_fd);
     close(server_fd);
+    if (use_splice) {
+        close(pipe_fds[0]);
+        close(pipe_fds[1]);
+        close(devnull_fd);
+    }
     return 0;
 }
\ No newline at end of file
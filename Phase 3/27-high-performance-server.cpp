@@ -30,6 +30,70 @@ handle_client_write: Client* client and epoll_fd as para
 - .erase written data up to bytes wrote
 - outside while loop:
 - if write buffer empty, then stop monitoring EPOLLOUT
+
+Multi-reactor mode (--loops N):
+- EventLoop struct: id, cpu, own listener fd, own epoll fd, counters
+- create_listener(port, reuseport): SO_REUSEADDR + SO_REUSEPORT so every loop can bind 8080
+- kernel hashes each incoming connection to exactly one of the N listeners
+- each loop runs on its own pthread pinned to one core (pthread_setaffinity_np)
+- nothing is shared between loops -> no locks, no cross-core cache traffic
+- main thread only prints accepts/sec + echo MB/sec per loop once a second
+
+Connection table (replaces map<int, Client*> + new Client):
+- one slab of 64-byte aligned Client slots, indexed directly by fd, allocated once at startup
+- fds are unique process-wide, so one table serves every loop (slot N belongs to whoever accepted fd N)
+- epoll data.u64 = slot address | generation (low 6 bits are free because of the alignment)
+- release bumps the generation -> an event queued for the old connection no longer matches
+- --bench-table: random event dispatch + connection churn at 100k conns, map vs slab
+
+Output queue (replaces write_buffer + erase):
+- Chunk: next pointer, start/end offsets, 16 KB of data
+- BufferPool per loop: free list of chunks, keeps at most POOL_MAX_FREE idle ones
+- read() goes straight into the tail chunk, a fresh chunk is only linked if the read returned data
+- flush: one writev over up to IOV_BATCH chunks, fully written chunks go back to the pool
+
+Backpressure (--high-water, --low-water, --budget):
+- queued output >= high watermark: stop reading, EPOLLIN is dropped from the interest set
+- flushed down to the low watermark: take EPOLLIN back and read what piled up in the socket
+- global budget: chunk memory held by all output queues (queued_memory, shared by every loop)
+- over budget: the connection that wanted a new chunk pauses too and waits on its loop's
+  budget_waiters list, retried every BUDGET_RETRY_MS (memory may be freed by another loop)
+- per-loop counters: throttled_high, throttled_budget, resumed (printed with the loop stats,
+  by a stats thread in single-loop mode too)
+
+Fewer epoll_ctl calls (--no-inline-write restores the old behaviour for comparison):
+- after reading, writev the echo right away instead of arming EPOLLOUT and waiting for it
+- EPOLLOUT is only armed when that writev hits EAGAIN
+- Client::interest = mask registered with epoll, update_interest skips the MOD if unchanged
+- --bench-syscalls: ping-pong clients, syscalls per echoed message, old vs new path
+
+Busy-poll loop (--busy-poll N, --spin, --so-busy-poll USEC; epoll backend only):
+- blocking (default): epoll_wait(-1), every event after an idle gap pays a sleep + wakeup
+- hybrid (--busy-poll N): epoll_wait(0) until N polls in a row come back empty, then block;
+  any event resets the count
+- pure spin (--spin): epoll_wait(0) forever, burns a whole core, needs one to itself
+- --so-busy-poll: SO_BUSY_POLL + SO_PREFER_BUSY_POLL on accepted sockets and EPIOCSPARAMS
+  on the epoll fd, so the kernel polls the NIC queue too (no effect over loopback)
+- --bench-latency: one client, 64-byte request every 50 us, RTT p50/p99/p99.9 per mode
+
+Zero-copy mode (--splice):
+- bytes go socket -> pipe -> socket with splice(), never entering user space
+- pipes come from a per-loop PipePool and are only held while bytes are in flight
+- handle_splice_io: drain pipe to socket first, then refill from socket, repeat until
+  socket empty (EAGAIN with empty pipe) or send buffer full (arm EPOLLOUT and come back)
+- --bench-echo: in-process client, copy vs splice at 4 KB / 64 KB / 1 MB payloads
+
+io_uring backend (--uring, needs liburing + kernel 6.0+):
+- one ring per loop (SINGLE_ISSUER | DEFER_TASKRUN when the kernel has them)
+- multishot accept on the listener: one SQE, a CQE per new connection
+- provided buffer ring: the kernel picks a buffer for each recv, CQE says which (bid)
+- startup probe: one recv through the ring; if registering fails or the probe gets -ENOBUFS
+  with the ring full, the same buffers are handed over with IORING_OP_PROVIDE_BUFFERS instead
+- multishot recv per connection, each received buffer is sent straight back
+- one send in flight per connection (queued bids keep byte order), the send CQE recycles the buffer
+- loop = io_uring_submit_and_wait(1) + walk every ready CQE: one syscall per batch
+- loop->syscalls counts every syscall both backends make
+- --bench-uring: N connections ping-ponging, epoll vs io_uring, msgs/s + syscalls/msg
 */
 
 
@@ -39,34 +103,427 @@ handle_client_write: Client* client and epoll_fd as para
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/uio.h>
+#include <sys/ioctl.h>
+#include <netinet/tcp.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <cstdio>
 #include <cstring>
+#include <cstdlib>
 #include <cerrno>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <map>
+#include <random>
 #include <vector>
 
+#if __has_include(<liburing.h>)
+#include <liburing.h>
+#define HAVE_LIBURING 1
+#endif
+
 #define MAX_EVENTS 1024
-#define BUFFER_SIZE 4096
+#define DEFAULT_PORT 8080
+#define DEFAULT_MAX_FDS 131072
+#define GENERATION_MASK 63  // Low bits of a 64-byte aligned slot address
+#define LISTENER_TAG 0      // epoll data for the listening socket
+
+#define CHUNK_SIZE 16384
+#define POOL_MAX_FREE 1024   // Idle chunks a loop keeps around (16 MB)
+#define IOV_BATCH 64         // Chunks per writev
+
+#define DEFAULT_HIGH_WATERMARK (1024 * 1024)       // Pending output that pauses reading
+#define DEFAULT_LOW_WATERMARK (256 * 1024)         // ... and that resumes it
+#define DEFAULT_MEMORY_BUDGET (512 * 1024 * 1024)  // Output queue memory across all connections
+#define BUDGET_RETRY_MS 10                         // epoll_wait timeout while connections wait for budget
+
+// Busy polling: older headers lack these (SO_PREFER_BUSY_POLL is 5.11+, epoll params 6.9+)
+#ifndef SO_PREFER_BUSY_POLL
+#define SO_PREFER_BUSY_POLL 69
+#endif
+#ifndef EPIOCSPARAMS
+struct epoll_params {
+    uint32_t busy_poll_usecs;
+    uint16_t busy_poll_budget;
+    uint8_t prefer_busy_poll;
+    uint8_t __pad;
+};
+#define EPIOCSPARAMS _IOW(0x8A, 0x01, struct epoll_params)
+#endif
+
+#define PIPE_SIZE (256 * 1024)  // Requested pipe capacity for splice mode
+#define PIPE_POOL_MAX 256       // Idle pipes a loop keeps open
+
+struct Chunk {
+    Chunk* next;
+    uint32_t start;  // First unsent byte
+    uint32_t end;    // One past the last received byte
+    char data[CHUNK_SIZE];
+};
+
+// Per-loop chunk allocator, never shared between threads
+struct BufferPool {
+    Chunk* free_list = nullptr;
+    size_t free_count = 0;
+    size_t allocated = 0;
+};
+
+// FIFO of chunks: bytes are appended at tail->end and sent from head->start
+struct OutputQueue {
+    Chunk* head = nullptr;
+    Chunk* tail = nullptr;
+    size_t chunks = 0;
+    size_t bytes = 0;
+};
+
+// One pre-allocated slot per fd. fd == -1 means the slot is free.
+struct alignas(64) Client {
+    int fd = -1;
+    std::atomic<uint32_t> generation{0};
+    OutputQueue output;
+    uint32_t interest = 0;        // Mask currently registered with epoll
+    bool read_paused = false;     // Throttled: EPOLLIN dropped, data left in the socket
+    bool budget_waiting = false;  // On the loop's budget_waiters list
+    
+    // Splice mode: borrowed pipe and the bytes currently sitting in it
+    int pipe_rd = -1;
+    int pipe_wr = -1;
+    size_t pipe_bytes = 0;
+    
+    // io_uring mode: provided buffers waiting to be echoed, sent one at a time
+    int32_t send_head = -1;
+    int32_t send_tail = -1;
+    bool send_inflight = false;
+    bool recv_armed = false;
+    bool cancel_sent = false;  // The recv's ASYNC_CANCEL is queued: one per connection
+    bool closing = false;
+};
+
+struct SplicePipe {
+    int rd;
+    int wr;
+};
+
+// Per-loop cache of empty pipes, so a connection only pays pipe2() once per burst
+struct PipePool {
+    std::vector<SplicePipe> free;
+    size_t capacity = 0;  // Bytes one pipe holds after F_SETPIPE_SZ
+};
+
+Chunk* pool_get(BufferPool* pool) {
+    Chunk* chunk = pool->free_list;
+    if (chunk) {
+        pool->free_list = chunk->next;
+        pool->free_count--;
+    } else {
+        chunk = new Chunk;
+        pool->allocated++;
+    }
+    
+    chunk->next = nullptr;
+    chunk->start = 0;
+    chunk->end = 0;
+    return chunk;
+}
+
+void pool_put(BufferPool* pool, Chunk* chunk) {
+    if (pool->free_count >= POOL_MAX_FREE) {
+        delete chunk;
+        pool->allocated--;
+        return;
+    }
+    
+    chunk->next = pool->free_list;
+    pool->free_list = chunk;
+    pool->free_count++;
+}
+
+// Chunk memory held by every output queue in the process (the --budget total)
+std::atomic<size_t> queued_memory{0};
+
+void queue_push(OutputQueue* queue, Chunk* chunk) {
+    if (queue->tail) {
+        queue->tail->next = chunk;
+    } else {
+        queue->head = chunk;
+    }
+    queue->tail = chunk;
+    queue->chunks++;
+    queued_memory.fetch_add(CHUNK_SIZE, std::memory_order_relaxed);
+}
+
+// Drop n sent bytes from the front, returning emptied chunks to the pool
+void queue_consume(OutputQueue* queue, BufferPool* pool, size_t n) {
+    queue->bytes -= n;
+    
+    while (n > 0) {
+        Chunk* chunk = queue->head;
+        size_t available = chunk->end - chunk->start;
+        
+        if (n < available) {
+            chunk->start += n;
+            return;
+        }
+        
+        n -= available;
+        queue->head = chunk->next;
+        if (!queue->head) queue->tail = nullptr;
+        queue->chunks--;
+        queued_memory.fetch_sub(CHUNK_SIZE, std::memory_order_relaxed);
+        pool_put(pool, chunk);
+    }
+}
+
+void queue_clear(OutputQueue* queue, BufferPool* pool) {
+    while (queue->head) {
+        Chunk* chunk = queue->head;
+        queue->head = chunk->next;
+        pool_put(pool, chunk);
+    }
+    queued_memory.fetch_sub(queue->chunks * CHUNK_SIZE, std::memory_order_relaxed);
+    queue->tail = nullptr;
+    queue->chunks = 0;
+    queue->bytes = 0;
+}
+
+struct ConnectionTable {
+    Client* slots;
+    size_t capacity;
+};
+
+ConnectionTable connections;
+
+void init_connection_table(ConnectionTable* table, size_t capacity) {
+    table->slots = new Client[capacity];
+    table->capacity = capacity;
+}
+
+Client* acquire_slot(ConnectionTable* table, int fd) {
+    if (fd < 0 || (size_t)fd >= table->capacity) return nullptr;
+    
+    Client* client = &table->slots[fd];
+    client->fd = fd;
+    return client;
+}
+
+// The output queue must already be empty (see close_client)
+void release_slot(Client* client) {
+    client->interest = 0;
+    client->read_paused = false;
+    client->budget_waiting = false;
+    client->send_head = -1;
+    client->send_tail = -1;
+    client->send_inflight = false;
+    client->recv_armed = false;
+    client->cancel_sent = false;
+    client->closing = false;
+    client->fd = -1;
+    client->generation.store(client->generation.load(std::memory_order_relaxed) + 1,
+                             std::memory_order_relaxed);
+}
+
+// Pointer + generation packed into epoll_event.data
+static inline uint64_t slot_tag(Client* client) {
+    return (uint64_t)(uintptr_t)client |
+           (client->generation.load(std::memory_order_relaxed) & GENERATION_MASK);
+}
+
+// Returns nullptr for events that belong to an already-released connection
+static inline Client* resolve_tag(uint64_t tag) {
+    Client* client = (Client*)(uintptr_t)(tag & ~(uint64_t)GENERATION_MASK);
+    uint32_t generation = client->generation.load(std::memory_order_relaxed);
+    
+    if ((generation & GENERATION_MASK) != (tag & GENERATION_MASK) || client->fd == -1) {
+        return nullptr;
+    }
+    return client;
+}
+
+// Table size follows the fd limit: raise the soft limit as far as allowed
+size_t raise_fd_limit(size_t wanted) {
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) == -1) return 1024;
+    
+    rlim_t target = wanted;
+    if (rl.rlim_max != RLIM_INFINITY && target > rl.rlim_max) target = rl.rlim_max;
+    
+    if (target > rl.rlim_cur) {
+        rl.rlim_cur = target;
+        if (setrlimit(RLIMIT_NOFILE, &rl) == -1) {
+            getrlimit(RLIMIT_NOFILE, &rl);
+        }
+    }
+    
+    return rl.rlim_cur < wanted ? rl.rlim_cur : wanted;
+}
+
+struct ServerConfig {
+    int port = DEFAULT_PORT;
+    int loops = 1;        // Number of event-loop threads
+    bool pin = true;      // Pin loop i to core i % ncpus
+    bool verbose = true;  // Log every connect/disconnect
+    size_t max_fds = DEFAULT_MAX_FDS;  // Connection table size
+    bool splice = false;  // Zero-copy echo through pipes
+    bool uring = false;   // io_uring completion backend instead of epoll
+    size_t high_watermark = DEFAULT_HIGH_WATERMARK;
+    size_t low_watermark = DEFAULT_LOW_WATERMARK;
+    size_t memory_budget = DEFAULT_MEMORY_BUDGET;
+    bool inline_write = true;  // Write right after reading, skip unchanged epoll_ctl
+    int spin_polls = 0;        // Empty epoll_wait(0) polls before blocking: 0 = always block, -1 = never
+    int busy_poll_usec = 0;    // SO_BUSY_POLL / SO_PREFER_BUSY_POLL + epoll busy-poll params
+};
 
-struct Client {
-    int fd;
-    std::vector<char> read_buffer;
-    std::vector<char> write_buffer;
+// One reactor: everything a loop touches lives here, so loops never share state.
+// Counters are written only by the owning loop and read by the stats printer.
+struct alignas(64) EventLoop {
+    int id;
+    int cpu;
+    int server_fd;
+    int epoll_fd;
+    const ServerConfig* config;
+    ConnectionTable* table;
+    size_t active = 0;  // Connections owned by this loop
+    BufferPool pool;
+    PipePool pipes;
+    std::vector<uint64_t> budget_waiters;  // Slot tags of connections paused by the budget
+
+    std::atomic<uint64_t> accepted{0};
+    std::atomic<uint64_t> bytes_echoed{0};
+    std::atomic<uint64_t> syscalls{0};
+    std::atomic<uint64_t> throttled_high{0};    // Reads paused at the high watermark
+    std::atomic<uint64_t> throttled_budget{0};  // Reads paused by the global budget
+    std::atomic<uint64_t> resumed{0};
+    std::atomic<uint64_t> idle_polls{0};  // Spin-mode epoll_wait calls that returned nothing
 };
 
-std::map<int, Client*> clients;
+// Single-writer counter bump: a plain load/store, no locked instruction
+static inline void bump(std::atomic<uint64_t>& counter, uint64_t n) {
+    counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
 
 void set_nonblocking(int fd) {
     int flags = fcntl(fd, F_GETFL, 0);
     fcntl(fd, F_SETFL, flags | O_NONBLOCK);
 }
 
-void handle_new_connection(int server_fd, int epoll_fd) {
+int create_listener(int port, bool reuseport) {
+    int server_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (server_fd == -1) {
+        perror("socket");
+        return -1;
+    }
+    
+    int opt = 1;
+    setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    
+    // Every loop binds the same port; the kernel load-balances new
+    // connections across all listeners in the reuseport group
+    if (reuseport && setsockopt(server_fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) == -1) {
+        perror("setsockopt SO_REUSEPORT");
+        close(server_fd);
+        return -1;
+    }
+    
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = INADDR_ANY;
+    addr.sin_port = htons(port);
+    
+    if (bind(server_fd, (struct sockaddr*)&addr, sizeof(addr)) == -1) {
+        perror("bind");
+        close(server_fd);
+        return -1;
+    }
+    
+    listen(server_fd, SOMAXCONN);
+    set_nonblocking(server_fd);
+    
+    return server_fd;
+}
+
+bool acquire_pipe(EventLoop* loop, Client* client) {
+    SplicePipe p;
+    
+    if (!loop->pipes.free.empty()) {
+        p = loop->pipes.free.back();
+        loop->pipes.free.pop_back();
+    } else {
+        int fds[2];
+        if (pipe2(fds, O_NONBLOCK | O_CLOEXEC) == -1) {
+            perror("pipe2");
+            return false;
+        }
+        p.rd = fds[0];
+        p.wr = fds[1];
+        
+        // Bigger pipe = fewer splice round trips per burst (may be capped by pipe-max-size)
+        int size = fcntl(p.wr, F_SETPIPE_SZ, PIPE_SIZE);
+        if (size == -1) size = fcntl(p.wr, F_GETPIPE_SZ);
+        loop->pipes.capacity = size;
+    }
+    
+    client->pipe_rd = p.rd;
+    client->pipe_wr = p.wr;
+    client->pipe_bytes = 0;
+    return true;
+}
+
+void release_pipe(EventLoop* loop, Client* client) {
+    if (client->pipe_rd == -1) return;
+    
+    // A pipe with bytes still in it can't be handed to another connection
+    if (client->pipe_bytes == 0 && loop->pipes.free.size() < PIPE_POOL_MAX) {
+        loop->pipes.free.push_back({client->pipe_rd, client->pipe_wr});
+    } else {
+        close(client->pipe_rd);
+        close(client->pipe_wr);
+    }
+    
+    client->pipe_rd = -1;
+    client->pipe_wr = -1;
+    client->pipe_bytes = 0;
+}
+
+void close_client(EventLoop* loop, Client* client) {
+    bump(loop->syscalls, 2);  // epoll_ctl + close
+    epoll_ctl(loop->epoll_fd, EPOLL_CTL_DEL, client->fd, nullptr);
+    close(client->fd);
+    queue_clear(&client->output, &loop->pool);
+    release_pipe(loop, client);
+    release_slot(client);
+    loop->active--;
+}
+
+// Let the kernel poll the NIC queue from recv() instead of waiting for an interrupt.
+// Needs a real device queue (NAPI): over loopback this is a no-op.
+void enable_busy_poll(EventLoop* loop, int fd) {
+    int usec = loop->config->busy_poll_usec;
+    int prefer = 1;
+    
+    bump(loop->syscalls, 2);
+    if (setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &usec, sizeof(usec)) == -1 ||
+        setsockopt(fd, SOL_SOCKET, SO_PREFER_BUSY_POLL, &prefer, sizeof(prefer)) == -1) {
+        static bool warned = false;
+        if (!warned) {
+            perror("setsockopt SO_BUSY_POLL");  // EPERM above net.core.busy_read without CAP_NET_ADMIN
+            warned = true;
+        }
+    }
+}
+
+void handle_new_connection(EventLoop* loop) {
     while (true) {
         struct sockaddr_in client_addr;
         socklen_t client_len = sizeof(client_addr);
         
-        int client_fd = accept(server_fd, (struct sockaddr*)&client_addr, &client_len);
+        bump(loop->syscalls, 1);
+        int client_fd = accept(loop->server_fd, (struct sockaddr*)&client_addr, &client_len);
         
         if (client_fd == -1) {
             if (errno == EAGAIN || errno == EWOULDBLOCK) {
@@ -77,28 +534,146 @@ void handle_new_connection(int server_fd, int epoll_fd) {
             }
         }
         
+        // Track client: the slot for this fd, no allocation
+        Client* client = acquire_slot(loop->table, client_fd);
+        if (!client) {
+            std::cerr << "fd " << client_fd << " exceeds connection table ("
+                      << loop->table->capacity << "), closing" << std::endl;
+            bump(loop->syscalls, 1);
+            close(client_fd);
+            continue;
+        }
+        
         set_nonblocking(client_fd);
+        if (loop->config->busy_poll_usec > 0) {
+            enable_busy_poll(loop, client_fd);
+        }
         
-        // Add to epoll
+        // Add to epoll, pointing straight at the slot
         struct epoll_event ev;
         ev.events = EPOLLIN | EPOLLET;  // Edge-triggered
-        ev.data.fd = client_fd;
-        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, client_fd, &ev);
+        ev.data.u64 = slot_tag(client);
+        bump(loop->syscalls, 1);
+        epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, client_fd, &ev);
+        client->interest = ev.events;
         
-        // Track client
-        Client* client = new Client;
-        client->fd = client_fd;
-        clients[client_fd] = client;
+        loop->active++;
+        bump(loop->accepted, 1);
+        
+        if (loop->config->verbose) {
+            std::cout << "[loop " << loop->id << "] New client: fd " << client_fd 
+                      << " (total: " << loop->active << ")" << std::endl;
+        }
+    }
+}
+
+// Interest follows state: EPOLLIN unless throttled, EPOLLOUT while output is queued
+void update_interest(EventLoop* loop, Client* client) {
+    uint32_t events = EPOLLET | (client->read_paused ? 0u : (uint32_t)EPOLLIN) | (client->output.bytes > 0 ? (uint32_t)EPOLLOUT : 0u);
+    
+    // Already registered: skip the syscall (--no-inline-write always issues it)
+    if (events == client->interest && loop->config->inline_write) return;
+    
+    struct epoll_event ev;
+    ev.events = events;
+    ev.data.u64 = slot_tag(client);
+    bump(loop->syscalls, 1);
+    epoll_ctl(loop->epoll_fd, EPOLL_CTL_MOD, client->fd, &ev);
+    client->interest = events;
+}
+
+static inline bool over_budget(const ServerConfig* config) {
+    return queued_memory.load(std::memory_order_relaxed) + CHUNK_SIZE > config->memory_budget;
+}
+
+void wait_for_budget(EventLoop* loop, Client* client) {
+    if (client->budget_waiting) return;
+    client->budget_waiting = true;
+    loop->budget_waiters.push_back(slot_tag(client));
+}
+
+void pause_reading(EventLoop* loop, Client* client, bool budget) {
+    client->read_paused = true;
+    
+    if (budget) {
+        bump(loop->throttled_budget, 1);
+        wait_for_budget(loop, client);
+    } else {
+        bump(loop->throttled_high, 1);
+    }
+    
+    if (loop->config->verbose) {
+        std::cout << "[loop " << loop->id << "] Throttling fd " << client->fd 
+                  << (budget ? " (memory budget)" : " (high watermark)") << std::endl;
+    }
+}
+
+// Below the low watermark with budget to spare: reading may start again
+bool try_resume_reading(EventLoop* loop, Client* client) {
+    if (client->output.bytes > loop->config->low_watermark) return false;
+    
+    if (over_budget(loop->config)) {
+        wait_for_budget(loop, client);
+        return false;
+    }
+    
+    client->read_paused = false;
+    client->budget_waiting = false;
+    bump(loop->resumed, 1);
+    return true;
+}
+
+void handle_client_read(EventLoop* loop, Client* client);
+
+// Budget may have been freed by any loop: give waiting connections another try
+void retry_budget_waiters(EventLoop* loop) {
+    std::vector<uint64_t> waiters;
+    waiters.swap(loop->budget_waiters);
+    
+    for (uint64_t tag : waiters) {
+        Client* client = resolve_tag(tag);
+        if (!client || !client->budget_waiting) continue;  // Closed or already resumed
+        
+        client->budget_waiting = false;
+        if (!client->read_paused) continue;
         
-        std::cout << "New client: fd " << client_fd 
-                  << " (total: " << clients.size() << ")" << std::endl;
+        if (try_resume_reading(loop, client)) {
+            update_interest(loop, client);
+            handle_client_read(loop, client);
+        }
     }
 }
 
-void handle_client_read(Client* client, int epoll_fd) {
+// Read until EAGAIN or throttled. Returns false if the client was closed or failed.
+bool read_input(EventLoop* loop, Client* client) {
+    OutputQueue* output = &client->output;
+    const ServerConfig* config = loop->config;
+    
     while (true) {
-        char buffer[BUFFER_SIZE];
-        ssize_t n = read(client->fd, buffer, sizeof(buffer));
+        // Read straight into the tail chunk, or a fresh one if it is full
+        Chunk* tail = output->tail;
+        bool fresh = false;
+        
+        if (!tail || tail->end == CHUNK_SIZE) {
+            // Backlog full: leave the rest in the socket until we flush
+            if (output->bytes >= config->high_watermark) {
+                pause_reading(loop, client, false);
+                break;
+            }
+            if (over_budget(config)) {
+                pause_reading(loop, client, true);
+                break;
+            }
+            tail = pool_get(&loop->pool);
+            fresh = true;
+        }
+        
+        bump(loop->syscalls, 1);
+        ssize_t n = read(client->fd, tail->data + tail->end, CHUNK_SIZE - tail->end);
+        
+        if (n <= 0 && fresh) {
+            pool_put(&loop->pool, tail);  // Don't pin an empty chunk to an idle client
+        }
         
         if (n == -1) {
             if (errno == EAGAIN || errno == EWOULDBLOCK) {
@@ -106,36 +681,47 @@ void handle_client_read(Client* client, int epoll_fd) {
                 break;
             } else {
                 std::cerr << "read error" << std::endl;
-                return;
+                return false;
             }
         }
         else if (n == 0) {
             // Client disconnected
-            std::cout << "Client disconnected: fd " << client->fd << std::endl;
-            epoll_ctl(epoll_fd, EPOLL_CTL_DEL, client->fd, nullptr);
-            close(client->fd);
-            clients.erase(client->fd);
-            delete client;
-            return;
+            if (loop->config->verbose) {
+                std::cout << "[loop " << loop->id << "] Client disconnected: fd " 
+                          << client->fd << std::endl;
+            }
+            close_client(loop, client);
+            return false;
         }
         
-        // Echo: add to write buffer
-        client->write_buffer.insert(client->write_buffer.end(), buffer, buffer + n);
+        // Echo: the received bytes are already queued for sending
+        if (fresh) queue_push(output, tail);
+        tail->end += n;
+        output->bytes += n;
     }
     
-    // If we have data to write, register for EPOLLOUT
-    if (!client->write_buffer.empty()) {
-        struct epoll_event ev;
-        ev.events = EPOLLIN | EPOLLOUT | EPOLLET;
-        ev.data.fd = client->fd;
-        epoll_ctl(epoll_fd, EPOLL_CTL_MOD, client->fd, &ev);
-    }
+    return true;
 }
 
-void handle_client_write(Client* client, int epoll_fd) {
-    while (!client->write_buffer.empty()) {
-        ssize_t n = write(client->fd, client->write_buffer.data(), 
-                         client->write_buffer.size());
+// writev queued chunks until the queue is empty or the socket is full.
+// Returns false on a write error.
+bool flush_output(EventLoop* loop, Client* client) {
+    OutputQueue* output = &client->output;
+    
+    while (output->bytes > 0) {
+        // One writev across as many queued chunks as fit
+        struct iovec iov[IOV_BATCH];
+        int iovcnt = 0;
+        
+        for (Chunk* chunk = output->head; chunk && iovcnt < IOV_BATCH; chunk = chunk->next) {
+            if (chunk->end == chunk->start) continue;
+            iov[iovcnt].iov_base = chunk->data + chunk->start;
+            iov[iovcnt].iov_len = chunk->end - chunk->start;
+            iovcnt++;
+        }
+        
+        bump(loop->syscalls, 1);
+        ssize_t n = writev(client->fd, iov, iovcnt);
         
         if (n == -1) {
             if (errno == EAGAIN || errno == EWOULDBLOCK) {
@@ -143,87 +729,1235 @@ void handle_client_write(Client* client, int epoll_fd) {
                 break;
             } else {
                 std::cerr << "write error" << std::endl;
-                return;
+                return false;
             }
         }
         
-        // Remove written data
-        client->write_buffer.erase(client->write_buffer.begin(), 
-                                   client->write_buffer.begin() + n);
+        // Remove written data: O(chunks sent), no memmove
+        queue_consume(output, &loop->pool, n);
+        bump(loop->bytes_echoed, n);
     }
     
-    // If write buffer empty, stop monitoring EPOLLOUT
-    if (client->write_buffer.empty()) {
-        struct epoll_event ev;
-        ev.events = EPOLLIN | EPOLLET;
-        ev.data.fd = client->fd;
-        epoll_ctl(epoll_fd, EPOLL_CTL_MOD, client->fd, &ev);
-    }
+    return true;
 }
 
-int main() {
-    // Create server socket
-    int server_fd = socket(AF_INET, SOCK_STREAM, 0);
+void handle_client_read(EventLoop* loop, Client* client) {
+    OutputQueue* output = &client->output;
     
-    int opt = 1;
-    setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    while (true) {
+        if (!read_input(loop, client)) return;
+        if (!loop->config->inline_write) break;
+        
+        // Optimistic write: the echo usually fits in the send buffer, so
+        // EPOLLOUT only gets armed when writev actually hits EAGAIN
+        if (output->bytes > 0 && !flush_output(loop, client)) return;
+        
+        // Drained below the low watermark straight away: keep reading
+        if (!client->read_paused || !try_resume_reading(loop, client)) break;
+    }
     
-    struct sockaddr_in addr;
-    addr.sin_family = AF_INET;
-    addr.sin_addr.s_addr = INADDR_ANY;
-    addr.sin_port = htons(8080);
+    if (loop->config->inline_write) {
+        update_interest(loop, client);  // Usually unchanged: no syscall
+    } else if (output->bytes > 0 || client->read_paused) {
+        // If we have data to write, register for EPOLLOUT (and drop EPOLLIN if throttled)
+        update_interest(loop, client);
+    }
+}
+
+void handle_client_write(EventLoop* loop, Client* client) {
+    OutputQueue* output = &client->output;
     
-    bind(server_fd, (struct sockaddr*)&addr, sizeof(addr));
-    listen(server_fd, SOMAXCONN);
-    set_nonblocking(server_fd);
+    if (!flush_output(loop, client)) return;
     
-    // Create epoll
-    int epoll_fd = epoll_create1(0);
+    bool resumed = client->read_paused && try_resume_reading(loop, client);
     
-    struct epoll_event ev;
-    ev.events = EPOLLIN | EPOLLET;
-    ev.data.fd = server_fd;
-    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, server_fd, &ev);
+    // If write buffer empty, stop monitoring EPOLLOUT; if resumed, take EPOLLIN back
+    if (output->bytes == 0 || resumed) {
+        update_interest(loop, client);
+    }
     
-    std::cout << "=== High-Performance Echo Server ===" << std::endl;
-    std::cout << "Listening on port 8080" << std::endl;
-    std::cout << "Edge-triggered, non-blocking I/O\n" << std::endl;
+    // Edge-triggered epoll won't repeat the EPOLLIN we left unread
+    if (resumed) {
+        handle_client_read(loop, client);
+    }
+}
+
+// Zero-copy echo: called for both EPOLLIN and EPOLLOUT in --splice mode
+void handle_splice_io(EventLoop* loop, Client* client) {
+    bool had_output = client->pipe_bytes > 0;
     
-    struct epoll_event events[MAX_EVENTS];
+    if (client->pipe_rd == -1 && !acquire_pipe(loop, client)) {
+        close_client(loop, client);
+        return;
+    }
     
     while (true) {
-        int nfds = epoll_wait(epoll_fd, events, MAX_EVENTS, -1);
-        
-        for (int i = 0; i < nfds; i++) {
-            if (events[i].data.fd == server_fd) {
-                // New connections
-                handle_new_connection(server_fd, epoll_fd);
+        // 1. Pipe -> socket: push out whatever is in flight
+        while (client->pipe_bytes > 0) {
+            bump(loop->syscalls, 1);
+            ssize_t n = splice(client->pipe_rd, nullptr, client->fd, nullptr, client->pipe_bytes,
+                               SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+            if (n == -1) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+                close_client(loop, client);
+                return;
             }
-            else {
-                // Existing client
-                auto it = clients.find(events[i].data.fd);
-                if (it == clients.end()) continue;
-                
-                Client* client = it->second;
-                
-                if (events[i].events & EPOLLIN) {
-                    handle_client_read(client, epoll_fd);
-                }
-                
-                if (events[i].events & EPOLLOUT) {
-                    handle_client_write(client, epoll_fd);
-                }
-                
-                if (events[i].events & (EPOLLERR | EPOLLHUP)) {
-                    std::cout << "Error on client: fd " << client->fd << std::endl;
-                    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, client->fd, nullptr);
-                    close(client->fd);
-                    clients.erase(client->fd);
-                    delete client;
-                }
+            client->pipe_bytes -= n;
+            bump(loop->bytes_echoed, n);
+        }
+        
+        // Send buffer full: the rest of the input stays in the socket until EPOLLOUT
+        if (client->pipe_bytes > 0) break;
+        
+        // 2. Socket -> pipe: the pipe is empty, so EAGAIN here means the socket is drained
+        bump(loop->syscalls, 1);
+        ssize_t n = splice(client->fd, nullptr, client->pipe_wr, nullptr, loop->pipes.capacity,
+                           SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (n == 0) {
+            if (loop->config->verbose) {
+                std::cout << "[loop " << loop->id << "] Client disconnected: fd " 
+                          << client->fd << std::endl;
             }
+            close_client(loop, client);
+            return;
         }
+        if (n == -1) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            close_client(loop, client);
+            return;
+        }
+        client->pipe_bytes += n;
     }
     
-    return 0;
-}
\ No newline at end of file
+    bool has_output = client->pipe_bytes > 0;
+    if (has_output != had_output) {
+        struct epoll_event ev;
+        ev.events = has_output ? (EPOLLIN | EPOLLOUT | EPOLLET) : (EPOLLIN | EPOLLET);
+        ev.data.u64 = slot_tag(client);
+        bump(loop->syscalls, 1);
+        epoll_ctl(loop->epoll_fd, EPOLL_CTL_MOD, client->fd, &ev);
+    }
+    
+    // Idle again: give the pipe back so only busy connections hold one
+    if (!has_output) release_pipe(loop, client);
+}
+
+#ifdef HAVE_LIBURING
+#define URING_ENTRIES 4096
+#define URING_BUFFERS 4096      // Provided buffers per loop, power of two
+#define URING_BUFFER_SIZE 4096
+#define URING_BGID 0
+#define URING_PROBE_BUFFERS 8   // Startup check that ring-mapped buffers work here
+
+enum UringOp : uint64_t {
+    OP_ACCEPT = 1,
+    OP_RECV,
+    OP_SEND,
+    OP_CLOSE,
+    OP_CANCEL,
+    OP_PROVIDE
+};
+
+// user_data = op | buffer id | fd, so a CQE needs no lookup
+static inline uint64_t uring_tag(UringOp op, int fd, uint32_t bid) {
+    return (uint64_t)op << 56 | (uint64_t)bid << 32 | (uint32_t)fd;
+}
+
+struct UringBackend {
+    struct io_uring ring;
+    struct io_uring_buf_ring* buf_ring;  // Null: buffers go back with IORING_OP_PROVIDE_BUFFERS
+    char* buffers;
+    
+    // Per provided buffer: echo length, bytes sent so far, next bid in its connection's queue
+    uint32_t length[URING_BUFFERS];
+    uint32_t sent[URING_BUFFERS];
+    int32_t next[URING_BUFFERS];
+    
+    std::vector<int> starved;  // fds whose recv stopped with -ENOBUFS
+};
+
+struct io_uring_sqe* uring_sqe(EventLoop* loop, UringBackend* u) {
+    struct io_uring_sqe* sqe = io_uring_get_sqe(&u->ring);
+    if (!sqe) {
+        // SQ full: hand what we have to the kernel, then there is room again
+        bump(loop->syscalls, 1);
+        io_uring_submit(&u->ring);
+        sqe = io_uring_get_sqe(&u->ring);
+    }
+    return sqe;
+}
+
+void uring_arm_accept(EventLoop* loop, UringBackend* u) {
+    struct io_uring_sqe* sqe = uring_sqe(loop, u);
+    io_uring_prep_multishot_accept(sqe, loop->server_fd, nullptr, nullptr, 0);
+    io_uring_sqe_set_data64(sqe, uring_tag(OP_ACCEPT, loop->server_fd, 0));
+}
+
+void uring_arm_recv(EventLoop* loop, UringBackend* u, Client* client) {
+    struct io_uring_sqe* sqe = uring_sqe(loop, u);
+    io_uring_prep_recv_multishot(sqe, client->fd, nullptr, 0, 0);
+    sqe->flags |= IOSQE_BUFFER_SELECT;  // Kernel picks a buffer from the ring
+    sqe->buf_group = URING_BGID;
+    io_uring_sqe_set_data64(sqe, uring_tag(OP_RECV, client->fd, 0));
+    client->recv_armed = true;
+}
+
+void uring_send_head(EventLoop* loop, UringBackend* u, Client* client) {
+    int32_t bid = client->send_head;
+    
+    struct io_uring_sqe* sqe = uring_sqe(loop, u);
+    io_uring_prep_send(sqe, client->fd, u->buffers + (size_t)bid * URING_BUFFER_SIZE + u->sent[bid],
+                       u->length[bid] - u->sent[bid], MSG_WAITALL | MSG_NOSIGNAL);
+    io_uring_sqe_set_data64(sqe, uring_tag(OP_SEND, client->fd, bid));
+    client->send_inflight = true;
+}
+
+// Give `count` buffers starting at bid back to the kernel. With the ring that is a
+// store to shared memory; without it, one PROVIDE_BUFFERS SQE riding the next submit.
+void uring_recycle(EventLoop* loop, UringBackend* u, uint32_t bid, uint32_t count = 1) {
+    if (!u->buf_ring) {
+        struct io_uring_sqe* sqe = uring_sqe(loop, u);
+        io_uring_prep_provide_buffers(sqe, u->buffers + (size_t)bid * URING_BUFFER_SIZE,
+                                      URING_BUFFER_SIZE, count, URING_BGID, bid);
+        io_uring_sqe_set_data64(sqe, uring_tag(OP_PROVIDE, -1, 0));
+        return;
+    }
+    
+    for (uint32_t i = 0; i < count; i++) {
+        io_uring_buf_ring_add(u->buf_ring, u->buffers + (size_t)(bid + i) * URING_BUFFER_SIZE,
+                              URING_BUFFER_SIZE, bid + i, io_uring_buf_ring_mask(URING_BUFFERS), i);
+    }
+    io_uring_buf_ring_advance(u->buf_ring, count);
+}
+
+// Close only once nothing in the kernel still references the fd
+void uring_maybe_close(EventLoop* loop, UringBackend* u, Client* client) {
+    if (!client->closing) return;
+    
+    if (client->recv_armed) {
+        // Completes the multishot recv with -ECANCELED, which brings us back here.
+        // Sends still completing come through here too: cancel once.
+        if (client->cancel_sent) return;
+        client->cancel_sent = true;
+        
+        struct io_uring_sqe* sqe = uring_sqe(loop, u);
+        io_uring_prep_cancel64(sqe, uring_tag(OP_RECV, client->fd, 0), 0);
+        io_uring_sqe_set_data64(sqe, uring_tag(OP_CANCEL, client->fd, 0));
+        return;
+    }
+    if (client->send_inflight) return;
+    
+    // Buffers that never got sent go back to the ring
+    while (client->send_head != -1) {
+        int32_t bid = client->send_head;
+        client->send_head = u->next[bid];
+        uring_recycle(loop, u, bid);
+    }
+    
+    struct io_uring_sqe* sqe = uring_sqe(loop, u);
+    io_uring_prep_close(sqe, client->fd);
+    io_uring_sqe_set_data64(sqe, uring_tag(OP_CLOSE, client->fd, 0));
+    
+    if (loop->config->verbose) {
+        std::cout << "[loop " << loop->id << "] Client disconnected: fd " << client->fd << std::endl;
+    }
+    
+    // The fd number can't be handed out again before the close completes
+    release_slot(client);
+    loop->active--;
+}
+
+void uring_handle_cqe(EventLoop* loop, UringBackend* u, struct io_uring_cqe* cqe) {
+    uint64_t data = io_uring_cqe_get_data64(cqe);
+    UringOp op = (UringOp)(data >> 56);
+    int fd = (int)(uint32_t)data;
+    uint32_t bid = (data >> 32) & 0xffff;
+    bool more = cqe->flags & IORING_CQE_F_MORE;
+    
+    switch (op) {
+    case OP_ACCEPT: {
+        if (!more) uring_arm_accept(loop, u);  // Multishot ended, re-arm
+        if (cqe->res < 0) break;
+        
+        Client* client = acquire_slot(loop->table, cqe->res);
+        if (!client) {
+            bump(loop->syscalls, 1);
+            close(cqe->res);
+            break;
+        }
+        
+        loop->active++;
+        bump(loop->accepted, 1);
+        if (loop->config->verbose) {
+            std::cout << "[loop " << loop->id << "] New client: fd " << client->fd 
+                      << " (total: " << loop->active << ")" << std::endl;
+        }
+        
+        uring_arm_recv(loop, u, client);
+        break;
+    }
+    
+    case OP_RECV: {
+        Client* client = &loop->table->slots[fd];
+        if (!more) client->recv_armed = false;
+        
+        if (cqe->res > 0) {
+            // Echo the buffer the kernel filled: append to this connection's send queue
+            uint32_t filled = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+            u->length[filled] = cqe->res;
+            u->sent[filled] = 0;
+            u->next[filled] = -1;
+            
+            if (client->send_tail == -1) {
+                client->send_head = filled;
+            } else {
+                u->next[client->send_tail] = filled;
+            }
+            client->send_tail = filled;
+            
+            if (!client->send_inflight && !client->closing) uring_send_head(loop, u, client);
+            if (!more && !client->closing) uring_arm_recv(loop, u, client);
+        } else if (cqe->res == -ENOBUFS && !client->closing) {
+            // Every buffer is waiting on a send: resume once one is recycled
+            u->starved.push_back(fd);
+        } else {
+            // 0 = peer closed, otherwise error or our own cancel
+            client->closing = true;
+        }
+        
+        uring_maybe_close(loop, u, client);
+        break;
+    }
+    
+    case OP_SEND: {
+        Client* client = &loop->table->slots[fd];
+        client->send_inflight = false;
+        
+        if (cqe->res < 0) {
+            client->closing = true;
+        } else {
+            u->sent[bid] += cqe->res;
+            bump(loop->bytes_echoed, cqe->res);
+            
+            if (u->sent[bid] < u->length[bid] && !client->closing) {
+                uring_send_head(loop, u, client);  // Short send: rest of the same buffer
+                break;
+            }
+            
+            // Buffer fully echoed: back to the kernel, then the next one for this connection
+            client->send_head = u->next[bid];
+            if (client->send_head == -1) client->send_tail = -1;
+            uring_recycle(loop, u, bid);
+            
+            if (client->send_head != -1 && !client->closing) uring_send_head(loop, u, client);
+        }
+        
+        // A buffer came back: connections that ran dry can receive again
+        while (!u->starved.empty()) {
+            Client* starved = &loop->table->slots[u->starved.back()];
+            u->starved.pop_back();
+            if (starved->fd != -1 && !starved->recv_armed && !starved->closing) {
+                uring_arm_recv(loop, u, starved);
+            }
+        }
+        
+        uring_maybe_close(loop, u, client);
+        break;
+    }
+    
+    case OP_PROVIDE:
+        if (cqe->res < 0) std::cerr << "IORING_OP_PROVIDE_BUFFERS: " << strerror(-cqe->res) << std::endl;
+        break;
+        
+    case OP_CLOSE:
+    case OP_CANCEL:
+        break;
+    }
+}
+
+// Does a recv actually get a buffer from a registered ring? Some kernels accept the
+// registration and then fail every selection with -ENOBUFS, ring full or not, which
+// would leave every connection starved. One byte through a socketpair tells; the probe
+// uses a throwaway ring so a misbehaving registration can't touch the loop's own.
+bool uring_buf_ring_usable() {
+    struct io_uring ring;
+    if (io_uring_queue_init(URING_PROBE_BUFFERS, &ring, 0) < 0) return false;
+    
+    int ret;
+    struct io_uring_buf_ring* buf_ring = io_uring_setup_buf_ring(&ring, URING_PROBE_BUFFERS, URING_BGID, 0, &ret);
+    if (!buf_ring) {
+        io_uring_queue_exit(&ring);
+        return false;
+    }
+    static char probe[URING_PROBE_BUFFERS][64];
+    for (int bid = 0; bid < URING_PROBE_BUFFERS; bid++) {
+        io_uring_buf_ring_add(buf_ring, probe[bid], sizeof(probe[bid]), bid,
+                              io_uring_buf_ring_mask(URING_PROBE_BUFFERS), bid);
+    }
+    io_uring_buf_ring_advance(buf_ring, URING_PROBE_BUFFERS);
+    
+    bool usable = false;
+    int sv[2];
+    struct io_uring_sqe* sqe = io_uring_get_sqe(&ring);
+    if (sqe && socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) == 0) {
+        if (write(sv[0], "p", 1) == 1) {
+            io_uring_prep_recv(sqe, sv[1], nullptr, 0, 0);
+            sqe->flags |= IOSQE_BUFFER_SELECT;
+            sqe->buf_group = URING_BGID;
+            
+            struct io_uring_cqe* cqe;
+            if (io_uring_submit_and_wait(&ring, 1) >= 0 && io_uring_peek_cqe(&ring, &cqe) == 0) {
+                usable = cqe->res == 1 && (cqe->flags & IORING_CQE_F_BUFFER);
+            }
+        }
+        close(sv[0]);
+        close(sv[1]);
+    }
+    
+    io_uring_free_buf_ring(&ring, buf_ring, URING_PROBE_BUFFERS, URING_BGID);
+    io_uring_queue_exit(&ring);
+    return usable;
+}
+
+void run_uring_loop(EventLoop* loop) {
+    UringBackend* u = new UringBackend;
+    
+    // One thread owns the ring: let the kernel skip locking and defer task work to our wait
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN;
+    
+    if (io_uring_queue_init_params(URING_ENTRIES, &u->ring, &params) < 0) {
+        memset(&params, 0, sizeof(params));
+        int ret = io_uring_queue_init_params(URING_ENTRIES, &u->ring, &params);
+        if (ret < 0) {
+            std::cerr << "io_uring_queue_init: " << strerror(-ret) << std::endl;
+            return;
+        }
+    }
+    
+    u->buffers = new char[(size_t)URING_BUFFERS * URING_BUFFER_SIZE];
+    u->buf_ring = nullptr;
+    if (uring_buf_ring_usable()) {
+        int ret;
+        u->buf_ring = io_uring_setup_buf_ring(&u->ring, URING_BUFFERS, URING_BGID, 0, &ret);
+    }
+    uring_recycle(loop, u, 0, URING_BUFFERS);  // Without the ring: one SQE, submitted with the accept
+    
+    if (loop->id == 0) {
+        std::cout << "io_uring: " << (u->buf_ring ? "provided buffer ring" : "IORING_OP_PROVIDE_BUFFERS")
+                  << ", " << URING_BUFFERS << " x " << URING_BUFFER_SIZE / 1024 << " KB buffers" << std::endl;
+    }
+    
+    uring_arm_accept(loop, u);
+    
+    while (true) {
+        // Submit everything queued by the last batch and sleep until at least one completion
+        bump(loop->syscalls, 1);
+        int ret = io_uring_submit_and_wait(&u->ring, 1);
+        if (ret < 0 && ret != -EINTR) {
+            std::cerr << "io_uring_submit_and_wait: " << strerror(-ret) << std::endl;
+            break;
+        }
+        
+        unsigned head;
+        unsigned count = 0;
+        struct io_uring_cqe* cqe;
+        
+        io_uring_for_each_cqe(&u->ring, head, cqe) {
+            uring_handle_cqe(loop, u, cqe);
+            count++;
+        }
+        io_uring_cq_advance(&u->ring, count);
+    }
+}
+#endif
+
+void pin_to_cpu(int cpu) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    
+    int ret = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (ret != 0) {
+        std::cerr << "pthread_setaffinity_np(" << cpu << "): " << strerror(ret) << std::endl;
+    }
+}
+
+bool init_event_loop(EventLoop* loop, bool reuseport) {
+    loop->server_fd = create_listener(loop->config->port, reuseport);
+    if (loop->server_fd == -1) return false;
+    
+    // The io_uring backend watches the listener with multishot accept instead
+    loop->epoll_fd = -1;
+    if (loop->config->uring) return true;
+    
+    // Create epoll
+    loop->epoll_fd = epoll_create1(0);
+    if (loop->epoll_fd == -1) {
+        perror("epoll_create1");
+        return false;
+    }
+    
+    struct epoll_event ev;
+    ev.events = EPOLLIN | EPOLLET;
+    ev.data.u64 = LISTENER_TAG;
+    epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, loop->server_fd, &ev);
+    
+    // epoll_wait busy-polls the NAPI queues of its sockets before sleeping (6.9+)
+    if (loop->config->busy_poll_usec > 0) {
+        struct epoll_params params;
+        memset(&params, 0, sizeof(params));
+        params.busy_poll_usecs = loop->config->busy_poll_usec;
+        params.busy_poll_budget = 8;
+        params.prefer_busy_poll = 1;
+        if (ioctl(loop->epoll_fd, EPIOCSPARAMS, &params) == -1) {
+            perror("ioctl EPIOCSPARAMS");
+        }
+    }
+    
+    return true;
+}
+
+void run_event_loop(EventLoop* loop) {
+    struct epoll_event events[MAX_EVENTS];
+    int spin_polls = loop->config->spin_polls;
+    int empty_polls = 0;
+    
+    while (true) {
+        // Connections waiting for budget are polled, nothing else wakes them
+        int timeout = loop->budget_waiters.empty() ? -1 : BUDGET_RETRY_MS;
+        
+        // Busy-poll: never sleep while the spin budget lasts, so a new event
+        // costs no wakeup (scheduler + IPI). Block once it runs out.
+        bool spinning = spin_polls < 0 || empty_polls < spin_polls;
+        if (spinning) timeout = 0;
+        
+        bump(loop->syscalls, 1);
+        int nfds = epoll_wait(loop->epoll_fd, events, MAX_EVENTS, timeout);
+        
+        if (nfds > 0) {
+            empty_polls = 0;
+        } else if (spinning) {
+            empty_polls++;
+            bump(loop->idle_polls, 1);
+        }
+        
+        for (int i = 0; i < nfds; i++) {
+            if (events[i].data.u64 == LISTENER_TAG) {
+                // New connections
+                handle_new_connection(loop);
+            }
+            else {
+                // Existing client: data points at its slot, no lookup
+                Client* client = resolve_tag(events[i].data.u64);
+                if (!client) continue;  // Stale event for a closed connection
+                
+                if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+                    if (loop->config->verbose) {
+                        std::cout << "[loop " << loop->id << "] Error on client: fd " 
+                                  << client->fd << std::endl;
+                    }
+                    close_client(loop, client);
+                    continue;
+                }
+                
+                if (loop->config->splice) {
+                    handle_splice_io(loop, client);
+                    continue;
+                }
+                
+                if (events[i].events & EPOLLIN) {
+                    handle_client_read(loop, client);
+                    
+                    // Read may have closed the client
+                    if (client->fd == -1) continue;
+                }
+                
+                if (events[i].events & EPOLLOUT) {
+                    handle_client_write(loop, client);
+                }
+            }
+        }
+        
+        if (!loop->budget_waiters.empty()) {
+            retry_budget_waiters(loop);
+        }
+    }
+}
+
+void run_loop(EventLoop* loop) {
+#ifdef HAVE_LIBURING
+    if (loop->config->uring) {
+        run_uring_loop(loop);
+        return;
+    }
+#endif
+    run_event_loop(loop);
+}
+
+void* event_loop_thread(void* arg) {
+    EventLoop* loop = (EventLoop*)arg;
+    
+    if (loop->config->pin) {
+        pin_to_cpu(loop->cpu);
+    }
+    
+    run_loop(loop);
+    return nullptr;
+}
+
+// Per-loop rates and throttling counters once a second, so scaling and backpressure
+// are visible. Runs on its own thread in every mode; the loops only bump relaxed atomics.
+void* stats_thread(void* arg) {
+    std::vector<EventLoop*>& loops = *(std::vector<EventLoop*>*)arg;
+    
+    std::vector<uint64_t> last_accepted(loops.size(), 0);
+    std::vector<uint64_t> last_bytes(loops.size(), 0);
+    std::vector<uint64_t> last_throttled(loops.size(), 0);
+    
+    while (true) {
+        sleep(1);
+        
+        uint64_t total_accepts = 0;
+        uint64_t total_bytes = 0;
+        
+        for (size_t i = 0; i < loops.size(); i++) {
+            uint64_t accepted = loops[i]->accepted.load(std::memory_order_relaxed);
+            uint64_t bytes = loops[i]->bytes_echoed.load(std::memory_order_relaxed);
+            
+            uint64_t throttled = loops[i]->throttled_high.load(std::memory_order_relaxed) +
+                                 loops[i]->throttled_budget.load(std::memory_order_relaxed);
+            
+            uint64_t accepts_per_sec = accepted - last_accepted[i];
+            uint64_t bytes_per_sec = bytes - last_bytes[i];
+            uint64_t throttled_per_sec = throttled - last_throttled[i];
+            last_accepted[i] = accepted;
+            last_bytes[i] = bytes;
+            last_throttled[i] = throttled;
+            
+            total_accepts += accepts_per_sec;
+            total_bytes += bytes_per_sec;
+            
+            if (accepts_per_sec || bytes_per_sec) {
+                std::cout << "  loop " << i << " (cpu " << loops[i]->cpu << "): "
+                          << accepts_per_sec << " accepts/s, "
+                          << bytes_per_sec / (1024.0 * 1024.0) << " MB/s, "
+                          << throttled_per_sec << " throttles/s (high "
+                          << loops[i]->throttled_high.load(std::memory_order_relaxed) << ", budget "
+                          << loops[i]->throttled_budget.load(std::memory_order_relaxed) << ", resumed "
+                          << loops[i]->resumed.load(std::memory_order_relaxed) << ")" << std::endl;
+            }
+        }
+        
+        if (total_accepts || total_bytes) {
+            std::cout << "TOTAL: " << total_accepts << " accepts/s, "
+                      << total_bytes / (1024.0 * 1024.0) << " MB/s, "
+                      << queued_memory.load(std::memory_order_relaxed) / (1024.0 * 1024.0) 
+                      << " MB queued\n" << std::endl;
+        }
+    }
+    
+    return nullptr;
+}
+
+ServerConfig parse_args(int argc, char* argv[]) {
+    ServerConfig config;
+    
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--loops") == 0 && i + 1 < argc) {
+            config.loops = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--port") == 0 && i + 1 < argc) {
+            config.port = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--no-pin") == 0) {
+            config.pin = false;
+        } else if (strcmp(argv[i], "--quiet") == 0) {
+            config.verbose = false;
+        } else if (strcmp(argv[i], "--max-fds") == 0 && i + 1 < argc) {
+            config.max_fds = strtoul(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "--splice") == 0) {
+            config.splice = true;
+        } else if (strcmp(argv[i], "--uring") == 0) {
+            config.uring = true;
+        } else if (strcmp(argv[i], "--high-water") == 0 && i + 1 < argc) {
+            config.high_watermark = strtoul(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "--low-water") == 0 && i + 1 < argc) {
+            config.low_watermark = strtoul(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "--budget") == 0 && i + 1 < argc) {
+            config.memory_budget = strtoul(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "--no-inline-write") == 0) {
+            config.inline_write = false;
+        } else if (strcmp(argv[i], "--busy-poll") == 0 && i + 1 < argc) {
+            config.spin_polls = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--spin") == 0) {
+            config.spin_polls = -1;
+        } else if (strcmp(argv[i], "--so-busy-poll") == 0 && i + 1 < argc) {
+            config.busy_poll_usec = atoi(argv[++i]);
+        } else {
+            std::cerr << "Usage: " << argv[0] 
+                      << " [--loops N] [--port P] [--no-pin] [--quiet] [--max-fds N] [--splice | --uring]"
+                      << "\n         [--high-water BYTES] [--low-water BYTES] [--budget BYTES] [--no-inline-write]"
+                      << "\n         [--busy-poll N | --spin] [--so-busy-poll USEC]"
+                      << "\n       " << argv[0] << " --bench-table | --bench-echo | --bench-uring | --bench-syscalls | --bench-latency" << std::endl;
+            exit(1);
+        }
+    }
+    
+#ifndef HAVE_LIBURING
+    if (config.uring) {
+        std::cerr << "--uring: built without liburing" << std::endl;
+        exit(1);
+    }
+#endif
+    
+    if (config.loops < 1) config.loops = 1;
+    if (config.low_watermark > config.high_watermark) config.low_watermark = config.high_watermark;
+    if (config.memory_budget < CHUNK_SIZE) config.memory_budget = CHUNK_SIZE;
+    return config;
+}
+
+// ---------------------------------------------------------------------------
+// --bench-table: std::map<int, Client*> + new Client vs the fd-indexed slab.
+// No sockets: a fake epoll_event stream over BENCH_CONNECTIONS "fds".
+// ---------------------------------------------------------------------------
+#define BENCH_CONNECTIONS 100000
+#define BENCH_EVENTS 10000000
+#define BENCH_CHURN 1000000
+
+double elapsed_ns(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::nano>(
+        std::chrono::steady_clock::now() - start).count();
+}
+
+void benchmark_connection_tables() {
+    std::cout << "=== Connection table benchmark: " << BENCH_CONNECTIONS 
+              << " connections ===" << std::endl;
+    
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<int> pick(0, BENCH_CONNECTIONS - 1);
+    
+    // Same random fd order for both tables (fds start after stdio + listener)
+    std::vector<int> order(BENCH_EVENTS);
+    for (int& fd : order) fd = pick(rng) + 4;
+    
+    // --- map: one heap node + one heap Client per connection ---
+    std::map<int, Client*> client_map;
+    for (int i = 0; i < BENCH_CONNECTIONS; i++) {
+        Client* client = new Client;
+        client->fd = i + 4;
+        client_map[i + 4] = client;
+    }
+    
+    std::vector<struct epoll_event> map_events(BENCH_EVENTS);
+    for (size_t i = 0; i < order.size(); i++) map_events[i].data.fd = order[i];
+    
+    size_t checksum = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (const struct epoll_event& ev : map_events) {
+        auto it = client_map.find(ev.data.fd);
+        if (it == client_map.end()) continue;
+        checksum += it->second->fd;
+    }
+    double map_dispatch = elapsed_ns(start) / BENCH_EVENTS;
+    
+    // --- slab: data.u64 is the slot itself ---
+    ConnectionTable table;
+    init_connection_table(&table, BENCH_CONNECTIONS + 4);
+    for (int i = 0; i < BENCH_CONNECTIONS; i++) acquire_slot(&table, i + 4);
+    
+    std::vector<struct epoll_event> slab_events(BENCH_EVENTS);
+    for (size_t i = 0; i < order.size(); i++) {
+        slab_events[i].data.u64 = slot_tag(&table.slots[order[i]]);
+    }
+    
+    size_t slab_checksum = 0;
+    start = std::chrono::steady_clock::now();
+    for (const struct epoll_event& ev : slab_events) {
+        Client* client = resolve_tag(ev.data.u64);
+        if (!client) continue;
+        slab_checksum += client->fd;
+    }
+    double slab_dispatch = elapsed_ns(start) / BENCH_EVENTS;
+    
+    // --- churn: close one connection, accept a new one on the same fd ---
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < BENCH_CHURN; i++) {
+        int fd = order[i];
+        auto it = client_map.find(fd);
+        delete it->second;
+        client_map.erase(it);
+        
+        Client* client = new Client;
+        client->fd = fd;
+        client_map[fd] = client;
+    }
+    double map_churn = elapsed_ns(start) / BENCH_CHURN;
+    
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < BENCH_CHURN; i++) {
+        int fd = order[i];
+        release_slot(&table.slots[fd]);
+        acquire_slot(&table, fd);
+    }
+    double slab_churn = elapsed_ns(start) / BENCH_CHURN;
+    
+    // Stale event: tag taken before a close/reopen must not resolve
+    uint64_t stale = slot_tag(&table.slots[4]);
+    release_slot(&table.slots[4]);
+    acquire_slot(&table, 4);
+    
+    std::cout << "\nDispatch (" << BENCH_EVENTS << " random events):" << std::endl;
+    std::cout << "  map.find(fd):      " << map_dispatch << " ns/event" << std::endl;
+    std::cout << "  data.u64 -> slot:  " << slab_dispatch << " ns/event" << std::endl;
+    std::cout << "  speedup:           " << map_dispatch / slab_dispatch << "x" << std::endl;
+    
+    std::cout << "\nClose + accept (" << BENCH_CHURN << " reconnects):" << std::endl;
+    std::cout << "  map + new/delete:  " << map_churn << " ns/reconnect" << std::endl;
+    std::cout << "  slab release/acquire: " << slab_churn << " ns/reconnect" << std::endl;
+    
+    std::cout << "\nStale event after fd reuse detected: " 
+              << (resolve_tag(stale) == nullptr ? "yes" : "NO") << std::endl;
+    std::cout << "(checksums " << checksum << " / " << slab_checksum << ")" << std::endl;
+    
+    for (auto& entry : client_map) delete entry.second;
+    delete[] table.slots;
+}
+
+// ---------------------------------------------------------------------------
+// --bench-echo: real sockets over loopback. The server runs in a background
+// thread, the client sends one payload, waits for the full echo, repeats.
+// ---------------------------------------------------------------------------
+#define BENCH_SECONDS 1.0
+
+void* bench_server_thread(void* arg) {
+    run_loop((EventLoop*)arg);
+    return nullptr;
+}
+
+// Starts a single-loop server on an ephemeral port, returns the port
+int start_bench_server(ServerConfig* config, EventLoop** out_loop = nullptr) {
+    config->port = 0;
+    config->verbose = false;
+    
+    EventLoop* loop = new EventLoop;
+    loop->id = 0;
+    loop->cpu = 0;
+    loop->config = config;
+    loop->table = &connections;
+    if (!init_event_loop(loop, false)) exit(1);
+    
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    getsockname(loop->server_fd, (struct sockaddr*)&addr, &len);
+    
+    // Runs until the process exits
+    pthread_t thread;
+    pthread_create(&thread, nullptr, bench_server_thread, loop);
+    pthread_detach(thread);
+    
+    if (out_loop) *out_loop = loop;
+    return ntohs(addr.sin_port);
+}
+
+int connect_loopback(int port) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) == -1) {
+        perror("connect");
+        exit(1);
+    }
+    return fd;
+}
+
+// Send payload and read the echo back concurrently (a 1 MB payload doesn't fit
+// in the socket buffers, so sending it all before reading would deadlock)
+bool echo_round_trip(int fd, const char* out, char* in, size_t payload) {
+    size_t sent = 0;
+    size_t received = 0;
+    
+    while (received < payload) {
+        struct pollfd pfd;
+        pfd.fd = fd;
+        pfd.events = POLLIN | (sent < payload ? POLLOUT : 0);
+        if (poll(&pfd, 1, 5000) <= 0) return false;
+        
+        if ((pfd.revents & POLLOUT) && sent < payload) {
+            ssize_t n = send(fd, out + sent, payload - sent, MSG_DONTWAIT | MSG_NOSIGNAL);
+            if (n > 0) sent += n;
+        }
+        if (pfd.revents & POLLIN) {
+            ssize_t n = recv(fd, in + received, payload - received, MSG_DONTWAIT);
+            if (n == 0) return false;
+            if (n > 0) received += n;
+        }
+    }
+    return true;
+}
+
+double bench_echo_throughput(int port, size_t payload) {
+    int fd = connect_loopback(port);
+    std::vector<char> out(payload, 'x');
+    std::vector<char> in(payload);
+    
+    size_t rounds = 0;
+    auto start = std::chrono::steady_clock::now();
+    double seconds = 0;
+    
+    while (seconds < BENCH_SECONDS) {
+        if (!echo_round_trip(fd, out.data(), in.data(), payload)) {
+            std::cerr << "echo failed" << std::endl;
+            break;
+        }
+        rounds++;
+        seconds = elapsed_ns(start) / 1e9;
+    }
+    
+    close(fd);
+    return rounds * payload / seconds / (1024.0 * 1024.0);
+}
+
+void benchmark_echo_paths() {
+    std::cout << "=== Echo throughput: copy vs splice (1 connection, loopback) ===" << std::endl;
+    
+    init_connection_table(&connections, raise_fd_limit(DEFAULT_MAX_FDS));
+    
+    static ServerConfig copy_config;
+    static ServerConfig splice_config;
+    splice_config.splice = true;
+    
+    int copy_port = start_bench_server(&copy_config);
+    int splice_port = start_bench_server(&splice_config);
+    
+    const size_t payloads[] = {4096, 65536, 1024 * 1024};
+    
+    std::cout << "\n  payload      copy MB/s    splice MB/s" << std::endl;
+    for (size_t payload : payloads) {
+        double copy = bench_echo_throughput(copy_port, payload);
+        double zero_copy = bench_echo_throughput(splice_port, payload);
+        
+        printf("  %7zu KB  %10.1f  %12.1f\n", payload / 1024, copy, zero_copy);
+    }
+}
+
+// Many connections, each with one small message in flight: the request/response
+// pattern where per-message syscall overhead dominates. Returns round trips.
+uint64_t run_pingpong_clients(int port, int conns, size_t payload, double seconds) {
+    int epoll_fd = epoll_create1(0);
+    std::vector<int> fds(conns);
+    std::vector<size_t> received(conns, 0);
+    std::vector<char> out(payload, 'p');
+    std::vector<char> in(payload);
+    
+    for (int i = 0; i < conns; i++) {
+        fds[i] = connect_loopback(port);
+        set_nonblocking(fds[i]);
+        
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.u32 = i;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fds[i], &ev);
+        send(fds[i], out.data(), payload, MSG_NOSIGNAL);
+    }
+    
+    uint64_t round_trips = 0;
+    struct epoll_event events[MAX_EVENTS];
+    auto start = std::chrono::steady_clock::now();
+    
+    while (elapsed_ns(start) / 1e9 < seconds) {
+        int nfds = epoll_wait(epoll_fd, events, MAX_EVENTS, 100);
+        
+        for (int e = 0; e < nfds; e++) {
+            int i = events[e].data.u32;
+            ssize_t n = recv(fds[i], in.data(), payload - received[i], 0);
+            if (n <= 0) continue;
+            
+            received[i] += n;
+            if (received[i] == payload) {
+                received[i] = 0;
+                round_trips++;
+                send(fds[i], out.data(), payload, MSG_NOSIGNAL);
+            }
+        }
+    }
+    
+    for (int fd : fds) close(fd);
+    close(epoll_fd);
+    return round_trips;
+}
+
+// 0 = both backends echoed at every connection count
+int benchmark_epoll_vs_uring() {
+    std::cout << "=== Echo backends: epoll (edge-triggered) vs io_uring ===" << std::endl;
+    
+#ifndef HAVE_LIBURING
+    std::cout << "Built without liburing, nothing to compare" << std::endl;
+    return 0;
+#else
+    init_connection_table(&connections, raise_fd_limit(DEFAULT_MAX_FDS));
+    
+    static ServerConfig epoll_config;
+    static ServerConfig uring_config;
+    uring_config.uring = true;
+    
+    EventLoop* epoll_loop;
+    EventLoop* uring_loop;
+    int epoll_port = start_bench_server(&epoll_config, &epoll_loop);
+    int uring_port = start_bench_server(&uring_config, &uring_loop);
+    
+    const int conn_counts[] = {1, 64, 512};
+    const size_t payload = 64;
+    
+    std::cout << "\n  " << payload << "-byte messages, 1 s per run" << std::endl;
+    std::cout << "  conns   epoll msgs/s  syscalls/msg   uring msgs/s  syscalls/msg" << std::endl;
+    
+    for (int conns : conn_counts) {
+        uint64_t before = epoll_loop->syscalls.load(std::memory_order_relaxed);
+        uint64_t epoll_msgs = run_pingpong_clients(epoll_port, conns, payload, BENCH_SECONDS);
+        double epoll_per_msg = (double)(epoll_loop->syscalls.load(std::memory_order_relaxed) - before) / epoll_msgs;
+        
+        before = uring_loop->syscalls.load(std::memory_order_relaxed);
+        uint64_t uring_msgs = run_pingpong_clients(uring_port, conns, payload, BENCH_SECONDS);
+        double uring_per_msg = (double)(uring_loop->syscalls.load(std::memory_order_relaxed) - before) / uring_msgs;
+        
+        // A backend that stalls (e.g. every recv starved of buffers) must not pass as 0 msgs/s
+        if (epoll_msgs == 0 || uring_msgs == 0) {
+            fflush(stdout);
+            std::cerr << "\nFAILED: " << (epoll_msgs == 0 ? "epoll" : "io_uring") << " backend echoed nothing in "
+                      << BENCH_SECONDS << " s with " << conns << " connections" << std::endl;
+            return 1;
+        }
+        
+        printf("  %5d  %13.0f  %12.2f  %13.0f  %12.2f\n", conns,
+               epoll_msgs / BENCH_SECONDS, epoll_per_msg, uring_msgs / BENCH_SECONDS, uring_per_msg);
+    }
+    
+    std::cout << "\n(syscalls counted inside the server loop; connect/close of the runs included)" << std::endl;
+    return 0;
+#endif
+}
+
+// ---------------------------------------------------------------------------
+// --bench-syscalls: MOD on every read/drain vs inline write + cached interest
+// ---------------------------------------------------------------------------
+void benchmark_interest_updates() {
+    std::cout << "=== epoll syscalls per echoed message ===" << std::endl;
+    
+    init_connection_table(&connections, raise_fd_limit(DEFAULT_MAX_FDS));
+    
+    static ServerConfig before_config;
+    static ServerConfig after_config;
+    before_config.inline_write = false;
+    
+    EventLoop* before_loop;
+    EventLoop* after_loop;
+    int before_port = start_bench_server(&before_config, &before_loop);
+    int after_port = start_bench_server(&after_config, &after_loop);
+    
+    const int conn_counts[] = {1, 64, 512};
+    const size_t payload = 64;
+    
+    std::cout << "\n  " << payload << "-byte messages, 1 s per run" << std::endl;
+    std::cout << "         MOD per read/drain            inline write + cached mask" << std::endl;
+    std::cout << "  conns        msgs/s  syscalls/msg          msgs/s  syscalls/msg" << std::endl;
+    
+    for (int conns : conn_counts) {
+        uint64_t before = before_loop->syscalls.load(std::memory_order_relaxed);
+        uint64_t before_msgs = run_pingpong_clients(before_port, conns, payload, BENCH_SECONDS);
+        double before_per_msg = (double)(before_loop->syscalls.load(std::memory_order_relaxed) - before) / before_msgs;
+        
+        before = after_loop->syscalls.load(std::memory_order_relaxed);
+        uint64_t after_msgs = run_pingpong_clients(after_port, conns, payload, BENCH_SECONDS);
+        double after_per_msg = (double)(after_loop->syscalls.load(std::memory_order_relaxed) - before) / after_msgs;
+        
+        printf("  %5d  %12.0f  %12.2f    %12.0f  %12.2f\n", conns,
+               before_msgs / BENCH_SECONDS, before_per_msg, after_msgs / BENCH_SECONDS, after_per_msg);
+    }
+    
+    std::cout << "\n(syscalls counted inside the server loop; connect/close of the runs included)" << std::endl;
+}
+
+// ---------------------------------------------------------------------------
+// --bench-latency: blocking vs hybrid vs pure-spin loop. One client sends a
+// 64-byte request every LATENCY_GAP_US, so the server goes idle in between
+// (the case where the sleep/wakeup shows up in the round trip).
+// ---------------------------------------------------------------------------
+#define LATENCY_GAP_US 50
+#define LATENCY_SPIN_POLLS 20000
+
+// Sorted round-trip times in ns
+std::vector<uint64_t> measure_round_trips(int port, size_t payload, double seconds) {
+    int fd = connect_loopback(port);
+    int nodelay = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+    
+    std::vector<char> out(payload, 'l');
+    std::vector<char> in(payload);
+    std::vector<uint64_t> samples;
+    auto start = std::chrono::steady_clock::now();
+    
+    while (elapsed_ns(start) / 1e9 < seconds) {
+        auto sent_at = std::chrono::steady_clock::now();
+        if (send(fd, out.data(), payload, MSG_NOSIGNAL) != (ssize_t)payload) break;
+        
+        size_t received = 0;
+        while (received < payload) {
+            ssize_t n = recv(fd, in.data() + received, payload - received, 0);
+            if (n <= 0) break;
+            received += n;
+        }
+        if (received < payload) break;
+        
+        samples.push_back(elapsed_ns(sent_at));
+        usleep(LATENCY_GAP_US);
+    }
+    
+    close(fd);
+    std::sort(samples.begin(), samples.end());
+    return samples;
+}
+
+void benchmark_busy_poll() {
+    std::cout << "=== Event loop wakeup modes: round-trip latency ===" << std::endl;
+    
+    init_connection_table(&connections, raise_fd_limit(DEFAULT_MAX_FDS));
+    long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+    
+    struct Mode {
+        const char* name;
+        int spin_polls;
+    };
+    // Pure spin last: its loop keeps burning a core until the process exits
+    const Mode modes[] = {
+        {"blocking", 0},
+        {"hybrid", LATENCY_SPIN_POLLS},
+        {"spin", -1},
+    };
+    
+    std::cout << "\n  64-byte request every " << LATENCY_GAP_US << " us, 1 connection, "
+              << BENCH_SECONDS << " s per mode, " << ncpus << " cpus" << std::endl;
+    std::cout << "  mode          samples    p50 us    p99 us  p99.9 us    max us  idle polls/msg" << std::endl;
+    
+    static ServerConfig configs[3];
+    
+    for (int m = 0; m < 3; m++) {
+        const Mode& mode = modes[m];
+        configs[m].spin_polls = mode.spin_polls;
+        
+        EventLoop* loop;
+        int port = start_bench_server(&configs[m], &loop);
+        
+        std::vector<uint64_t> samples = measure_round_trips(port, 64, BENCH_SECONDS);
+        uint64_t idle = loop->idle_polls.load(std::memory_order_relaxed);
+        if (samples.empty()) continue;
+        
+        auto percentile = [&samples](double p) {
+            return samples[std::min(samples.size() - 1, (size_t)(p / 100.0 * samples.size()))] / 1e3;
+        };
+        
+        printf("  %-10s  %9zu  %8.1f  %8.1f  %8.1f  %8.1f  %14.1f\n", mode.name, samples.size(),
+               percentile(50), percentile(99), percentile(99.9), samples.back() / 1e3,
+               (double)idle / samples.size());
+    }
+    
+    if (ncpus < 3) {
+        std::cout << "\n(fewer than 3 cpus: a spinning loop shares its core with the client,"
+                  << " so spin numbers here are pessimistic)" << std::endl;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    if (argc > 1 && strcmp(argv[1], "--bench-table") == 0) {
+        benchmark_connection_tables();
+        return 0;
+    }
+    if (argc > 1 && strcmp(argv[1], "--bench-echo") == 0) {
+        benchmark_echo_paths();
+        return 0;
+    }
+    if (argc > 1 && strcmp(argv[1], "--bench-uring") == 0) {
+        return benchmark_epoll_vs_uring();
+    }
+    if (argc > 1 && strcmp(argv[1], "--bench-syscalls") == 0) {
+        benchmark_interest_updates();
+        return 0;
+    }
+    if (argc > 1 && strcmp(argv[1], "--bench-latency") == 0) {
+        benchmark_busy_poll();
+        return 0;
+    }
+    
+    ServerConfig config = parse_args(argc, argv);
+    
+    std::cout << "=== High-Performance Echo Server ===" << std::endl;
+    std::cout << "Listening on port " << config.port << std::endl;
+    if (config.uring) {
+        std::cout << "io_uring: multishot accept/recv, provided buffers\n" << std::endl;
+    } else {
+        std::cout << "Edge-triggered, non-blocking I/O" 
+                  << (config.splice ? ", zero-copy splice()" : "") << "\n" << std::endl;
+    }
+    
+    size_t table_size = raise_fd_limit(config.max_fds);
+    init_connection_table(&connections, table_size);
+    std::cout << "Connection table: " << table_size << " slots x " 
+              << sizeof(Client) << " bytes" << std::endl;
+    if (!config.uring && !config.splice) {
+        std::cout << "Backpressure: pause reads at " << config.high_watermark / 1024 
+                  << " KB queued, resume at " << config.low_watermark / 1024 << " KB, budget "
+                  << config.memory_budget / (1024 * 1024) << " MB" << std::endl;
+    }
+    std::cout << std::endl;
+    
+    if (config.loops == 1) {
+        // Classic single reactor on the main thread
+        EventLoop loop;
+        loop.id = 0;
+        loop.cpu = 0;
+        loop.config = &config;
+        loop.table = &connections;
+        if (!init_event_loop(&loop, false)) return 1;
+        
+        std::vector<EventLoop*> loops = {&loop};
+        pthread_t stats;
+        pthread_create(&stats, nullptr, stats_thread, &loops);
+        
+        run_loop(&loop);
+        return 0;
+    }
+    
+    // Multi-reactor: N independent loops, one SO_REUSEPORT listener each
+    long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (ncpus < 1) ncpus = 1;
+    
+    std::cout << "Starting " << config.loops << " event loops (SO_REUSEPORT, "
+              << (config.pin ? "pinned" : "unpinned") << ", " << ncpus << " cpus)\n" << std::endl;
+    
+    std::vector<EventLoop*> loops;
+    for (int i = 0; i < config.loops; i++) {
+        EventLoop* loop = new EventLoop;
+        loop->id = i;
+        loop->cpu = i % ncpus;
+        loop->config = &config;
+        loop->table = &connections;
+        
+        // Bind all listeners before any loop starts so the reuseport group is complete
+        if (!init_event_loop(loop, true)) return 1;
+        loops.push_back(loop);
+    }
+    
+    std::vector<pthread_t> threads(config.loops);
+    for (int i = 0; i < config.loops; i++) {
+        pthread_create(&threads[i], nullptr, event_loop_thread, loops[i]);
+    }
+    
+    // Main thread: the stats, until killed
+    stats_thread(&loops);
+    
+    return 0;
+}
@@ -1,46 +1,560 @@
 // reactor_pattern.cpp
 #include <iostream>
 #include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <malloc.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <fcntl.h>
+#include <signal.h>
 #include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <charconv>
+#include <chrono>
+#include <exception>
 #include <functional>
 #include <map>
+#include <new>
+#include <optional>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
+#if __has_include(<liburing.h>)
+#include <liburing.h>
+#define HAVE_LIBURING 1
+#endif
+
+#if __has_include(<coroutine>) && defined(__cpp_impl_coroutine)
+#include <coroutine>
+#define HAVE_COROUTINES 1
+#endif
+
 #define MAX_EVENTS 64
 
+// Inline capture space of a Handler. 24 bytes = a Handler is 32 bytes, so an fd's
+// read and write handlers fill exactly one cache line. Bigger captures don't compile.
+#define HANDLER_CAPTURE_BYTES 24
+#define CACHE_LINE 64
+
+// Edge bits per fd: a direction epoll has reported that no syscall has drained since
+#define EDGE_READ 1
+#define EDGE_WRITE 2
+#define EDGE_READ_HUP 4  // Peer shut its side: reads stay ready, the EOF is still to be read
+
+// Tasks post() can have queued for the loop thread (power of two)
+#define POST_QUEUE_SIZE 4096
+#define POST_QUEUE_MASK (POST_QUEUE_SIZE - 1)
+
+// Timing wheel: 4 levels x 256 slots of 1 ms ticks.
+// Level 0 covers 256 ms, level 1 ~65 s, level 2 ~4.6 h, level 3 ~49 days.
+#define WHEEL_BITS 8
+#define WHEEL_SIZE (1 << WHEEL_BITS)
+#define WHEEL_MASK (WHEEL_SIZE - 1)
+#define WHEEL_LEVELS 4
+#define WHEEL_MAX_TICKS ((1ULL << (WHEEL_BITS * WHEEL_LEVELS)) - 1)
+
+struct TimerLink {
+    TimerLink* prev;
+    TimerLink* next;
+};
+
+// Intrusive timer: embed one per deadline (read, write, idle, ...) in the
+// connection object. The callback is set once; arming never allocates.
+struct Timer : TimerLink {
+    uint64_t expires = 0;  // Absolute tick
+    int level = -1;        // -1 = not armed
+    int slot = 0;
+    std::function<void()> callback;
+};
+
+// void(Args...) callable kept inline: an invoker pointer plus the lambda's own bytes.
+// No heap fallback: a capture bigger than Capacity doesn't compile. Captures must be
+// trivially copyable (pointers, references, ints), so copying or clearing one is a
+// memcpy or a store, and clearing leaves the bytes a running handler still uses intact.
+template <size_t Capacity, typename... Args>
+class InlineCallback {
+private:
+    void (*invoke)(void* storage, Args... args) = nullptr;
+    alignas(void*) unsigned char storage[Capacity];
+    
+public:
+    InlineCallback() = default;
+    
+    template <typename F, typename = std::enable_if_t<!std::is_same_v<std::decay_t<F>, InlineCallback>>>
+    InlineCallback(F f) {
+        static_assert(sizeof(F) <= Capacity, "capture too big for the inline handler storage");
+        static_assert(alignof(F) <= alignof(void*), "over-aligned capture");
+        static_assert(std::is_trivially_copyable_v<F>, "capture needs a destructor: capture a pointer to it");
+        new (storage) F(f);
+        invoke = [](void* p, Args... args) { (*static_cast<F*>(p))(args...); };
+    }
+    
+    void reset() {
+        invoke = nullptr;
+    }
+    
+    explicit operator bool() const {
+        return invoke != nullptr;
+    }
+    
+    void operator()(Args... args) {
+        invoke(storage, args...);
+    }
+};
+
+using Handler = InlineCallback<HANDLER_CAPTURE_BYTES>;
+
+// Completion of an async_* operation: bytes, the accepted fd, or -errno (io_uring's
+// convention, on both engines)
+using Completion = InlineCallback<HANDLER_CAPTURE_BYTES, ssize_t>;
+
+// Both handlers of one fd: dispatching an event touches this line and nothing else
+struct alignas(CACHE_LINE) HandlerSlot {
+    Handler read;
+    Handler write;
+};
+
+static_assert(sizeof(HandlerSlot) == CACHE_LINE, "an fd's handlers should share one cache line");
+
+// One cell of the post() ring (Vyukov's bounded queue). `sequence` == position: free
+// for the producer that claims that position; position + 1: filled, the loop's turn.
+struct PostSlot {
+    std::atomic<size_t> sequence;
+    Handler task;
+};
+
+// ---------------------------------------------------------------------------
+// Completion API shared by Reactor (readiness underneath) and Proactor (io_uring):
+// async_read/write/recv/send/accept(fd, ..., Completion). Handler code written
+// against it moves between the two by changing the loop type. Results are like the
+// syscall's (reads and writes may be short), one operation per fd and direction.
+// close_fd(fd) is the same on both: every operation still in flight on fd completes
+// exactly once, from the loop, with -ECANCELED, so whatever its completion points to
+// (buffer, session) must stay alive until then.
+// ---------------------------------------------------------------------------
+#define IO_OPS_MAX 16384   // Operations in flight per loop
+#define OP_NONE UINT32_MAX
+
+enum IoKind : uint8_t {
+    IO_READ,
+    IO_WRITE,
+    IO_RECV,
+    IO_SEND,
+    IO_ACCEPT
+};
+
+struct IoOp {
+    Completion done;
+    char* buf;
+    uint32_t len;
+    int fd;
+    IoKind kind;
+    bool cancelled;  // fd closed under it: completes with -ECANCELED
+    bool queued;     // Reactor: in ready_ops rather than parked in the fd's slot
+    uint32_t next_free;
+};
+
+inline bool io_writes(IoKind kind) {
+    return kind == IO_WRITE || kind == IO_SEND;
+}
+
+// Submitted operations by index (the io_uring user_data), on a free list; sized once.
+// Also indexed by fd and direction, so close_fd can find what is in flight.
+class OpTable {
+private:
+    std::vector<IoOp> ops;
+    uint32_t free_head = OP_NONE;
+    size_t used = 0;
+    std::vector<uint32_t> by_fd;  // [fd * 2 + writes]: the operation in flight, or OP_NONE
+    
+public:
+    void init(size_t capacity) {
+        ops.resize(capacity);
+        for (size_t i = 0; i < capacity; i++) {
+            ops[i].next_free = i + 1 < capacity ? i + 1 : OP_NONE;
+        }
+        free_head = capacity ? 0 : OP_NONE;
+    }
+    
+    bool empty() const {
+        return ops.empty();
+    }
+    
+    size_t in_flight() const {
+        return used;
+    }
+    
+    // OP_NONE = IO_OPS_MAX already in flight, or fd already has one in this direction
+    uint32_t acquire(IoKind kind, int fd, const void* buf, size_t len, Completion done) {
+        size_t key = (size_t)fd * 2 + io_writes(kind);
+        if (key >= by_fd.size()) by_fd.resize(std::max(key + 1, by_fd.size() * 2), OP_NONE);
+        
+        uint32_t index = free_head;
+        if (index == OP_NONE || by_fd[key] != OP_NONE) return OP_NONE;
+        
+        IoOp& op = ops[index];
+        free_head = op.next_free;
+        op.done = done;
+        op.buf = static_cast<char*>(const_cast<void*>(buf));
+        op.len = len;
+        op.fd = fd;
+        op.kind = kind;
+        op.cancelled = false;
+        op.queued = false;
+        by_fd[key] = index;
+        used++;
+        return index;
+    }
+    
+    void release(uint32_t index) {
+        IoOp& op = ops[index];
+        if (!op.cancelled) by_fd[(size_t)op.fd * 2 + io_writes(op.kind)] = OP_NONE;
+        op.next_free = free_head;
+        free_head = index;
+        used--;
+    }
+    
+    // Mark fd's operation in this direction cancelled and detach it from the fd, so the
+    // number is free for the next fd. OP_NONE = nothing in flight.
+    uint32_t cancel(int fd, bool for_write) {
+        size_t key = (size_t)fd * 2 + for_write;
+        if (key >= by_fd.size() || by_fd[key] == OP_NONE) return OP_NONE;
+        
+        uint32_t index = by_fd[key];
+        by_fd[key] = OP_NONE;
+        ops[index].cancelled = true;
+        return index;
+    }
+    
+    IoOp& operator[](uint32_t index) {
+        return ops[index];
+    }
+};
+
+// The operation as a non-blocking syscall: what its completion would get
+ssize_t perform_io(const IoOp& op) {
+    ssize_t result;
+    switch (op.kind) {
+    case IO_READ:   result = read(op.fd, op.buf, op.len); break;
+    case IO_WRITE:  result = write(op.fd, op.buf, op.len); break;
+    case IO_RECV:   result = recv(op.fd, op.buf, op.len, 0); break;
+    case IO_SEND:   result = send(op.fd, op.buf, op.len, MSG_NOSIGNAL); break;
+    case IO_ACCEPT: result = accept4(op.fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC); break;
+    default:        return -EINVAL;
+    }
+    return result < 0 ? -errno : result;
+}
+
+#ifdef HAVE_COROUTINES
+class Reactor;
+
+// co_await async_read(fd, ...) / async_write(fd, ...): the syscall runs right away
+// unless the fd is known drained; on EAGAIN the coroutine parks in the fd's handler
+// slot until the next edge. No buffer (readable(fd)) = wait for the next edge alone.
+// Result: bytes or -errno. A write that fails after some progress (EPIPE after 3 of
+// 4 KB) returns the bytes it got out, like write(2); the next write reports the error.
+struct FdAwaiter {
+    Reactor* reactor;   // Null: the loop of the task that awaits
+    int fd;
+    bool for_write;
+    char* buf;
+    size_t len;
+    ssize_t result = 0;  // Writes: bytes done so far, across edges
+    std::coroutine_handle<> waiting;
+    
+    FdAwaiter(Reactor* reactor, int fd, bool for_write, char* buf, size_t len)
+        : reactor(reactor), fd(fd), for_write(for_write), buf(buf), len(len) {}
+    
+    // The loop comes from the awaiting task, so the decision is made in await_suspend
+    bool await_ready() const noexcept {
+        return false;
+    }
+    
+    template <typename P>
+    bool await_suspend(std::coroutine_handle<P> awaiting);
+    
+    ssize_t await_resume() const noexcept {
+        return result;
+    }
+    
+    bool attempt();
+    void on_edge();
+};
+
+// co_await sleep_for(ms): the timer lives in the awaiting frame, arming is O(1)
+struct SleepAwaiter {
+    Reactor* reactor;
+    uint64_t ms;
+    Timer timer;
+    
+    bool await_ready() const noexcept {
+        return false;
+    }
+    
+    template <typename P>
+    void await_suspend(std::coroutine_handle<P> awaiting);
+    
+    void await_resume() const noexcept {}
+};
+#endif
+
 class Reactor {
 private:
     int epoll_fd;
-    std::map<int, std::function<void()>> read_handlers;
-    std::map<int, std::function<void()>> write_handlers;
+    std::vector<HandlerSlot> handlers;  // Indexed by fd, sized once: never moves under a running handler
+    std::vector<uint32_t> registered;   // Mask epoll has for each fd, 0 = not added (unregister before close)
+    std::vector<uint8_t> edges;         // EDGE_* not yet drained (EAGAIN or short read), for edge-triggered fds
     bool running;
+    int spin_polls;  // Empty epoll_wait(0) polls before blocking: 0 = always block, -1 = never
+    
+    // Cross-thread post(): lock-free ring drained by the loop, woken through one eventfd
+    int wake_fd;
+    std::vector<PostSlot> posted;
+    alignas(CACHE_LINE) std::atomic<size_t> post_tail;   // Next position producers claim
+    alignas(CACHE_LINE) std::atomic<bool> wake_pending;  // Eventfd written, loop not yet draining
+    std::atomic<uint64_t> wake_writes;
+    alignas(CACHE_LINE) size_t post_head;                // Next position to run (loop thread only)
+    
+    // Completion API: operations parked on an fd, and those to run on the next turn
+    OpTable ops;                     // Sized on first use
+    std::vector<uint32_t> ready_ops;
+    std::vector<uint32_t> running_ops;
+    
+    // Timers
+    TimerLink wheel[WHEEL_LEVELS][WHEEL_SIZE];
+    uint64_t occupied[WHEEL_LEVELS][WHEEL_SIZE / 64];  // Non-empty slot bitmap
+    uint64_t tick;                                      // Last processed tick
+    size_t armed;
+    std::chrono::steady_clock::time_point start_time;
     
 public:
-    Reactor() : running(false) {
+    // max_fds = 0: the RLIMIT_NOFILE soft limit, so every fd this process can open fits
+    explicit Reactor(size_t max_fds = 0)
+        : running(false), spin_polls(0), posted(POST_QUEUE_SIZE), post_tail(0), wake_pending(false),
+          wake_writes(0), post_head(0), tick(0), armed(0) {
+        if (max_fds == 0) {
+            struct rlimit limit;
+            max_fds = getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY
+                          ? limit.rlim_cur : 65536;
+        }
+        handlers.resize(max_fds);
+        registered.resize(max_fds);
+        edges.resize(max_fds, EDGE_READ | EDGE_WRITE);
+        
         epoll_fd = epoll_create1(0);
         if (epoll_fd == -1) {
             throw std::runtime_error("epoll_create1 failed");
         }
+        
+        for (int level = 0; level < WHEEL_LEVELS; level++) {
+            for (int slot = 0; slot < WHEEL_SIZE; slot++) {
+                wheel[level][slot].prev = wheel[level][slot].next = &wheel[level][slot];
+            }
+        }
+        memset(occupied, 0, sizeof(occupied));
+        start_time = std::chrono::steady_clock::now();
+        
+        for (size_t i = 0; i < POST_QUEUE_SIZE; i++) {
+            posted[i].sequence.store(i, std::memory_order_relaxed);
+        }
+        wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (wake_fd == -1) {
+            close(epoll_fd);
+            throw std::runtime_error("eventfd failed");
+        }
+        register_read_handler(wake_fd, [this] { run_posted(); });
     }
     
     ~Reactor() {
+        close(wake_fd);
         close(epoll_fd);
     }
     
-    void register_read_handler(int fd, std::function<void()> handler) {
-        read_handlers[fd] = handler;
+    // Handlers are stored inline: a lambda capturing more than HANDLER_CAPTURE_BYTES
+    // doesn't compile (capture a pointer to the state instead)
+    void register_read_handler(int fd, Handler handler) {
+        slot(fd).read = handler;
+        update_epoll(fd);
+    }
+    
+    void register_write_handler(int fd, Handler handler) {
+        slot(fd).write = handler;
         update_epoll(fd);
     }
     
-    void register_write_handler(int fd, std::function<void()> handler) {
-        write_handlers[fd] = handler;
+    // Drop EPOLLOUT interest once the output is drained (keeps the read handler)
+    void unregister_write_handler(int fd) {
+        if (!slot(fd).write) return;
+        
+        handlers[fd].write.reset();
         update_epoll(fd);
     }
     
+    // A handler may unregister its own fd: only the invoker is cleared, so its captures
+    // stay readable until it returns (as long as it doesn't register the fd again)
     void unregister(int fd) {
-        read_handlers.erase(fd);
-        write_handlers.erase(fd);
-        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+        HandlerSlot& s = slot(fd);
+        s.read.reset();
+        s.write.reset();
+        
+        if (registered[fd]) {
+            epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+            registered[fd] = 0;
+        }
+        edges[fd] = EDGE_READ | EDGE_WRITE;  // Unknown for the next fd with this number: try
+    }
+    
+    size_t max_fds() const {
+        return handlers.size();
+    }
+    
+    // Edge-triggered waits (the coroutine awaitables): the first wait adds the fd with
+    // EPOLLIN | EPOLLET, later waits only store the waiter in the slot, so parking
+    // costs no epoll_ctl. EPOLLOUT is added by the first writer that has to wait (the
+    // send buffer filled up) and kept; before that, every drain by the peer would
+    // be an edge to dispatch. An edge that fires while nobody waits is kept in
+    // edges[fd]: waiters try the syscall first while it is set, and clear it when
+    // the syscall finds the socket drained, so after a short read they park without
+    // paying for the read that would return EAGAIN. EPOLLRDHUP is asked for too: a FIN
+    // that comes with the last bytes is one edge, and the short read must not park.
+    void wait_edge(int fd, bool for_write, Handler waiter) {
+        HandlerSlot& s = slot(fd);
+        (for_write ? s.write : s.read) = waiter;
+        
+        uint32_t wanted = EPOLLIN | EPOLLRDHUP | EPOLLET | (for_write ? (uint32_t)EPOLLOUT : 0);
+        if ((registered[fd] & wanted) == wanted) return;
+        
+        struct epoll_event ev;
+        ev.data.fd = fd;
+        ev.events = wanted | ((registered[fd] & EPOLLET) ? registered[fd] & EPOLLOUT : 0);
+        epoll_ctl(epoll_fd, registered[fd] ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, fd, &ev);
+        registered[fd] = ev.events | EPOLLERR;
+    }
+    
+    void cancel_wait(int fd, bool for_write) {
+        HandlerSlot& s = slot(fd);
+        (for_write ? s.write : s.read).reset();
+    }
+    
+    bool edge_pending(int fd, bool for_write) const {
+        return edges[fd] & (for_write ? EDGE_WRITE : EDGE_READ);
+    }
+    
+    void clear_edge(int fd, bool for_write) {
+        if (!for_write && (edges[fd] & EDGE_READ_HUP)) return;
+        edges[fd] &= ~(for_write ? EDGE_WRITE : EDGE_READ);
+    }
+    
+#ifdef HAVE_COROUTINES
+    // Awaitables bound to this loop (the free readable() etc. use the awaiting task's)
+    FdAwaiter readable(int fd) {
+        return FdAwaiter{this, fd, false, nullptr, 0};
+    }
+    
+    FdAwaiter writable(int fd) {
+        return FdAwaiter{this, fd, true, nullptr, 0};
+    }
+    
+    SleepAwaiter sleep_for(uint64_t ms) {
+        return SleepAwaiter{this, ms, {}};
+    }
+#endif
+
+    // Busy-poll: skip the sleep/wakeup on the next event at the cost of a core.
+    // Hybrid (N > 0) spins until N polls in a row come back empty, then blocks.
+    void set_spin_polls(int polls) {
+        spin_polls = polls;
+    }
+    
+    // Milliseconds since the reactor was created (the wheel's clock)
+    uint64_t now_ms() const {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - start_time).count();
+    }
+    
+    // (Re)arm to fire timeout_ms from now. O(1), no allocation.
+    // Pushing an armed deadline later only updates `expires`: the timer is
+    // moved when its old slot comes up, so resetting on every read is a store.
+    void arm_timer(Timer* timer, uint64_t timeout_ms) {
+        uint64_t expires = now_ms() + timeout_ms;
+        if (expires <= tick) expires = tick + 1;
+        
+        if (timer->level != -1) {
+            if (expires >= timer->expires) {
+                timer->expires = expires;
+                return;
+            }
+            unlink_timer(timer);
+        }
+        
+        timer->expires = expires;
+        insert_timer(timer, tick);
+    }
+    
+    void cancel_timer(Timer* timer) {
+        if (timer->level == -1) return;
+        unlink_timer(timer);
+    }
+    
+    size_t armed_timers() const {
+        return armed;
+    }
+    
+    // epoll_wait timeout: until the next non-empty level 0 slot, or until
+    // level 0 wraps and the next level cascades. -1 = no timers.
+    int next_timeout_ms() {
+        if (armed == 0) return -1;
+        
+        uint64_t now = now_ms();
+        if (now > tick) return 0;
+        
+        int current = tick & WHEEL_MASK;
+        for (int slot = current + 1; slot < WHEEL_SIZE; ) {
+            uint64_t bits = occupied[0][slot / 64] >> (slot % 64);
+            if (bits) return slot + __builtin_ctzll(bits) - current;
+            slot = (slot / 64 + 1) * 64;
+        }
+        return WHEEL_SIZE - current;
+    }
+    
+    // Fire everything due up to now_tick (ms on the reactor clock)
+    void advance_timers(uint64_t now_tick) {
+        if (armed == 0) {
+            if (now_tick > tick) tick = now_tick;
+            return;
+        }
+        
+        while (tick < now_tick) {
+            tick++;
+            
+            // Level 0 wrapped: pull the next slot of each wrapped level down
+            if ((tick & WHEEL_MASK) == 0) {
+                int top = 1;
+                while (top < WHEEL_LEVELS - 1 && ((tick >> (WHEEL_BITS * top)) & WHEEL_MASK) == 0) top++;
+                for (int level = top; level >= 1; level--) {
+                    cascade(level, (tick >> (WHEEL_BITS * level)) & WHEEL_MASK);
+                }
+            }
+            
+            expire_slot(tick & WHEEL_MASK);
+            if (armed == 0) {
+                tick = now_tick;
+                break;
+            }
+        }
     }
     
     void run() {
@@ -49,76 +563,811 @@ public:
         
         std::cout << "Reactor: Event loop started" << std::endl;
         
+        int empty_polls = 0;
+        
         while (running) {
-            int nfds = epoll_wait(epoll_fd, events, MAX_EVENTS, -1);
-            
-            for (int i = 0; i < nfds; i++) {
-                int fd = events[i].data.fd;
-                
-                if (events[i].events & EPOLLIN) {
-                    auto it = read_handlers.find(fd);
-                    if (it != read_handlers.end()) {
-                        it->second();  // Call handler
-                    }
-                }
-                
-                if (events[i].events & EPOLLOUT) {
-                    auto it = write_handlers.find(fd);
-                    if (it != write_handlers.end()) {
-                        it->second();  // Call handler
-                    }
-                }
-            }
+            bool spinning = spin_polls < 0 || empty_polls < spin_polls || !ready_ops.empty();
+            int nfds = epoll_wait(epoll_fd, events, MAX_EVENTS, spinning ? 0 : next_timeout_ms());
+            empty_polls = nfds > 0 ? 0 : empty_polls + 1;
+            
+            dispatch(events, nfds);
+            run_ready_ops();
+            advance_timers(now_ms());
         }
         
         std::cout << "Reactor: Event loop stopped" << std::endl;
     }
     
+    // One batch of ready events: an index into the table and an indirect call each.
+    // run() calls this; it is public so the dispatch benchmark can feed it directly.
+    void dispatch(const struct epoll_event* events, int count) {
+        for (int i = 0; i < count; i++) {
+            int fd = events[i].data.fd;
+            HandlerSlot& s = handlers[fd];
+            
+            bool readable = events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP);
+            bool writable = events[i].events & (EPOLLOUT | EPOLLERR | EPOLLHUP);
+            edges[fd] |= (readable ? EDGE_READ : 0) | (writable ? EDGE_WRITE : 0);
+            if (events[i].events & (EPOLLRDHUP | EPOLLHUP)) edges[fd] |= EDGE_READ_HUP;
+            
+            if (readable && s.read) {
+                s.read();  // Call handler
+            }
+            
+            // The read handler may have dropped this one (or the whole fd). Errors go
+            // to a writer too: an edge-triggered writer gets no other wakeup.
+            if (writable && s.write) {
+                s.write();  // Call handler
+            }
+        }
+    }
+    
     void stop() {
         running = false;
     }
     
+    // Run `task` on the loop thread. Safe from any thread, never blocks or allocates:
+    // claim a ring slot with one CAS, fill it, and write the eventfd only if no wakeup
+    // is already pending, so a burst of posts costs one write(). False = ring full
+    // (POST_QUEUE_SIZE tasks waiting): back off and retry, or drop.
+    bool post(Handler task) {
+        size_t pos = post_tail.load(std::memory_order_relaxed);
+        PostSlot* cell;
+        for (;;) {
+            cell = &posted[pos & POST_QUEUE_MASK];
+            size_t sequence = cell->sequence.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)sequence - (intptr_t)pos;
+            
+            if (diff == 0) {
+                if (post_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+            } else if (diff < 0) {
+                return false;  // The loop hasn't run the task a lap ago yet
+            } else {
+                pos = post_tail.load(std::memory_order_relaxed);
+            }
+        }
+        
+        cell->task = task;
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        wake();
+        return true;
+    }
+    
+    // Eventfd writes so far: posts / wakeup_writes() is the coalescing factor
+    uint64_t wakeup_writes() const {
+        return wake_writes.load(std::memory_order_relaxed);
+    }
+    
+    // Completion API on readiness (see IoOp). An operation whose direction has an edge
+    // pending runs its syscall on the next loop turn, otherwise it parks in the fd's
+    // slot until epoll reports one; either way the completion runs from the loop,
+    // never inside the call. False = IO_OPS_MAX operations already in flight.
+    bool async_read(int fd, void* buf, size_t len, Completion done) {
+        return submit_io(IO_READ, fd, buf, len, done);
+    }
+    
+    bool async_write(int fd, const void* buf, size_t len, Completion done) {
+        return submit_io(IO_WRITE, fd, buf, len, done);
+    }
+    
+    bool async_recv(int fd, void* buf, size_t len, Completion done) {
+        return submit_io(IO_RECV, fd, buf, len, done);
+    }
+    
+    bool async_send(int fd, const void* buf, size_t len, Completion done) {
+        return submit_io(IO_SEND, fd, buf, len, done);
+    }
+    
+    // Result: the new fd (non-blocking, close-on-exec)
+    bool async_accept(int listen_fd, Completion done) {
+        return submit_io(IO_ACCEPT, listen_fd, nullptr, 0, done);
+    }
+    
+    // Parked operations leave the fd's slot for ready_ops, queued ones stay there;
+    // either way the next turn completes them with -ECANCELED without a syscall
+    void close_fd(int fd) {
+        for (bool for_write : {false, true}) {
+            uint32_t index = ops.cancel(fd, for_write);
+            if (index == OP_NONE || ops[index].queued) continue;
+            
+            ops[index].queued = true;
+            ready_ops.push_back(index);
+        }
+        unregister(fd);
+        close(fd);
+    }
+    
+    size_t ops_in_flight() const {
+        return ops.in_flight();
+    }
+    
 private:
+    bool submit_io(IoKind kind, int fd, const void* buf, size_t len, Completion done) {
+        slot(fd);  // Range check before anything is taken
+        if (ops.empty()) ops.init(IO_OPS_MAX);
+        
+        uint32_t index = ops.acquire(kind, fd, buf, len, done);
+        if (index == OP_NONE) return false;
+        
+        if (edge_pending(fd, io_writes(kind))) {
+            ops[index].queued = true;
+            ready_ops.push_back(index);
+        } else {
+            wait_edge(fd, io_writes(kind), [this, index] { perform_op(index); });
+        }
+        return true;
+    }
+    
+    void perform_op(uint32_t index) {
+        IoOp& op = ops[index];
+        bool for_write = io_writes(op.kind);
+        op.queued = false;
+        
+        // op.fd is closed, possibly reused: touch neither it nor its slot
+        ssize_t result = op.cancelled ? -ECANCELED : perform_io(op);
+        if (!op.cancelled) {
+            if (result == -EAGAIN || result == -EWOULDBLOCK) {
+                clear_edge(op.fd, for_write);
+                wait_edge(op.fd, for_write, [this, index] { perform_op(index); });
+                return;
+            }
+            if (result == -EINTR) {
+                op.queued = true;
+                ready_ops.push_back(index);
+                return;
+            }
+            
+            // Short read: drained, the next read parks without trying
+            if ((op.kind == IO_READ || op.kind == IO_RECV) && result > 0 && (size_t)result < op.len) {
+                clear_edge(op.fd, false);
+            }
+            cancel_wait(op.fd, for_write);
+        }
+        
+        Completion done = op.done;
+        ops.release(index);
+        done(result);
+    }
+    
+    // Operations submitted during this batch wait for the next turn, after epoll_wait(0)
+    void run_ready_ops() {
+        if (ready_ops.empty()) return;
+        
+        running_ops.swap(ready_ops);
+        for (uint32_t index : running_ops) perform_op(index);
+        running_ops.clear();
+    }
+    
+    // Wake handler. Clear the pending flag before looking at the ring, with an RMW:
+    // a poster whose exchange came first is seen by the scan (it synchronizes with
+    // this one), a poster whose exchange comes after sees false and writes again.
+    void run_posted() {
+        uint64_t count;
+        ssize_t ignored = read(wake_fd, &count, sizeof(count));
+        (void)ignored;
+        wake_pending.exchange(false, std::memory_order_acq_rel);
+        
+        // At most one lap per wakeup, so posters can't starve I/O and timers
+        for (int ran = 0; ran < POST_QUEUE_SIZE; ran++) {
+            PostSlot& cell = posted[post_head & POST_QUEUE_MASK];
+            if (cell.sequence.load(std::memory_order_acquire) != post_head + 1) return;
+            
+            Handler task = cell.task;
+            cell.sequence.store(post_head + POST_QUEUE_SIZE, std::memory_order_release);
+            post_head++;
+            task();
+        }
+        
+        wake();  // Ring may still hold tasks: come back after the next epoll_wait
+    }
+    
+    // Only the first post since the last drain writes the eventfd
+    void wake() {
+        if (wake_pending.exchange(true, std::memory_order_acq_rel)) return;
+        
+        uint64_t one = 1;
+        wake_writes.fetch_add(1, std::memory_order_relaxed);
+        ssize_t ignored = write(wake_fd, &one, sizeof(one));
+        (void)ignored;
+    }
+    
+    HandlerSlot& slot(int fd) {
+        if (fd < 0 || (size_t)fd >= handlers.size()) {
+            throw std::out_of_range("fd outside the reactor's handler table");
+        }
+        return handlers[fd];
+    }
+    
     void update_epoll(int fd) {
         struct epoll_event ev;
         ev.data.fd = fd;
         ev.events = 0;
         
-        if (read_handlers.count(fd)) {
+        if (handlers[fd].read) {
             ev.events |= EPOLLIN;
         }
-        if (write_handlers.count(fd)) {
+        if (handlers[fd].write) {
             ev.events |= EPOLLOUT;
         }
         
-        // Try to modify first
-        if (epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &ev) == -1) {
-            // Doesn't exist, add it
+        // We know what epoll has: ADD new fds, MOD changed masks, skip the rest
+        if (registered[fd] == 0) {
             epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+            registered[fd] = ev.events | EPOLLERR;  // Never 0 once added, even with no interest
+        } else if ((registered[fd] & ~EPOLLERR) != ev.events) {
+            epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &ev);
+            registered[fd] = ev.events | EPOLLERR;
+        }
+    }
+    
+    // Place by distance from `base`: the level is the first whose span covers it
+    void insert_timer(Timer* timer, uint64_t base) {
+        uint64_t delta = timer->expires - base;
+        if (delta > WHEEL_MAX_TICKS) {
+            delta = WHEEL_MAX_TICKS;
+            timer->expires = base + delta;
+        }
+        
+        int level = 0;
+        while (level < WHEEL_LEVELS - 1 && delta >= (1ULL << (WHEEL_BITS * (level + 1)))) level++;
+        int slot = (timer->expires >> (WHEEL_BITS * level)) & WHEEL_MASK;
+        
+        TimerLink* head = &wheel[level][slot];
+        timer->next = head;
+        timer->prev = head->prev;
+        head->prev->next = timer;
+        head->prev = timer;
+        
+        timer->level = level;
+        timer->slot = slot;
+        occupied[level][slot / 64] |= 1ULL << (slot % 64);
+        armed++;
+    }
+    
+    void unlink_timer(Timer* timer) {
+        timer->prev->next = timer->next;
+        timer->next->prev = timer->prev;
+        
+        TimerLink* head = &wheel[timer->level][timer->slot];
+        if (head->next == head) {
+            occupied[timer->level][timer->slot / 64] &= ~(1ULL << (timer->slot % 64));
+        }
+        timer->level = -1;
+        armed--;
+    }
+    
+    // Move a slot's list onto `out` and leave the slot empty
+    void detach_slot(int level, int slot, TimerLink* out) {
+        TimerLink* head = &wheel[level][slot];
+        if (head->next == head) {
+            out->prev = out->next = out;
+            return;
+        }
+        
+        out->next = head->next;
+        out->prev = head->prev;
+        out->next->prev = out;
+        out->prev->next = out;
+        head->prev = head->next = head;
+        occupied[level][slot / 64] &= ~(1ULL << (slot % 64));
+    }
+    
+    void cascade(int level, int slot) {
+        TimerLink pending;
+        detach_slot(level, slot, &pending);
+        
+        while (pending.next != &pending) {
+            Timer* timer = static_cast<Timer*>(pending.next);
+            pending.next = timer->next;
+            timer->next->prev = &pending;
+            armed--;
+            insert_timer(timer, tick);
+        }
+    }
+    
+    void expire_slot(int slot) {
+        TimerLink pending;
+        detach_slot(0, slot, &pending);
+        
+        // Timers still on `pending` keep level/slot, so a callback cancelling
+        // one of them (e.g. closing a connection with two due deadlines) works
+        while (pending.next != &pending) {
+            Timer* timer = static_cast<Timer*>(pending.next);
+            pending.next = timer->next;
+            timer->next->prev = &pending;
+            armed--;
+            
+            if (timer->expires > tick) {
+                insert_timer(timer, tick);  // Pushed back since it was placed
+                continue;
+            }
+            
+            timer->level = -1;
+            timer->callback();  // May free the timer: don't touch it after this
         }
     }
 };
 
-void demonstrate_reactor_pattern() {
-    std::cout << "=== Reactor Pattern ===" << std::endl;
-    std::cout << R"(
-Structure:
-    ┌─────────────────────────┐
-    │   Reactor (epoll)       │
-    └───────────┬─────────────┘
-                │
-        ┌───────┴───────┐
-        │               │
-    ┌───▼───┐       ┌───▼───┐
-    │Handler│       │Handler│  Register callbacks
-    │  1    │       │  2    │  for events
-    └───────┘       └───────┘
+#ifdef HAVE_LIBURING
+// ---------------------------------------------------------------------------
+// Proactor: the completion API executed by io_uring. The kernel does the I/O and
+// reports results; there is no readiness step and no syscall per operation.
+// ---------------------------------------------------------------------------
+#define PROACTOR_ENTRIES 4096
 
-Flow:
-  1. Register FD with callback
-  2. Reactor waits for events
-  3. Event occurs → Reactor calls callback
-  4. Callback handles event
+class Proactor {
+private:
+    struct io_uring ring;
+    OpTable ops;
+    bool running;
+    uint64_t enters;  // io_uring_enter calls made by run()
+    
+public:
+    explicit Proactor(unsigned entries = PROACTOR_ENTRIES) : running(false), enters(0) {
+        int ret = io_uring_queue_init(entries, &ring, 0);
+        if (ret < 0) {
+            throw std::runtime_error(std::string("io_uring_queue_init failed: ") + strerror(-ret));
+        }
+        ops.init(IO_OPS_MAX);
+    }
+    
+    ~Proactor() {
+        io_uring_queue_exit(&ring);
+    }
+    
+    // Same contract as the Reactor's: queued in the SQ only, submitted with the
+    // rest of the batch when the loop next enters the kernel
+    bool async_read(int fd, void* buf, size_t len, Completion done) {
+        return submit_io(IO_READ, fd, buf, len, done);
+    }
+    
+    bool async_write(int fd, const void* buf, size_t len, Completion done) {
+        return submit_io(IO_WRITE, fd, buf, len, done);
+    }
+    
+    bool async_recv(int fd, void* buf, size_t len, Completion done) {
+        return submit_io(IO_RECV, fd, buf, len, done);
+    }
+    
+    bool async_send(int fd, const void* buf, size_t len, Completion done) {
+        return submit_io(IO_SEND, fd, buf, len, done);
+    }
+    
+    bool async_accept(int listen_fd, Completion done) {
+        return submit_io(IO_ACCEPT, listen_fd, nullptr, 0, done);
+    }
+    
+    // The kernel holds its own reference to the file while a recv/send is pending, so
+    // a plain close() would leave the socket open and the completion still to come.
+    // Cancel everything on fd, then close it, in that order in the same submission.
+    void close_fd(int fd) {
+        bool in_flight = false;
+        for (bool for_write : {false, true}) {
+            if (ops.cancel(fd, for_write) != OP_NONE) in_flight = true;
+        }
+        
+        struct io_uring_sqe* sqe;
+        if (in_flight && (sqe = get_sqe())) {
+            io_uring_prep_cancel_fd(sqe, fd, IORING_ASYNC_CANCEL_ALL);
+            io_uring_sqe_set_data64(sqe, OP_NONE);
+        }
+        if ((sqe = get_sqe())) {
+            io_uring_prep_close(sqe, fd);
+            io_uring_sqe_set_data64(sqe, OP_NONE);
+        } else {
+            close(fd);
+        }
+    }
+    
+    size_t ops_in_flight() const {
+        return ops.in_flight();
+    }
+    
+    // One io_uring_enter per turn: submit everything queued since the last one and
+    // wait for at least one completion, then reap every CQE that is there
+    void run() {
+        running = true;
+        std::cout << "Proactor: Event loop started" << std::endl;
+        
+        while (running) {
+            enters++;
+            int ret = io_uring_submit_and_wait(&ring, 1);
+            if (ret < 0 && ret != -EINTR && ret != -EBUSY) {
+                std::cerr << "io_uring_submit_and_wait: " << strerror(-ret) << std::endl;
+                break;
+            }
+            
+            unsigned head;
+            unsigned reaped = 0;
+            struct io_uring_cqe* cqe;
+            io_uring_for_each_cqe(&ring, head, cqe) {
+                complete(io_uring_cqe_get_data64(cqe), cqe->res);
+                reaped++;
+            }
+            io_uring_cq_advance(&ring, reaped);
+        }
+        
+        std::cout << "Proactor: Event loop stopped" << std::endl;
+    }
+    
+    void stop() {
+        running = false;
+    }
+    
+    uint64_t enter_calls() const {
+        return enters;
+    }
+    
+private:
+    bool submit_io(IoKind kind, int fd, const void* buf, size_t len, Completion done) {
+        uint32_t index = ops.acquire(kind, fd, buf, len, done);
+        if (index == OP_NONE) return false;
+        
+        struct io_uring_sqe* sqe = get_sqe();
+        if (!sqe) {
+            ops.release(index);
+            return false;
+        }
+        
+        IoOp& op = ops[index];
+        switch (kind) {
+        case IO_READ:   io_uring_prep_read(sqe, fd, op.buf, op.len, (uint64_t)-1); break;  // -1: file position
+        case IO_WRITE:  io_uring_prep_write(sqe, fd, op.buf, op.len, (uint64_t)-1); break;
+        case IO_RECV:   io_uring_prep_recv(sqe, fd, op.buf, op.len, 0); break;
+        case IO_SEND:   io_uring_prep_send(sqe, fd, op.buf, op.len, MSG_NOSIGNAL); break;
+        case IO_ACCEPT: io_uring_prep_accept(sqe, fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC); break;
+        }
+        io_uring_sqe_set_data64(sqe, index);
+        return true;
+    }
+    
+    struct io_uring_sqe* get_sqe() {
+        struct io_uring_sqe* sqe = io_uring_get_sqe(&ring);
+        if (!sqe) {
+            // SQ full: hand what we have to the kernel, then there is room again
+            enters++;
+            io_uring_submit(&ring);
+            sqe = io_uring_get_sqe(&ring);
+        }
+        return sqe;
+    }
+    
+    // OP_NONE: close_fd's cancel and close. A cancelled operation reports -ECANCELED
+    // even if it finished before the cancel got to it: its fd is gone either way.
+    void complete(uint64_t index, int result) {
+        if (index == OP_NONE) return;
+        
+        IoOp& op = ops[index];
+        Completion done = op.done;
+        if (op.cancelled) result = -ECANCELED;
+        ops.release(index);
+        done(result);
+    }
+};
+#endif
+
+#ifdef HAVE_COROUTINES
+// ---------------------------------------------------------------------------
+// Coroutines on the Reactor: Task<T>, spawn(), and the awaitables above
+// ---------------------------------------------------------------------------
+
+// Coroutine frames: power-of-two classes from 64 B to 16 KB cut from 64 KB slabs and
+// recycled through per-class free lists. One pool per thread, i.e. per loop: frames
+// are created and destroyed on the loop thread, so there is nothing to lock.
+#define FRAME_MIN_SHIFT 6
+#define FRAME_CLASSES 9
+#define FRAME_SLAB_BYTES 65536
+
+class FramePool {
+private:
+    struct FreeFrame {
+        FreeFrame* next;
+    };
+    
+    FreeFrame* free_lists[FRAME_CLASSES] = {};
+    std::vector<void*> slabs;
+    uint64_t frames = 0;
+    uint64_t oversized = 0;  // Past the largest class: straight from the heap
+    
+public:
+    ~FramePool() {
+        for (void* slab : slabs) ::operator delete(slab);
+    }
+    
+    void* allocate(size_t size) {
+        frames++;
+        int c = size_class(size);
+        if (c == FRAME_CLASSES) {
+            oversized++;
+            return ::operator new(size);
+        }
+        
+        if (!free_lists[c]) refill(c);
+        FreeFrame* frame = free_lists[c];
+        free_lists[c] = frame->next;
+        return frame;
+    }
+    
+    void deallocate(void* p, size_t size) {
+        int c = size_class(size);
+        if (c == FRAME_CLASSES) {
+            ::operator delete(p);
+            return;
+        }
+        
+        FreeFrame* frame = static_cast<FreeFrame*>(p);
+        frame->next = free_lists[c];
+        free_lists[c] = frame;
+    }
+    
+    uint64_t frames_allocated() const {
+        return frames;
+    }
+    
+    size_t heap_allocations() const {
+        return slabs.size() + oversized;
+    }
+    
+private:
+    static int size_class(size_t size) {
+        int c = 0;
+        while (c < FRAME_CLASSES && ((size_t)1 << (FRAME_MIN_SHIFT + c)) < size) c++;
+        return c;
+    }
+    
+    void refill(int c) {
+        size_t frame_size = (size_t)1 << (FRAME_MIN_SHIFT + c);
+        char* slab = static_cast<char*>(::operator new(FRAME_SLAB_BYTES));
+        slabs.push_back(slab);
+        
+        for (size_t offset = 0; offset + frame_size <= FRAME_SLAB_BYTES; offset += frame_size) {
+            FreeFrame* frame = reinterpret_cast<FreeFrame*>(slab + offset);
+            frame->next = free_lists[c];
+            free_lists[c] = frame;
+        }
+    }
+};
+
+thread_local FramePool frame_pool;
+
+template <typename T = void>
+class Task;
+
+// Shared by every Task's promise: the loop it runs on, who to resume when it
+// finishes, and how it failed. Frames come from the loop thread's pool.
+struct PromiseBase {
+    Reactor* reactor = nullptr;
+    std::coroutine_handle<> continuation;  // Awaiting parent, null for a spawned task
+    std::exception_ptr error;
+    
+    static void* operator new(size_t size) {
+        return frame_pool.allocate(size);
+    }
+    
+    static void operator delete(void* p, size_t size) {
+        frame_pool.deallocate(p, size);
+    }
+    
+    // Lazy: nothing runs until the task is awaited or spawned
+    std::suspend_always initial_suspend() noexcept {
+        return {};
+    }
+    
+    // Finishing jumps straight into the parent (symmetric transfer: no stack growth,
+    // no trip through the loop). A spawned task has no parent and frees itself.
+    struct FinalAwaiter {
+        bool await_ready() const noexcept {
+            return false;
+        }
+        
+        template <typename P>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<P> done) noexcept {
+            std::coroutine_handle<> parent = done.promise().continuation;
+            if (parent) return parent;
+            
+            done.destroy();
+            return std::noop_coroutine();
+        }
+        
+        void await_resume() const noexcept {}
+    };
+    
+    FinalAwaiter final_suspend() noexcept {
+        return {};
+    }
+    
+    // Awaited: the parent's co_await rethrows. Spawned: there is nobody to rethrow to,
+    // and unwinding out of resume() would end run() for every other connection, so it
+    // is reported here and the task finishes normally (final_suspend frees the frame;
+    // the frame's destructors have already run).
+    void unhandled_exception() {
+        if (continuation) {
+            error = std::current_exception();
+            return;
+        }
+        try {
+            throw;
+        } catch (const std::exception& e) {
+            std::cerr << "Spawned task failed: " << e.what() << std::endl;
+        } catch (...) {
+            std::cerr << "Spawned task failed: unknown exception" << std::endl;
+        }
+    }
+};
+
+template <typename T>
+struct TaskPromise : PromiseBase {
+    std::optional<T> value;
+    
+    Task<T> get_return_object();
+    
+    void return_value(T v) {
+        value = std::move(v);
+    }
+};
+
+template <>
+struct TaskPromise<void> : PromiseBase {
+    Task<void> get_return_object();
+    
+    void return_void() {}
+};
+
+template <typename T>
+class [[nodiscard]] Task {
+public:
+    using promise_type = TaskPromise<T>;
+    
+    explicit Task(std::coroutine_handle<promise_type> h) : handle(h) {}
+    Task(Task&& other) noexcept : handle(std::exchange(other.handle, nullptr)) {}
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+    
+    ~Task() {
+        if (handle) handle.destroy();
+    }
+    
+    // co_await child(): start it on the parent's loop and jump in (symmetric transfer)
+    bool await_ready() const noexcept {
+        return false;
+    }
+    
+    template <typename P>
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<P> parent) noexcept {
+        handle.promise().continuation = parent;
+        handle.promise().reactor = parent.promise().reactor;
+        return handle;
+    }
+    
+    T await_resume() {
+        if (handle.promise().error) std::rethrow_exception(handle.promise().error);
+        if constexpr (!std::is_void_v<T>) return std::move(*handle.promise().value);
+    }
+    
+    std::coroutine_handle<promise_type> release() {
+        return std::exchange(handle, nullptr);
+    }
+    
+private:
+    std::coroutine_handle<promise_type> handle;
+};
+
+template <typename T>
+Task<T> TaskPromise<T>::get_return_object() {
+    return Task<T>(std::coroutine_handle<TaskPromise<T>>::from_promise(*this));
+}
+
+inline Task<void> TaskPromise<void>::get_return_object() {
+    return Task<void>(std::coroutine_handle<TaskPromise<void>>::from_promise(*this));
+}
+
+// Start a detached task on `reactor`: it runs now up to its first suspension, and
+// frees its frame when it finishes
+void spawn(Reactor& reactor, Task<> task) {
+    std::coroutine_handle<TaskPromise<void>> handle = task.release();
+    handle.promise().reactor = &reactor;
+    handle.resume();
+}
+
+bool FdAwaiter::attempt() {
+    for (;;) {
+        if (!for_write) {
+            ssize_t n = read(fd, buf, len);
+            if (n >= 0) {
+                // Short read: the socket is drained, the next read waits for an edge
+                if (n > 0 && (size_t)n < len) reactor->clear_edge(fd, false);
+                result = n;
+                return true;
+            }
+        } else {
+            // Writes complete the whole buffer, however many edges that takes
+            while ((size_t)result < len) {
+                ssize_t n = write(fd, buf + result, len - result);
+                if (n < 0) break;
+                result += n;
+            }
+            if ((size_t)result == len) return true;
+        }
+        
+        if (errno == EINTR) continue;
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            reactor->clear_edge(fd, for_write);
+            return false;
+        }
+        if (result <= 0) result = -errno;  // Writes keep a partial count
+        return true;
+    }
+}
+
+// Runs as the fd's handler: no allocation, the awaiter sits in the suspended frame
+void FdAwaiter::on_edge() {
+    if (buf && !attempt()) return;  // Edge without data (or room): keep waiting
+    
+    reactor->cancel_wait(fd, for_write);
+    waiting.resume();
+}
+
+// false = done without suspending
+template <typename P>
+bool FdAwaiter::await_suspend(std::coroutine_handle<P> awaiting) {
+    if (!reactor) reactor = awaiting.promise().reactor;
+    if (buf && reactor->edge_pending(fd, for_write) && attempt()) return false;
+    
+    waiting = awaiting;
+    reactor->wait_edge(fd, for_write, [this] { on_edge(); });
+    return true;
+}
+
+template <typename P>
+void SleepAwaiter::await_suspend(std::coroutine_handle<P> awaiting) {
+    if (!reactor) reactor = awaiting.promise().reactor;
+    timer.callback = [awaiting] { awaiting.resume(); };  // 8 bytes: std::function keeps it inline
+    reactor->arm_timer(&timer, ms);
+}
+
+FdAwaiter readable(int fd) {
+    return FdAwaiter{nullptr, fd, false, nullptr, 0};
+}
+
+FdAwaiter writable(int fd) {
+    return FdAwaiter{nullptr, fd, true, nullptr, 0};
+}
+
+// Whatever is there, up to len (0 = EOF)
+FdAwaiter async_read(int fd, void* buf, size_t len) {
+    return FdAwaiter{nullptr, fd, false, static_cast<char*>(buf), len};
+}
+
+// All len bytes, unless the connection fails
+FdAwaiter async_write(int fd, const void* buf, size_t len) {
+    return FdAwaiter{nullptr, fd, true, static_cast<char*>(const_cast<void*>(buf)), len};
+}
+
+SleepAwaiter sleep_for(uint64_t ms) {
+    return SleepAwaiter{nullptr, ms, {}};
+}
+#endif
+
+void demonstrate_reactor_pattern() {
+    std::cout << "=== Reactor Pattern ===" << std::endl;
+    std::cout << R"(
+Structure:
+    ┌─────────────────────────┐
+    │   Reactor (epoll)       │
+    └───────────┬─────────────┘
+                │
+        ┌───────┴───────┐
+        │               │
+    ┌───▼───┐       ┌───▼───┐
+    │Handler│       │Handler│  Register callbacks
+    │  1    │       │  2    │  for events
+    └───────┘       └───────┘
+
+Flow:
+  1. Register FD with callback
+  2. Reactor waits for events
+  3. Event occurs → Reactor calls callback
+  4. Callback handles event
   5. Repeat
 
 Example use:
@@ -128,10 +1377,1259 @@ Example use:
       read(socket_fd, buf, sizeof(buf));
       process(buf);
   });
+
+Timers (hierarchical timing wheel, 1 ms ticks):
+  struct Connection { int fd; Timer idle; };
+
+  conn->idle.callback = [conn]{ close_connection(conn); };
+  reactor.arm_timer(&conn->idle, 30000);   // on accept
+  reactor.arm_timer(&conn->idle, 30000);   // on every read: O(1), no allocation
+  reactor.cancel_timer(&conn->idle);       // on close
+
+Cross-thread (any thread → loop thread, lock-free, one eventfd write per burst):
+  // worker thread, after a blocking lookup
+  reactor.post([conn, result]{ send_response(conn, result); });
+
+Coroutines (C++20; frames from a per-loop pool, no allocation per suspension):
+  Task<> echo(int fd) {
+      char buf[4096];
+      for (;;) {
+          ssize_t n = co_await async_read(fd, buf, sizeof(buf));
+          if (n <= 0 || co_await async_write(fd, buf, n) != n) break;
+      }
+  }
+  spawn(reactor, echo(client_fd));
+
+Completions (the same handler code on epoll or io_uring):
+  using IoLoop = Proactor;   // or Reactor: readiness + syscall underneath
+  loop.async_recv(fd, buf, sizeof(buf), [conn](ssize_t n){ on_received(conn, n); });
+  loop.async_send(fd, buf, n, [conn](ssize_t sent){ on_sent(conn, sent); });
 )" << std::endl;
 }
 
-int main() {
+// ---------------------------------------------------------------------------
+// --echo PORT [IDLE_MS] [SPIN_POLLS]: echo server that drops connections idle
+// for IDLE_MS, optionally busy-polling (-1 = pure spin)
+// ---------------------------------------------------------------------------
+struct EchoConnection {
+    int fd;
+    Timer idle;
+};
+
+void close_echo_connection(Reactor* reactor, EchoConnection* conn) {
+    reactor->cancel_timer(&conn->idle);
+    reactor->unregister(conn->fd);
+    close(conn->fd);
+    delete conn;
+}
+
+// Bound and listening, or exit. `flags`: SOCK_NONBLOCK etc.
+int open_listener(int port, int flags) {
+    int server_fd = socket(AF_INET, SOCK_STREAM | flags, 0);
+    int opt = 1;
+    setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = INADDR_ANY;
+    addr.sin_port = htons(port);
+    
+    if (bind(server_fd, (struct sockaddr*)&addr, sizeof(addr)) == -1) {
+        perror("bind");
+        exit(1);
+    }
+    listen(server_fd, SOMAXCONN);
+    return server_fd;
+}
+
+void run_echo_server(int port, uint64_t idle_ms, int spin_polls) {
+    int server_fd = open_listener(port, 0);
+    
+    Reactor reactor;
+    reactor.set_spin_polls(spin_polls);
+    
+    reactor.register_read_handler(server_fd, [&reactor, server_fd, idle_ms] {
+        int client_fd = accept(server_fd, nullptr, nullptr);
+        if (client_fd == -1) return;
+        
+        EchoConnection* conn = new EchoConnection;
+        conn->fd = client_fd;
+        conn->idle.callback = [&reactor, conn] {
+            std::cout << "Idle timeout, closing fd " << conn->fd << std::endl;
+            close_echo_connection(&reactor, conn);
+        };
+        reactor.arm_timer(&conn->idle, idle_ms);
+        
+        reactor.register_read_handler(client_fd, [&reactor, conn, idle_ms] {
+            char buffer[4096];
+            ssize_t n = read(conn->fd, buffer, sizeof(buffer));
+            if (n <= 0 || write(conn->fd, buffer, n) != n) {
+                close_echo_connection(&reactor, conn);
+                return;
+            }
+            reactor.arm_timer(&conn->idle, idle_ms);
+        });
+    });
+    
+    std::cout << "Echo server on port " << port << ", idle timeout " << idle_ms << " ms";
+    if (spin_polls != 0) {
+        std::cout << ", busy-poll " << (spin_polls < 0 ? "forever" : std::to_string(spin_polls) + " polls");
+    }
+    std::cout << std::endl;
+    reactor.run();
+}
+
+// ---------------------------------------------------------------------------
+// A minimal HTTP/1.x handler shared by the callback (--http) and the coroutine
+// (--co-http) server, so --bench-http compares control flow, not protocol code.
+// GET /health answers "ok", any other request 404. Keep-alive follows the version and
+// the Connection header, pipelined requests are answered in order, Content-Length
+// bodies are waited for and skipped. Lines must end in CRLF; anything it can't serve
+// gets an error and a close. The full server (limits, routes, files) is http_server.cpp.
+// ---------------------------------------------------------------------------
+#define HTTP_BUFFER 8192          // Request bytes buffered per connection: head + body must fit
+#define HTTP_OUT_BUFFER 4096      // Responses rendered per write
+#define HTTP_MAX_RESPONSE 256     // Largest response rendered
+#define HTTP_MAX_REQUESTS 1000    // Default responses per connection before closing
+
+struct HttpConfig {
+    uint32_t max_requests = HTTP_MAX_REQUESTS;
+};
+
+HttpConfig http_config;
+
+// Views into the connection's buffer: valid until the answered bytes are dropped
+struct HttpRequest {
+    std::string_view method;
+    std::string_view path;
+    bool keep_alive;
+};
+
+// One connection's HTTP state: request bytes in, rendered responses out
+struct HttpExchange {
+    char in[HTTP_BUFFER];
+    char out[HTTP_OUT_BUFFER];
+    size_t used = 0;       // Bytes in `in`, from the first unanswered request on
+    size_t scanned = 0;    // Searched for the end of the head up to here
+    size_t out_len = 0;
+    uint32_t served = 0;
+    bool closing = false;  // The last response rendered closes the connection
+};
+
+bool equals_lowercase(std::string_view a, std::string_view lower) {
+    if (a.size() != lower.size()) return false;
+    for (size_t i = 0; i < a.size(); i++) {
+        char c = a[i];
+        if (c >= 'A' && c <= 'Z') c += 'a' - 'A';
+        if (c != lower[i]) return false;
+    }
+    return true;
+}
+
+std::string_view trim_http_value(std::string_view value) {
+    while (!value.empty() && (value.front() == ' ' || value.front() == '\t')) value.remove_prefix(1);
+    while (!value.empty() && (value.back() == ' ' || value.back() == '\t')) value.remove_suffix(1);
+    return value;
+}
+
+// The request at buf[0, len): its length (head + body) once buffered, 0 while more
+// bytes are needed, -status if it can't be served. `scanned` keeps where the search
+// for the end of the head stopped, so a head arriving in pieces isn't rescanned.
+ssize_t parse_http_request(const char* buf, size_t len, size_t* scanned, HttpRequest* req) {
+    size_t from = *scanned > 3 ? *scanned - 3 : 0;
+    const char* blank = (const char*)memmem(buf + from, len - from, "\r\n\r\n", 4);
+    if (!blank) {
+        *scanned = len;
+        return len >= HTTP_BUFFER ? -431 : 0;
+    }
+    const char* end = blank + 4;
+    
+    // METHOD SP /path SP HTTP/1.x CRLF; the CR is found, the blank line has one
+    const char* eol = (const char*)memchr(buf, '\r', end - buf);
+    const char* sp = (const char*)memchr(buf, ' ', eol - buf);
+    if (!sp || sp == buf || eol[1] != '\n') return -400;
+    req->method = std::string_view(buf, sp - buf);
+    
+    const char* path = sp + 1;
+    const char* version = (const char*)memchr(path, ' ', eol - path);
+    if (!version || *path != '/') return -400;
+    req->path = std::string_view(path, version - path);
+    
+    version++;
+    if (eol - version != 8 || memcmp(version, "HTTP/1.", 7) != 0) return -505;
+    if (version[7] != '0' && version[7] != '1') return -505;
+    
+    // Headers: only Content-Length, Transfer-Encoding and Connection matter here
+    size_t content_length = 0;
+    std::string_view connection;
+    for (const char* p = eol + 2; p < blank + 2; ) {
+        const char* cr = (const char*)memchr(p, '\r', end - p);
+        const char* colon = (const char*)memchr(p, ':', cr - p);
+        if (cr[1] != '\n' || !colon || colon == p) return -400;
+        std::string_view field(p, colon - p);
+        std::string_view value = trim_http_value(std::string_view(colon + 1, cr - colon - 1));
+        p = cr + 2;
+        
+        if (equals_lowercase(field, "content-length")) {
+            const char* digits_end = value.data() + value.size();
+            std::from_chars_result r = std::from_chars(value.data(), digits_end, content_length);
+            if (value.empty() || r.ec != std::errc() || r.ptr != digits_end) return -400;
+        } else if (equals_lowercase(field, "transfer-encoding")) {
+            return -501;  // No chunked request bodies
+        } else if (equals_lowercase(field, "connection")) {
+            connection = value;
+        }
+    }
+    
+    // Bodies aren't used, just waited for so the next request lines up
+    if (content_length > HTTP_BUFFER) return -413;
+    size_t length = end - buf + content_length;
+    if (length > HTTP_BUFFER) return -413;
+    if (length > len) {
+        *scanned = blank - buf;  // Found again next time
+        return 0;
+    }
+    
+    // HTTP/1.1 is persistent unless told otherwise, HTTP/1.0 only if asked
+    if (version[7] == '1') {
+        req->keep_alive = !equals_lowercase(connection, "close");
+    } else {
+        req->keep_alive = equals_lowercase(connection, "keep-alive");
+    }
+    return length;
+}
+
+struct HttpStatus {
+    int status;
+    std::string_view line;
+    std::string_view body;
+};
+
+// Every status http_answer() renders
+constexpr HttpStatus http_statuses[] = {
+    {200, "HTTP/1.1 200 OK\r\n", "ok\n"},
+    {400, "HTTP/1.1 400 Bad Request\r\n", "Bad Request\n"},
+    {404, "HTTP/1.1 404 Not Found\r\n", "Not Found\n"},
+    {413, "HTTP/1.1 413 Content Too Large\r\n", "Content Too Large\n"},
+    {431, "HTTP/1.1 431 Request Header Fields Too Large\r\n", "Request Header Fields Too Large\n"},
+    {501, "HTTP/1.1 501 Not Implemented\r\n", "Not Implemented\n"},
+    {505, "HTTP/1.1 505 HTTP Version Not Supported\r\n", "HTTP Version Not Supported\n"},
+};
+
+char* put_http(char* p, std::string_view s) {
+    memcpy(p, s.data(), s.size());
+    return p + s.size();
+}
+
+// Status line, Content-Type, Content-Length, Connection, body: at most HTTP_MAX_RESPONSE
+void append_http_response(HttpExchange* x, int status, bool keep_alive) {
+    const HttpStatus* s = http_statuses;
+    while (s->status != status) s++;
+    
+    char* p = x->out + x->out_len;
+    p = put_http(p, s->line);
+    p = put_http(p, "Content-Type: text/plain\r\nContent-Length: ");
+    p = std::to_chars(p, p + 20, s->body.size()).ptr;
+    p = put_http(p, keep_alive ? "\r\nConnection: keep-alive\r\n\r\n" : "\r\nConnection: close\r\n\r\n");
+    p = put_http(p, s->body);
+    x->out_len = p - x->out;
+}
+
+// Answer the buffered requests in order (pipelining) into `out`, until it can't take
+// another response or one closes the connection. Answered bytes are dropped, so unless
+// it is closing, `in` has room for the next read. Returns true if `out` has bytes.
+bool http_answer(HttpExchange* x) {
+    size_t start = 0;
+    while (!x->closing && HTTP_OUT_BUFFER - x->out_len >= HTTP_MAX_RESPONSE) {
+        HttpRequest request;
+        ssize_t length = parse_http_request(x->in + start, x->used - start, &x->scanned, &request);
+        if (length == 0) break;
+        if (length < 0) {
+            // Where the next request would start is unknown: answer and close
+            x->closing = true;
+            append_http_response(x, (int)-length, false);
+            break;
+        }
+        start += length;
+        x->scanned = 0;
+        
+        bool keep_alive = request.keep_alive && ++x->served < http_config.max_requests;
+        x->closing = !keep_alive;
+        bool health = request.method == "GET" && request.path.substr(0, request.path.find('?')) == "/health";
+        append_http_response(x, health ? 200 : 404, keep_alive);
+    }
+    
+    memmove(x->in, x->in + start, x->used - start);
+    x->used -= start;
+    return x->out_len > 0;
+}
+
+// ---------------------------------------------------------------------------
+// --http PORT [IDLE_MS]: the callback version, a state object per connection as in
+// --echo. A full socket parks the output on EPOLLOUT and stops reading until it drains.
+// ---------------------------------------------------------------------------
+struct HttpConnection {
+    int fd;
+    bool blocked;      // Waiting for EPOLLOUT, the read handler is off
+    uint64_t idle_ms;
+    size_t out_sent;   // Bytes of http.out already written
+    int* live;         // Connections left, the loop stops at 0; nullptr = serve forever
+    Timer idle;
+    HttpExchange http;
+};
+
+void close_http_connection(Reactor* reactor, HttpConnection* conn) {
+    reactor->cancel_timer(&conn->idle);
+    reactor->unregister(conn->fd);
+    close(conn->fd);
+    if (conn->live && --*conn->live == 0) reactor->stop();
+    delete conn;
+}
+
+void http_on_readable(Reactor* reactor, HttpConnection* conn);
+
+// Write what is rendered, answer what is buffered, repeat until neither has anything
+void http_flush(Reactor* reactor, HttpConnection* conn) {
+    HttpExchange* x = &conn->http;
+    do {
+        while (conn->out_sent < x->out_len) {
+            ssize_t n = write(conn->fd, x->out + conn->out_sent, x->out_len - conn->out_sent);
+            if (n == -1 && errno == EINTR) continue;
+            if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                if (!conn->blocked) {
+                    conn->blocked = true;
+                    reactor->register_read_handler(conn->fd, Handler());
+                    reactor->register_write_handler(conn->fd, [reactor, conn] { http_flush(reactor, conn); });
+                }
+                return;
+            }
+            if (n == -1) {
+                close_http_connection(reactor, conn);
+                return;
+            }
+            conn->out_sent += n;
+        }
+        x->out_len = 0;
+        conn->out_sent = 0;
+        if (x->closing) {
+            close_http_connection(reactor, conn);
+            return;
+        }
+    } while (http_answer(x));
+    
+    if (conn->blocked) {
+        conn->blocked = false;
+        reactor->register_read_handler(conn->fd, [reactor, conn] { http_on_readable(reactor, conn); });
+        reactor->unregister_write_handler(conn->fd);
+    }
+}
+
+void http_on_readable(Reactor* reactor, HttpConnection* conn) {
+    HttpExchange* x = &conn->http;
+    ssize_t n = read(conn->fd, x->in + x->used, sizeof(x->in) - x->used);
+    if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) return;
+    if (n <= 0) {
+        close_http_connection(reactor, conn);
+        return;
+    }
+    x->used += n;
+    if (conn->idle_ms) reactor->arm_timer(&conn->idle, conn->idle_ms);
+    http_flush(reactor, conn);
+}
+
+// `fd` non-blocking
+void start_http_connection(Reactor* reactor, int fd, uint64_t idle_ms, int* live) {
+    HttpConnection* conn = new HttpConnection;
+    conn->fd = fd;
+    conn->blocked = false;
+    conn->idle_ms = idle_ms;
+    conn->out_sent = 0;
+    conn->live = live;
+    conn->idle.callback = [reactor, conn] { close_http_connection(reactor, conn); };
+    if (idle_ms) reactor->arm_timer(&conn->idle, idle_ms);
+    
+    reactor->register_read_handler(fd, [reactor, conn] { http_on_readable(reactor, conn); });
+}
+
+void run_http_server(int port, uint64_t idle_ms) {
+    int server_fd = open_listener(port, 0);
+    signal(SIGPIPE, SIG_IGN);
+    
+    Reactor reactor;
+    reactor.register_read_handler(server_fd, [&reactor, server_fd, idle_ms] {
+        int client_fd = accept4(server_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (client_fd != -1) start_http_connection(&reactor, client_fd, idle_ms, nullptr);
+    });
+    
+    std::cout << "HTTP server (callbacks) on port " << port << ", idle timeout " << idle_ms << " ms" << std::endl;
+    reactor.run();
+}
+
+#ifdef HAVE_COROUTINES
+// ---------------------------------------------------------------------------
+// --co-echo PORT [IDLE_MS] / --co-http PORT [IDLE_MS]: the same servers written as
+// one coroutine per connection. The protocol reads top to bottom; the state the
+// callbacks kept in a heap object lives in the frame.
+// ---------------------------------------------------------------------------
+Task<> co_echo_session(Reactor& reactor, int fd, uint64_t idle_ms) {
+    Timer idle;
+    idle.callback = [fd] {
+        std::cout << "Idle timeout, closing fd " << fd << std::endl;
+        shutdown(fd, SHUT_RDWR);  // The pending read returns EOF
+    };
+    char buffer[4096];
+    
+    for (;;) {
+        if (idle_ms) reactor.arm_timer(&idle, idle_ms);
+        ssize_t n = co_await async_read(fd, buffer, sizeof(buffer));
+        if (n <= 0 || co_await async_write(fd, buffer, n) != n) break;
+    }
+    
+    reactor.cancel_timer(&idle);
+    reactor.unregister(fd);
+    close(fd);
+}
+
+// The request path above (HttpExchange) with the I/O in line: read, answer what is
+// buffered, write, until the client leaves or a response closes the connection
+Task<> co_http_session(Reactor& reactor, int fd, uint64_t idle_ms) {
+    Timer idle;
+    idle.callback = [fd] { shutdown(fd, SHUT_RDWR); };
+    HttpExchange http;
+    
+    while (!http.closing) {
+        if (idle_ms) reactor.arm_timer(&idle, idle_ms);
+        ssize_t n = co_await async_read(fd, http.in + http.used, sizeof(http.in) - http.used);
+        if (n <= 0) break;
+        http.used += n;
+        
+        while (http_answer(&http)) {
+            ssize_t sent = co_await async_write(fd, http.out, http.out_len);
+            if (sent != (ssize_t)http.out_len) http.closing = true;
+            http.out_len = 0;
+        }
+    }
+    
+    reactor.cancel_timer(&idle);
+    reactor.unregister(fd);
+    close(fd);
+}
+
+Task<> co_accept_loop(Reactor& reactor, int server_fd, uint64_t idle_ms,
+                      Task<> (*session)(Reactor&, int, uint64_t)) {
+    for (;;) {
+        int client_fd = accept4(server_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (client_fd != -1) {
+            spawn(reactor, session(reactor, client_fd, idle_ms));
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            co_await reactor.readable(server_fd);
+        } else if (errno != EINTR && errno != ECONNABORTED) {
+            perror("accept4");
+            co_await reactor.sleep_for(100);  // EMFILE and friends: don't spin
+        }
+    }
+}
+
+void run_co_server(int port, uint64_t idle_ms, bool http) {
+    int server_fd = open_listener(port, SOCK_NONBLOCK);
+    signal(SIGPIPE, SIG_IGN);
+    
+    Reactor reactor;
+    spawn(reactor, co_accept_loop(reactor, server_fd, idle_ms, http ? co_http_session : co_echo_session));
+    
+    std::cout << (http ? "HTTP" : "Echo") << " server (coroutines) on port " << port
+              << ", idle timeout " << idle_ms << " ms" << std::endl;
+    reactor.run();
+}
+#endif
+
+// ---------------------------------------------------------------------------
+// --completion-echo PORT [reactor|proactor]: one echo server written against the
+// completion API, run on either loop. Switching engines is the template argument:
+//   using IoLoop = Proactor;  // or Reactor
+// ---------------------------------------------------------------------------
+template <typename Loop>
+struct CompletionEcho {
+    Loop* loop;
+    int fd;
+    int* live;  // Sessions left, the loop stops at 0; nullptr = serve forever
+    size_t length;
+    size_t sent;
+    char buffer[4096];
+    
+    void receive() {
+        if (!loop->async_recv(fd, buffer, sizeof(buffer), [this](ssize_t n) { on_received(n); })) finish();
+    }
+    
+    void on_received(ssize_t n) {
+        if (n <= 0) {
+            finish();
+            return;
+        }
+        length = n;
+        sent = 0;
+        send_rest();
+    }
+    
+    void send_rest() {
+        if (!loop->async_send(fd, buffer + sent, length - sent, [this](ssize_t n) { on_sent(n); })) finish();
+    }
+    
+    void on_sent(ssize_t n) {
+        if (n <= 0) {
+            finish();
+            return;
+        }
+        sent += n;
+        if (sent < length) {
+            send_rest();
+        } else {
+            receive();
+        }
+    }
+    
+    // Only ever reached with nothing in flight (one operation at a time, and this runs
+    // from its completion or a failed submit), so no -ECANCELED can follow the delete
+    void finish() {
+        loop->close_fd(fd);
+        if (live && --*live == 0) loop->stop();
+        delete this;
+    }
+};
+
+template <typename Loop>
+void start_completion_echo(Loop* loop, int fd, int* live) {
+    CompletionEcho<Loop>* session = new CompletionEcho<Loop>;
+    session->loop = loop;
+    session->fd = fd;
+    session->live = live;
+    session->receive();
+}
+
+// One accept always in flight on the listening socket
+template <typename Loop>
+struct CompletionAcceptor {
+    Loop* loop;
+    int listen_fd;
+    
+    void accept_next() {
+        loop->async_accept(listen_fd, [this](ssize_t client_fd) { on_accepted(client_fd); });
+    }
+    
+    void on_accepted(ssize_t client_fd) {
+        if (client_fd >= 0) {
+            start_completion_echo(loop, (int)client_fd, nullptr);
+        } else if (client_fd != -EINTR && client_fd != -ECONNABORTED) {
+            std::cerr << "accept: " << strerror(-client_fd) << std::endl;
+        }
+        accept_next();
+    }
+};
+
+template <typename Loop>
+void run_completion_echo(int port, const char* engine) {
+    int server_fd = open_listener(port, SOCK_NONBLOCK);
+    signal(SIGPIPE, SIG_IGN);
+    
+    Loop loop;
+    CompletionAcceptor<Loop> acceptor{&loop, server_fd};
+    acceptor.accept_next();
+    
+    std::cout << "Echo server (completions on " << engine << ") on port " << port << std::endl;
+    loop.run();
+}
+
+// ---------------------------------------------------------------------------
+// --check-close: close_fd with operations in flight, on each engine. A recv and a
+// send parked on a silent, full socket and a recv not yet started are closed; each
+// must complete exactly once with -ECANCELED, the peers must see EOF, and no
+// operation slot may be left taken.
+// ---------------------------------------------------------------------------
+template <typename Loop>
+struct CloseCheck {
+    Loop* loop;
+    ssize_t results[3];  // Parked recv, parked send, unstarted recv
+    int calls[3];
+    int pending;
+    
+    Completion counter(int which) {
+        return [this, which](ssize_t result) {
+            results[which] = result;
+            if (calls[which]++ == 0 && --pending == 0) loop->stop();
+        };
+    }
+};
+
+// Both ends non-blocking; the client end is the one the check reads
+void check_pair(int sv[2]) {
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, sv) == -1) {
+        perror("socketpair");
+        exit(1);
+    }
+}
+
+// Closed by the peer: everything it sent is readable, then EOF
+bool peer_sees_eof(int fd) {
+    char buffer[65536];
+    for (;;) {
+        ssize_t n = recv(fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+        if (n == 0) return true;
+        if (n < 0) return false;
+    }
+}
+
+template <typename Loop>
+bool check_close_in_flight(const char* engine) {
+    Loop loop;
+    CloseCheck<Loop> check{&loop, {0, 0, 0}, {0, 0, 0}, 3};
+    
+    int session[2], fresh[2], trigger[2];
+    check_pair(session);
+    check_pair(fresh);
+    check_pair(trigger);
+    
+    // Fill session's send buffer so the send has to wait, and give trigger's recv a byte
+    static char chunk[65536];
+    while (write(session[1], chunk, sizeof(chunk)) > 0) {}
+    ssize_t ignored = write(trigger[0], "x", 1);
+    (void)ignored;
+    
+    char in[64], trigger_in[1];
+    loop.async_recv(session[1], in, sizeof(in), check.counter(0));
+    loop.async_send(session[1], chunk, sizeof(chunk), check.counter(1));
+    loop.async_recv(fresh[1], in, sizeof(in), check.counter(2));
+    loop.close_fd(fresh[1]);  // Before the loop has run: queued, never started
+    
+    // Runs after the session's operations are parked (Reactor) or in the kernel (Proactor)
+    int session_fd = session[1];
+    loop.async_recv(trigger[1], trigger_in, 1, [&loop, session_fd](ssize_t) { loop.close_fd(session_fd); });
+    loop.run();
+    
+    static const char* names[3] = {"parked recv", "parked send", "unstarted recv"};
+    bool ok = true;
+    std::cout << engine << ":";
+    for (int i = 0; i < 3; i++) {
+        bool good = check.calls[i] == 1 && check.results[i] == -ECANCELED;
+        std::cout << " " << names[i] << " " << check.calls[i] << "x "
+                  << (check.results[i] < 0 ? strerror(-check.results[i]) : std::to_string(check.results[i]))
+                  << (good ? "" : " (WRONG)") << ",";
+        ok = ok && good;
+    }
+    bool eof = peer_sees_eof(session[0]) && peer_sees_eof(fresh[0]);
+    size_t left = loop.ops_in_flight();
+    std::cout << (eof ? " peers see EOF" : " peer still open (WRONG)") << ", " << left << " ops left"
+              << (eof && left == 0 && ok ? ": ok" : ": FAILED") << std::endl;
+    
+    loop.close_fd(trigger[1]);
+    close(session[0]);
+    close(fresh[0]);
+    close(trigger[0]);
+    return ok && eof && left == 0;
+}
+
+int check_close() {
+    std::cout << "=== close_fd with operations in flight ===" << std::endl;
+    alarm(10);  // A completion that never comes is a failure too
+    bool ok = check_close_in_flight<Reactor>("Reactor (epoll)");
+#ifdef HAVE_LIBURING
+    ok = check_close_in_flight<Proactor>("Proactor (io_uring)") && ok;
+#else
+    std::cout << "Proactor (io_uring): skipped, built without liburing" << std::endl;
+#endif
+    return ok ? 0 : 1;
+}
+
+// ---------------------------------------------------------------------------
+// --bench-timers: 1M armed timers, cost per arm / reset / cancel / tick
+// ---------------------------------------------------------------------------
+#define BENCH_TIMERS 1000000
+
+double elapsed_ns(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::nano>(
+        std::chrono::steady_clock::now() - start).count();
+}
+
+void benchmark_timers() {
+    std::cout << "=== Timing wheel benchmark: " << BENCH_TIMERS << " timers ===" << std::endl;
+    
+    Reactor reactor;
+    std::vector<Timer> timers(BENCH_TIMERS);
+    size_t fired = 0;
+    for (Timer& timer : timers) timer.callback = [&fired] { fired++; };
+    
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<uint64_t> timeout(1000, 60000);
+    std::vector<uint64_t> timeouts(BENCH_TIMERS * 2);
+    for (uint64_t& t : timeouts) t = timeout(rng);
+    
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < BENCH_TIMERS; i++) reactor.arm_timer(&timers[i], timeouts[i]);
+    double arm = elapsed_ns(start) / BENCH_TIMERS;
+    
+    // Idle reset on I/O: about half move later (lazy), half earlier (relink)
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < BENCH_TIMERS; i++) reactor.arm_timer(&timers[i], timeouts[BENCH_TIMERS + i]);
+    double reset = elapsed_ns(start) / BENCH_TIMERS;
+    
+    // Per-event overhead the loop pays with everything armed
+    const int polls = 1000000;
+    int checksum = 0;
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < polls; i++) checksum += reactor.next_timeout_ms();
+    double next_timeout = elapsed_ns(start) / polls;
+    
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < BENCH_TIMERS; i += 2) reactor.cancel_timer(&timers[i]);
+    double cancel = elapsed_ns(start) / (BENCH_TIMERS / 2);
+    size_t remaining = reactor.armed_timers();
+    
+    // Run the wheel's clock forward past every deadline
+    uint64_t base = reactor.now_ms();
+    start = std::chrono::steady_clock::now();
+    reactor.advance_timers(base + 61000);
+    double advance = elapsed_ns(start);
+    
+    std::cout << "arm:              " << arm << " ns/timer" << std::endl;
+    std::cout << "reset (re-arm):   " << reset << " ns/timer" << std::endl;
+    std::cout << "cancel:           " << cancel << " ns/timer" << std::endl;
+    std::cout << "next_timeout_ms:  " << next_timeout << " ns/call (" << BENCH_TIMERS << " armed)" << std::endl;
+    std::cout << "expire:           " << advance / fired << " ns/timer, "
+              << advance / 61000 << " ns/tick over 61000 ticks" << std::endl;
+    std::cout << "fired " << fired << " of " << remaining << " remaining, "
+              << reactor.armed_timers() << " still armed"
+              << (fired == remaining && reactor.armed_timers() == 0 ? " (ok)" : " (MISMATCH)")
+              << std::endl;
+    (void)checksum;
+}
+
+// ---------------------------------------------------------------------------
+// --bench-dispatch: 100k registered fds, batches of ready events at random fds fed
+// straight to dispatch(). Flat table + inline handlers vs two std::maps of std::function.
+// ---------------------------------------------------------------------------
+#define BENCH_FDS 100000
+#define BENCH_BATCH_POOL 4096   // Pre-built event batches, replayed in a loop
+#define BENCH_DISPATCH_EVENTS 20000000
+
+// Bytes malloc has handed out and not yet taken back
+size_t heap_in_use() {
+    return mallinfo2().uordblks;
+}
+
+// How handlers used to be stored, for comparison
+struct MapDispatch {
+    std::map<int, std::function<void()>> read_handlers;
+    std::map<int, std::function<void()>> write_handlers;
+    
+    void dispatch(const struct epoll_event* events, int count) {
+        for (int i = 0; i < count; i++) {
+            int fd = events[i].data.fd;
+            
+            if (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)) {
+                auto it = read_handlers.find(fd);
+                if (it != read_handlers.end()) it->second();
+            }
+            if (events[i].events & EPOLLOUT) {
+                auto it = write_handlers.find(fd);
+                if (it != write_handlers.end()) it->second();
+            }
+        }
+    }
+};
+
+void benchmark_dispatch() {
+    // epoll_ctl only takes real fds: eventfds, as many as the limit allows
+    struct rlimit limit;
+    getrlimit(RLIMIT_NOFILE, &limit);
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+    
+    Reactor reactor(limit.rlim_cur == RLIM_INFINITY ? BENCH_FDS + 64 : limit.rlim_cur);
+    
+    std::vector<int> fds;
+    while (fds.size() < BENCH_FDS) {
+        int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (fd == -1) break;
+        fds.push_back(fd);
+    }
+    
+    std::cout << "=== Reactor dispatch benchmark: " << fds.size() << " registered fds";
+    if (fds.size() < BENCH_FDS) std::cout << " (RLIMIT_NOFILE " << limit.rlim_max << ", wanted " << BENCH_FDS << ")";
+    std::cout << " ===" << std::endl;
+    std::cout << "HandlerSlot: " << sizeof(HandlerSlot) << " bytes (read + write, "
+              << HANDLER_CAPTURE_BYTES << " capture bytes each)" << std::endl;
+    
+    // 24-byte captures: inline in a Handler, too big for std::function's local buffer
+    uint64_t calls = 0;
+    uint64_t checksum = 0;
+    MapDispatch maps;
+    
+    size_t before = heap_in_use();
+    for (size_t i = 0; i < fds.size(); i++) {
+        int fd = fds[i];
+        reactor.register_read_handler(fd, [&calls, &checksum, fd] { calls++; checksum += fd; });
+        if (i % 4 == 0) reactor.register_write_handler(fd, [&calls, &checksum, fd] { calls++; checksum -= fd; });
+    }
+    size_t table_heap = heap_in_use() - before;
+    
+    before = heap_in_use();
+    for (size_t i = 0; i < fds.size(); i++) {
+        int fd = fds[i];
+        maps.read_handlers[fd] = [&calls, &checksum, fd] { calls++; checksum += fd; };
+        if (i % 4 == 0) maps.write_handlers[fd] = [&calls, &checksum, fd] { calls++; checksum -= fd; };
+    }
+    size_t map_heap = heap_in_use() - before;
+    
+    // Ready fds spread over the whole table, like many mostly idle connections
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<size_t> pick(0, fds.size() - 1);
+    std::vector<struct epoll_event> batches(BENCH_BATCH_POOL * MAX_EVENTS);
+    for (struct epoll_event& ev : batches) {
+        size_t i = pick(rng);
+        ev.data.fd = fds[i];
+        ev.events = EPOLLIN | (i % 4 == 0 ? (uint32_t)EPOLLOUT : 0);
+    }
+    
+    const int rounds = BENCH_DISPATCH_EVENTS / MAX_EVENTS;
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; r++) {
+        reactor.dispatch(&batches[(r % BENCH_BATCH_POOL) * MAX_EVENTS], MAX_EVENTS);
+    }
+    double table_ns = elapsed_ns(start) / ((double)rounds * MAX_EVENTS);
+    uint64_t table_calls = calls;
+    
+    calls = 0;
+    start = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; r++) {
+        maps.dispatch(&batches[(r % BENCH_BATCH_POOL) * MAX_EVENTS], MAX_EVENTS);
+    }
+    double map_ns = elapsed_ns(start) / ((double)rounds * MAX_EVENTS);
+    
+    std::cout << "register:  flat table " << (double)table_heap / fds.size() << " heap bytes/fd, "
+              << "std::map + std::function " << (double)map_heap / fds.size() << " heap bytes/fd" << std::endl;
+    std::cout << "dispatch:  flat table " << table_ns << " ns/event, "
+              << "std::map + std::function " << map_ns << " ns/event ("
+              << map_ns / table_ns << "x)" << std::endl;
+    std::cout << "handlers called: " << table_calls << " vs " << calls
+              << (table_calls == calls ? " (ok)" : " (MISMATCH)") << std::endl;
+    (void)checksum;
+    
+    for (int fd : fds) {
+        reactor.unregister(fd);
+        close(fd);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// --bench-post [PRODUCERS]: threads flooding post() (throughput, eventfd writes
+// per post), then one post at a time into an idle loop (wakeup latency)
+// ---------------------------------------------------------------------------
+#define BENCH_POSTS 4000000    // Across all producers
+#define BENCH_WAKEUPS 10000    // Latency samples
+#define BENCH_WAKEUP_GAP_US 100
+
+void benchmark_post(int producers) {
+    std::cout << "=== Cross-thread post() benchmark: " << producers << " producer threads, "
+              << std::thread::hardware_concurrency() << " CPUs ===" << std::endl;
+    
+    Reactor reactor;
+    uint64_t per_producer = BENCH_POSTS / producers;
+    uint64_t total = per_producer * producers;
+    uint64_t ran = 0;  // Only touched on the loop thread
+    std::atomic<uint64_t> full{0};
+    
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (int p = 0; p < producers; p++) {
+        threads.emplace_back([&reactor, &ran, &full, per_producer, total] {
+            for (uint64_t i = 0; i < per_producer; i++) {
+                while (!reactor.post([&reactor, &ran, total] {
+                    if (++ran == total) reactor.stop();
+                })) {
+                    full.fetch_add(1, std::memory_order_relaxed);
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+    reactor.run();
+    double seconds = elapsed_ns(start) / 1e9;
+    for (std::thread& t : threads) t.join();
+    uint64_t writes = reactor.wakeup_writes();
+    
+    std::cout << "throughput:  " << (uint64_t)(total / seconds) << " posts/sec (" << total << " posts, "
+              << ran << " run" << (ran == total ? ", ok" : ", MISMATCH") << ")" << std::endl;
+    std::cout << "coalescing:  " << writes << " eventfd writes, " << (double)total / writes
+              << " posts/write, ring full " << full.load() << " times" << std::endl;
+    
+    // Latency: the loop is asleep in epoll_wait each time
+    std::vector<double> latencies;
+    latencies.reserve(BENCH_WAKEUPS);
+    std::thread poster([&reactor, &latencies] {
+        for (int i = 0; i < BENCH_WAKEUPS; i++) {
+            std::this_thread::sleep_for(std::chrono::microseconds(BENCH_WAKEUP_GAP_US));
+            auto posted_at = std::chrono::steady_clock::now();
+            reactor.post([&latencies, posted_at] { latencies.push_back(elapsed_ns(posted_at)); });
+        }
+        reactor.post([&reactor] { reactor.stop(); });
+    });
+    reactor.run();
+    poster.join();
+    
+    std::sort(latencies.begin(), latencies.end());
+    auto percentile = [&latencies](double p) {
+        return latencies[std::min(latencies.size() - 1, (size_t)(p * latencies.size()))] / 1000;
+    };
+    std::cout << "wakeup:      p50 " << percentile(0.5) << " us, p99 " << percentile(0.99)
+              << " us, p99.9 " << percentile(0.999) << " us, max " << latencies.back() / 1000
+              << " us (" << latencies.size() << " posts into an idle loop)" << std::endl;
+}
+
+// ---------------------------------------------------------------------------
+// Echo benchmarks over socketpairs (--bench-echo, --bench-proactor): a client thread
+// writes a message to every connection, then reads every echo
+// ---------------------------------------------------------------------------
+#define BENCH_ECHO_CONNS 64
+#define BENCH_ECHO_ROUNDS 5000
+#define BENCH_ECHO_MESSAGE 64
+#define BENCH_ECHO_RUNS 3       // Alternating, best of each
+#define BENCH_ECHO_IDLE_MS 10000  // Both servers re-arm an idle timer per read, as --echo does
+
+// Client ends (blocking) are returned, server ends (non-blocking) go to server_fds
+std::vector<int> open_echo_pairs(int conns, std::vector<int>& server_fds) {
+    std::vector<int> client_fds;
+    for (int c = 0; c < conns; c++) {
+        int sv[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) == -1) {
+            perror("socketpair");
+            exit(1);
+        }
+        fcntl(sv[1], F_SETFL, O_NONBLOCK);
+        client_fds.push_back(sv[0]);
+        server_fds.push_back(sv[1]);
+    }
+    return client_fds;
+}
+
+// Closes the client ends when done, so every server session ends on EOF
+std::thread start_echo_client(std::vector<int> client_fds, int rounds, double* seconds) {
+    return std::thread([client_fds, rounds, seconds] {
+        char message[BENCH_ECHO_MESSAGE];
+        memset(message, 'x', sizeof(message));
+        
+        auto start = std::chrono::steady_clock::now();
+        for (int r = 0; r < rounds; r++) {
+            for (int fd : client_fds) {
+                if (write(fd, message, sizeof(message)) != sizeof(message)) exit(1);
+            }
+            for (int fd : client_fds) {
+                char echo[BENCH_ECHO_MESSAGE];
+                for (size_t got = 0; got < sizeof(echo); ) {
+                    ssize_t n = read(fd, echo + got, sizeof(echo) - got);
+                    if (n <= 0) exit(1);
+                    got += n;
+                }
+            }
+        }
+        *seconds = elapsed_ns(start) / 1e9;
+        for (int fd : client_fds) close(fd);
+    });
+}
+
+#ifdef HAVE_COROUTINES
+// ---------------------------------------------------------------------------
+// --bench-echo [CONNS] [ROUNDS]: callback echo vs coroutine echo
+// ---------------------------------------------------------------------------
+
+// Counts the session down so the loop stops once every connection has closed
+Task<> counted_echo_session(Reactor& reactor, int fd, int& live) {
+    co_await co_echo_session(reactor, fd, BENCH_ECHO_IDLE_MS);
+    if (--live == 0) reactor.stop();
+}
+
+double benchmark_echo_server(bool coroutines, int conns, int rounds) {
+    Reactor reactor;
+    int live = conns;
+    std::vector<int> server_fds;
+    std::vector<int> client_fds = open_echo_pairs(conns, server_fds);
+    
+    for (int fd : server_fds) {
+        if (coroutines) {
+            spawn(reactor, counted_echo_session(reactor, fd, live));
+        } else {
+            // run_echo_server's connection and handler, plus the count
+            EchoConnection* conn = new EchoConnection;
+            conn->fd = fd;
+            conn->idle.callback = [&reactor, conn] { close_echo_connection(&reactor, conn); };
+            reactor.arm_timer(&conn->idle, BENCH_ECHO_IDLE_MS);
+            
+            reactor.register_read_handler(fd, [&reactor, &live, conn] {
+                char buffer[4096];
+                ssize_t n = read(conn->fd, buffer, sizeof(buffer));
+                if (n <= 0 || write(conn->fd, buffer, n) != n) {
+                    close_echo_connection(&reactor, conn);
+                    if (--live == 0) reactor.stop();
+                    return;
+                }
+                reactor.arm_timer(&conn->idle, BENCH_ECHO_IDLE_MS);
+            });
+        }
+    }
+    
+    double seconds = 0;
+    std::thread client = start_echo_client(client_fds, rounds, &seconds);
+    reactor.run();
+    client.join();
+    
+    return (double)conns * rounds / seconds;
+}
+
+void benchmark_echo(int conns, int rounds) {
+    std::cout << "=== Echo benchmark: " << conns << " connections x " << rounds << " round trips of "
+              << BENCH_ECHO_MESSAGE << " bytes, best of " << BENCH_ECHO_RUNS << " ===" << std::endl;
+    
+    double callbacks = 0;
+    double coroutines = 0;
+    uint64_t frames = frame_pool.frames_allocated();
+    size_t heap = frame_pool.heap_allocations();
+    for (int run = 0; run < BENCH_ECHO_RUNS; run++) {
+        callbacks = std::max(callbacks, benchmark_echo_server(false, conns, rounds));
+        coroutines = std::max(coroutines, benchmark_echo_server(true, conns, rounds));
+    }
+    frames = frame_pool.frames_allocated() - frames;
+    heap = frame_pool.heap_allocations() - heap;
+    
+    std::cout << "callbacks:   " << (uint64_t)callbacks << " messages/sec" << std::endl;
+    std::cout << "coroutines:  " << (uint64_t)coroutines << " messages/sec (" << coroutines / callbacks
+              << "x)" << std::endl;
+    std::cout << "frames:      " << frames << " coroutine frames for " << (uint64_t)conns * rounds * 2 * BENCH_ECHO_RUNS
+              << " reads + writes, " << heap << " heap allocations (pool slabs)" << std::endl;
+}
+
+// ---------------------------------------------------------------------------
+// --bench-http [CONNS] [ROUNDS]: --http vs --co-http, the same HttpExchange under
+// both. Each round the client pipelines BENCH_HTTP_DEPTH wrk-style GET /health
+// requests on every connection, then reads every response.
+// ---------------------------------------------------------------------------
+#define BENCH_HTTP_CONNS 64
+#define BENCH_HTTP_ROUNDS 1000
+#define BENCH_HTTP_DEPTH 8
+
+const char bench_http_request[] =
+    "GET /health HTTP/1.1\r\n"
+    "Host: localhost:8080\r\n"
+    "User-Agent: wrk/4.2.0\r\n"
+    "Accept: */*\r\n"
+    "Accept-Encoding: gzip, deflate\r\n"
+    "Connection: keep-alive\r\n"
+    "\r\n";
+
+// Bytes of one response to bench_http_request, rendered by the servers' own code
+size_t bench_http_response_length() {
+    HttpExchange* x = new HttpExchange;
+    memcpy(x->in, bench_http_request, sizeof(bench_http_request) - 1);
+    x->used = sizeof(bench_http_request) - 1;
+    http_answer(x);
+    size_t length = x->out_len;
+    delete x;
+    return length;
+}
+
+// Closes the client ends when done, so every server session ends on EOF
+std::thread start_http_client(std::vector<int> client_fds, int rounds, size_t response_length, double* seconds) {
+    return std::thread([client_fds, rounds, response_length, seconds] {
+        std::string requests;
+        for (int i = 0; i < BENCH_HTTP_DEPTH; i++) requests += bench_http_request;
+        std::vector<char> responses(response_length * BENCH_HTTP_DEPTH);
+        
+        auto start = std::chrono::steady_clock::now();
+        for (int r = 0; r < rounds; r++) {
+            for (int fd : client_fds) {
+                if (write(fd, requests.data(), requests.size()) != (ssize_t)requests.size()) exit(1);
+            }
+            for (int fd : client_fds) {
+                for (size_t got = 0; got < responses.size(); ) {
+                    ssize_t n = read(fd, responses.data() + got, responses.size() - got);
+                    if (n <= 0) exit(1);
+                    got += n;
+                }
+                if (memcmp(responses.data(), "HTTP/1.1 200 OK\r\n", 17) != 0) exit(1);
+            }
+        }
+        *seconds = elapsed_ns(start) / 1e9;
+        for (int fd : client_fds) close(fd);
+    });
+}
+
+Task<> counted_http_session(Reactor& reactor, int fd, int& live) {
+    co_await co_http_session(reactor, fd, BENCH_ECHO_IDLE_MS);
+    if (--live == 0) reactor.stop();
+}
+
+double benchmark_http_server(bool coroutines, int conns, int rounds, size_t response_length) {
+    Reactor reactor;
+    int live = conns;
+    std::vector<int> server_fds;
+    std::vector<int> client_fds = open_echo_pairs(conns, server_fds);
+    
+    for (int fd : server_fds) {
+        if (coroutines) {
+            spawn(reactor, counted_http_session(reactor, fd, live));
+        } else {
+            start_http_connection(&reactor, fd, BENCH_ECHO_IDLE_MS, &live);
+        }
+    }
+    
+    double seconds = 0;
+    std::thread client = start_http_client(client_fds, rounds, response_length, &seconds);
+    reactor.run();
+    client.join();
+    
+    return (double)conns * rounds * BENCH_HTTP_DEPTH / seconds;
+}
+
+void benchmark_http(int conns, int rounds) {
+    std::cout << "=== HTTP benchmark: " << conns << " connections x " << rounds << " rounds of "
+              << BENCH_HTTP_DEPTH << " pipelined GET /health, best of " << BENCH_ECHO_RUNS << " ===" << std::endl;
+    
+    size_t response_length = bench_http_response_length();
+    uint32_t max_requests = http_config.max_requests;
+    http_config.max_requests = UINT32_MAX;  // Every connection lasts the whole run
+    
+    double callbacks = 0;
+    double coroutines = 0;
+    uint64_t frames = frame_pool.frames_allocated();
+    size_t heap = frame_pool.heap_allocations();
+    for (int run = 0; run < BENCH_ECHO_RUNS; run++) {
+        callbacks = std::max(callbacks, benchmark_http_server(false, conns, rounds, response_length));
+        coroutines = std::max(coroutines, benchmark_http_server(true, conns, rounds, response_length));
+    }
+    frames = frame_pool.frames_allocated() - frames;
+    heap = frame_pool.heap_allocations() - heap;
+    http_config.max_requests = max_requests;
+    
+    std::cout << "callbacks:   " << (uint64_t)callbacks << " requests/sec (--http)" << std::endl;
+    std::cout << "coroutines:  " << (uint64_t)coroutines << " requests/sec (" << coroutines / callbacks
+              << "x, --co-http)" << std::endl;
+    std::cout << "frames:      " << frames << " coroutine frames, " << heap << " heap allocations (pool slabs)"
+              << std::endl;
+}
+#endif
+
+#ifdef HAVE_LIBURING
+// ---------------------------------------------------------------------------
+// --bench-proactor [CONNS] [ROUNDS]: CompletionEcho on a Reactor vs on a Proactor.
+// Same session code; only the loop type differs.
+// ---------------------------------------------------------------------------
+template <typename Loop>
+double benchmark_completion_echo(Loop& loop, int conns, int rounds) {
+    int live = conns;
+    std::vector<int> server_fds;
+    std::vector<int> client_fds = open_echo_pairs(conns, server_fds);
+    for (int fd : server_fds) start_completion_echo(&loop, fd, &live);
+    
+    double seconds = 0;
+    std::thread client = start_echo_client(client_fds, rounds, &seconds);
+    loop.run();
+    client.join();
+    
+    return (double)conns * rounds / seconds;
+}
+
+void benchmark_proactor(int conns, int rounds) {
+    std::cout << "=== Completion echo benchmark: " << conns << " connections x " << rounds
+              << " round trips of " << BENCH_ECHO_MESSAGE << " bytes, best of " << BENCH_ECHO_RUNS
+              << " ===" << std::endl;
+    
+    double reactor_rate = 0;
+    double proactor_rate = 0;
+    double enters_per_message = 0;
+    for (int run = 0; run < BENCH_ECHO_RUNS; run++) {
+        Reactor reactor;
+        reactor_rate = std::max(reactor_rate, benchmark_completion_echo(reactor, conns, rounds));
+        
+        Proactor proactor;
+        double rate = benchmark_completion_echo(proactor, conns, rounds);
+        if (rate > proactor_rate) {
+            proactor_rate = rate;
+            enters_per_message = (double)proactor.enter_calls() / ((double)conns * rounds);
+        }
+    }
+    
+    std::cout << "Reactor:   " << (uint64_t)reactor_rate << " messages/sec (epoll_wait + recv + send)" << std::endl;
+    std::cout << "Proactor:  " << (uint64_t)proactor_rate << " messages/sec (" << proactor_rate / reactor_rate
+              << "x), " << enters_per_message << " io_uring_enter calls/message" << std::endl;
+}
+#endif
+
+int main(int argc, char* argv[]) {
+    if (argc > 1 && strcmp(argv[1], "--bench-timers") == 0) {
+        benchmark_timers();
+        return 0;
+    }
+    if (argc > 1 && strcmp(argv[1], "--bench-dispatch") == 0) {
+        benchmark_dispatch();
+        return 0;
+    }
+    if (argc > 1 && strcmp(argv[1], "--bench-post") == 0) {
+        benchmark_post(argc > 2 ? std::max(1, atoi(argv[2])) : 4);
+        return 0;
+    }
+    if (argc > 1 && (strcmp(argv[1], "--co-echo") == 0 || strcmp(argv[1], "--co-http") == 0 ||
+                     strcmp(argv[1], "--bench-echo") == 0 || strcmp(argv[1], "--bench-http") == 0)) {
+#ifdef HAVE_COROUTINES
+        if (strcmp(argv[1], "--bench-echo") == 0) {
+            benchmark_echo(argc > 2 ? atoi(argv[2]) : BENCH_ECHO_CONNS, argc > 3 ? atoi(argv[3]) : BENCH_ECHO_ROUNDS);
+        } else if (strcmp(argv[1], "--bench-http") == 0) {
+            benchmark_http(argc > 2 ? atoi(argv[2]) : BENCH_HTTP_CONNS, argc > 3 ? atoi(argv[3]) : BENCH_HTTP_ROUNDS);
+        } else if (argc > 2) {
+            run_co_server(atoi(argv[2]), argc > 3 ? strtoull(argv[3], nullptr, 10) : 10000,
+                          strcmp(argv[1], "--co-http") == 0);
+        } else {
+            std::cerr << "Usage: " << argv[0] << " " << argv[1] << " PORT [IDLE_MS]" << std::endl;
+            return 1;
+        }
+        return 0;
+#else
+        std::cerr << argv[1] << ": built without coroutines (compile with -std=c++20)" << std::endl;
+        return 1;
+#endif
+    }
+    if (argc > 1 && strcmp(argv[1], "--check-close") == 0) {
+        return check_close();
+    }
+    if (argc > 1 && strcmp(argv[1], "--bench-proactor") == 0) {
+#ifdef HAVE_LIBURING
+        benchmark_proactor(argc > 2 ? atoi(argv[2]) : BENCH_ECHO_CONNS, argc > 3 ? atoi(argv[3]) : BENCH_ECHO_ROUNDS);
+        return 0;
+#else
+        std::cerr << argv[1] << ": built without liburing" << std::endl;
+        return 1;
+#endif
+    }
+    if (argc > 2 && strcmp(argv[1], "--completion-echo") == 0) {
+        if (argc > 3 && strcmp(argv[3], "proactor") == 0) {
+#ifdef HAVE_LIBURING
+            run_completion_echo<Proactor>(atoi(argv[2]), "io_uring");
+            return 0;
+#else
+            std::cerr << argv[1] << " proactor: built without liburing" << std::endl;
+            return 1;
+#endif
+        }
+        run_completion_echo<Reactor>(atoi(argv[2]), "epoll");
+        return 0;
+    }
+    if (argc > 2 && strcmp(argv[1], "--http") == 0) {
+        run_http_server(atoi(argv[2]), argc > 3 ? strtoull(argv[3], nullptr, 10) : 10000);
+        return 0;
+    }
+    if (argc > 2 && strcmp(argv[1], "--echo") == 0) {
+        run_echo_server(atoi(argv[2]), argc > 3 ? strtoull(argv[3], nullptr, 10) : 10000,
+                        argc > 4 ? atoi(argv[4]) : 0);
+        return 0;
+    }
+    
     demonstrate_reactor_pattern();
     
     std::cout << "\n=== Reactor Pattern Benefits ===" << std::endl;
@@ -139,6 +2637,7 @@ int main() {
     std::cout << "✓ Easy to add new event sources" << std::endl;
     std::cout << "✓ Flexible callback system" << std::endl;
     std::cout << "✓ Foundation for async frameworks" << std::endl;
+    std::cout << "✓ Built-in timers for idle/read/write deadlines" << std::endl;
     
     std::cout << "\n=== Real-World Examples ===" << std::endl;
     std::cout << "- Node.js event loop" << std::endl;
@@ -147,4 +2646,4 @@ int main() {
     std::cout << "- HAProxy load balancer" << std::endl;
     
     return 0;
-}
\ No newline at end of file
+}
@@ -1,89 +1,961 @@
+/*
+Goal: replace guessed req/sec figures with measurements.
+
+Reference echo servers (one per backend, each forked into its own process per run):
+- blocking: accept loop + one thread per connection (read / write_all)
+- select: FD_SETSIZE limited, blocking sockets, one read per readiness
+- poll: same as select without the fd limit
+- epoll-lt: level-triggered, one read per event
+- epoll-et: edge-triggered, non-blocking, read until EAGAIN, pending output + EPOLLOUT
+- io_uring: multishot accept, one recv per connection, send with MSG_WAITALL, batched submit_and_wait
+- external: any server already listening (--connect PORT [--pid PID]), e.g. 27-high-performance-server
+
+Load generator:
+- M client threads, each with its own epoll loop and a slice of the connections
+- every connection keeps `depth` messages of `payload` bytes in flight (pipelining)
+- latency = time from queueing a message to receiving its last echoed byte
+- log-linear histogram (64 sub-buckets per power of two, ~1.5% error) per thread, merged at the end
+- warmup, then a measured window: req/s, server CPU per request (utime+stime from /proc/<pid>/stat), p50/p99/p99.9
+- output: table, CSV or JSON
+*/
+
 // io_benchmark.cpp
 #include <iostream>
 #include <chrono>
 #include <sys/socket.h>
+#include <sys/resource.h>
+#include <sys/select.h>
+#include <sys/wait.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
 #include <unistd.h>
 #include <sys/epoll.h>
+#include <poll.h>
 #include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <atomic>
+#include <string>
 #include <vector>
 #include <thread>
 
-void benchmark_summary() {
-    std::cout << "=== I/O Multiplexing Performance Summary ===" << std::endl;
-    std::cout << "\nTypical Performance (connections/second):" << std::endl;
-    std::cout << "\nBlocking (one thread per connection):" << std::endl;
-    std::cout << "  Max connections: ~1000 (memory limited)" << std::endl;
-    std::cout << "  Throughput: ~10,000 req/sec" << std::endl;
-    
-    std::cout << "\nselect():" << std::endl;
-    std::cout << "  Max connections: 1024 (FD_SETSIZE)" << std::endl;
-    std::cout << "  Throughput: ~50,000 req/sec" << std::endl;
-    std::cout << "  CPU usage: High (O(n) scanning)" << std::endl;
-    
-    std::cout << "\npoll():" << std::endl;
-    std::cout << "  Max connections: Unlimited" << std::endl;
-    std::cout << "  Throughput: ~50,000 req/sec" << std::endl;
-    std::cout << "  CPU usage: High (O(n) scanning)" << std::endl;
-    
-    std::cout << "\nepoll() (level-triggered):" << std::endl;
-    std::cout << "  Max connections: Millions" << std::endl;
-    std::cout << "  Throughput: ~500,000 req/sec" << std::endl;
-    std::cout << "  CPU usage: Low (O(1))" << std::endl;
-    
-    std::cout << "\nepoll() (edge-triggered):" << std::endl;
-    std::cout << "  Max connections: Millions" << std::endl;
-    std::cout << "  Throughput: ~700,000 req/sec" << std::endl;
-    std::cout << "  CPU usage: Very low" << std::endl;
-    
-    std::cout << "\nio_uring:" << std::endl;
-    std::cout << "  Max connections: Millions" << std::endl;
-    std::cout << "  Throughput: ~1,000,000+ req/sec" << std::endl;
-    std::cout << "  CPU usage: Lowest (batch operations)" << std::endl;
-    
-    std::cout << "\n=== Real-World Examples ===" << std::endl;
-    std::cout << "\nNginx (epoll):" << std::endl;
-    std::cout << "  - Handles 100,000+ concurrent connections" << std::endl;
-    std::cout << "  - ~1M requests/sec per core" << std::endl;
-    
-    std::cout << "\nRedis (epoll):" << std::endl;
-    std::cout << "  - 100,000+ operations/sec" << std::endl;
-    std::cout << "  - Single-threaded event loop" << std::endl;
-    
-    std::cout << "\nNode.js (epoll on Linux):" << std::endl;
-    std::cout << "  - Thousands of concurrent connections" << std::endl;
-    std::cout << "  - Event-driven, non-blocking I/O" << std::endl;
-}
-
-int main() {
-    benchmark_summary();
-    
-    std::cout << "\n=== Choosing the Right Approach ===" << std::endl;
-    std::cout << "\nUse blocking I/O when:" << std::endl;
-    std::cout << "  - Few connections (<100)" << std::endl;
-    std::cout << "  - Simplicity is priority" << std::endl;
-    std::cout << "  - Learning/prototyping" << std::endl;
-    
-    std::cout << "\nUse select() when:" << std::endl;
-    std::cout << "  - Portability required (POSIX)" << std::endl;
-    std::cout << "  - Few connections (<100)" << std::endl;
-    std::cout << "  - Timeout support needed" << std::endl;
-    
-    std::cout << "\nUse poll() when:" << std::endl;
-    std::cout << "  - More than 1024 connections" << std::endl;
-    std::cout << "  - Portability required" << std::endl;
-    std::cout << "  - Cleaner API than select()" << std::endl;
-    
-    std::cout << "\nUse epoll() when:" << std::endl;
-    std::cout << "  - High performance needed" << std::endl;
-    std::cout << "  - Many connections (1000+)" << std::endl;
-    std::cout << "  - Linux-only is acceptable" << std::endl;
-    
-    std::cout << "\nUse io_uring when:" << std::endl;
-    std::cout << "  - Maximum performance needed" << std::endl;
-    std::cout << "  - Modern kernel (5.1+)" << std::endl;
-    std::cout << "  - Complex I/O patterns" << std::endl;
-    std::cout << "  - Zero-copy desired" << std::endl;
-    
+#if __has_include(<liburing.h>)
+#include <liburing.h>
+#define HAVE_LIBURING 1
+#endif
+
+#define MAX_EVENTS 1024
+#define SERVER_BUFFER 65536
+#define CLIENT_BUFFER 65536
+#define BLOCKING_MAX_CONNS 2000       // Threads, not connections, are the limit here
+#define SELECT_MAX_CONNS (FD_SETSIZE - 16)
+#define CONNS_PER_SOURCE_IP 20000     // Stay inside one ephemeral port range per 127.0.0.x
+#define MAX_FDS 262144                // Cap on the raised RLIMIT_NOFILE: per-fd tables are sized from it
+
+#define HIST_SUB_BITS 6
+#define HIST_SUB_COUNT (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS ((64 - HIST_SUB_BITS + 1) * HIST_SUB_COUNT)
+
+// ---------------------------------------------------------------------------
+// Latency histogram
+// ---------------------------------------------------------------------------
+
+struct Histogram {
+    uint64_t counts[HIST_BUCKETS] = {};
+    uint64_t total = 0;
+};
+
+static inline int hist_index(uint64_t value) {
+    if (value < HIST_SUB_COUNT) return (int)value;
+
+    int msb = 63 - __builtin_clzll(value);
+    int shift = msb - HIST_SUB_BITS;
+    return (shift + 1) * HIST_SUB_COUNT + (int)((value >> shift) - HIST_SUB_COUNT);
+}
+
+// Midpoint of the bucket
+static inline uint64_t hist_value(int index) {
+    if (index < HIST_SUB_COUNT) return index;
+
+    int shift = index / HIST_SUB_COUNT - 1;
+    uint64_t sub = index % HIST_SUB_COUNT + HIST_SUB_COUNT;
+    return (sub << shift) + ((1ULL << shift) >> 1);
+}
+
+void hist_record(Histogram* hist, uint64_t value) {
+    hist->counts[hist_index(value)]++;
+    hist->total++;
+}
+
+void hist_merge(Histogram* into, const Histogram* from) {
+    for (int i = 0; i < HIST_BUCKETS; i++) into->counts[i] += from->counts[i];
+    into->total += from->total;
+}
+
+uint64_t hist_percentile(const Histogram* hist, double percentile) {
+    if (hist->total == 0) return 0;
+
+    uint64_t rank = (uint64_t)(percentile / 100.0 * hist->total);
+    if (rank >= hist->total) rank = hist->total - 1;
+
+    uint64_t seen = 0;
+    for (int i = 0; i < HIST_BUCKETS; i++) {
+        seen += hist->counts[i];
+        if (seen > rank) return hist_value(i);
+    }
+    return hist_value(HIST_BUCKETS - 1);
+}
+
+// ---------------------------------------------------------------------------
+// Helpers
+// ---------------------------------------------------------------------------
+
+static inline uint64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void set_nonblocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+bool write_all(int fd, const char* data, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, data, len);
+        if (n == -1) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+// Soft limit set to the hard one capped at MAX_FDS: rlim_max can be RLIM_INFINITY or
+// in the millions, and the servers index one slot per fd, so no fd may reach past it
+size_t raise_fd_limit() {
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) != 0) return 1024;
+    rl.rlim_cur = rl.rlim_max < MAX_FDS ? rl.rlim_max : MAX_FDS;
+    setrlimit(RLIMIT_NOFILE, &rl);
+    getrlimit(RLIMIT_NOFILE, &rl);
+    return rl.rlim_cur < MAX_FDS ? rl.rlim_cur : MAX_FDS;
+}
+
+// Server CPU time (user + system) in microseconds, -1 if unknown
+double process_cpu_us(pid_t pid) {
+    if (pid <= 0) return -1;
+
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+    FILE* f = fopen(path, "r");
+    if (!f) return -1;
+
+    char buf[1024];
+    size_t len = fread(buf, 1, sizeof(buf) - 1, f);
+    fclose(f);
+    buf[len] = '\0';
+
+    // Fields after the "(comm)" which may itself contain spaces
+    char* p = strrchr(buf, ')');
+    if (!p) return -1;
+
+    unsigned long utime = 0;
+    unsigned long stime = 0;
+    if (sscanf(p + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu", &utime, &stime) != 2) {
+        return -1;
+    }
+    return (utime + stime) * 1e6 / sysconf(_SC_CLK_TCK);
+}
+
+// ---------------------------------------------------------------------------
+// Reference servers: each runs forever in a forked child on an inherited listener
+// ---------------------------------------------------------------------------
+
+void* blocking_connection_thread(void* arg) {
+    int fd = (int)(intptr_t)arg;
+    char buffer[SERVER_BUFFER];
+
+    while (true) {
+        ssize_t n = read(fd, buffer, sizeof(buffer));
+        if (n <= 0 || !write_all(fd, buffer, n)) break;
+    }
+
+    close(fd);
+    return nullptr;
+}
+
+void run_blocking_server(int server_fd) {
+    while (true) {
+        int client_fd = accept(server_fd, nullptr, nullptr);
+        if (client_fd == -1) continue;
+
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        pthread_attr_setstacksize(&attr, 256 * 1024);
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+        pthread_t thread;
+        pthread_create(&thread, &attr, blocking_connection_thread, (void*)(intptr_t)client_fd);
+        pthread_attr_destroy(&attr);
+    }
+}
+
+void run_select_server(int server_fd) {
+    fd_set master_set;
+    FD_ZERO(&master_set);
+    FD_SET(server_fd, &master_set);
+    int max_fd = server_fd;
+    char buffer[SERVER_BUFFER];
+
+    while (true) {
+        fd_set read_fds = master_set;
+        if (select(max_fd + 1, &read_fds, nullptr, nullptr, nullptr) < 0) continue;
+
+        for (int fd = 0; fd <= max_fd; fd++) {
+            if (!FD_ISSET(fd, &read_fds)) continue;
+
+            if (fd == server_fd) {
+                int client_fd = accept(server_fd, nullptr, nullptr);
+                if (client_fd == -1) continue;
+                if (client_fd >= FD_SETSIZE) {
+                    close(client_fd);
+                    continue;
+                }
+                FD_SET(client_fd, &master_set);
+                if (client_fd > max_fd) max_fd = client_fd;
+            } else {
+                ssize_t n = read(fd, buffer, sizeof(buffer));
+                if (n <= 0 || !write_all(fd, buffer, n)) {
+                    close(fd);
+                    FD_CLR(fd, &master_set);
+                }
+            }
+        }
+    }
+}
+
+void run_poll_server(int server_fd) {
+    std::vector<struct pollfd> poll_fds;
+    poll_fds.push_back({server_fd, POLLIN, 0});
+    char buffer[SERVER_BUFFER];
+
+    while (true) {
+        if (poll(poll_fds.data(), poll_fds.size(), -1) < 0) continue;
+
+        size_t count = poll_fds.size();
+        for (size_t i = 0; i < count; i++) {
+            if (!poll_fds[i].revents) continue;
+
+            if (poll_fds[i].fd == server_fd) {
+                int client_fd = accept(server_fd, nullptr, nullptr);
+                if (client_fd != -1) poll_fds.push_back({client_fd, POLLIN, 0});
+            } else {
+                ssize_t n = read(poll_fds[i].fd, buffer, sizeof(buffer));
+                if (n <= 0 || !write_all(poll_fds[i].fd, buffer, n)) {
+                    close(poll_fds[i].fd);
+                    poll_fds[i].fd = -1;  // poll() ignores negative fds, compacted below
+                }
+            }
+        }
+
+        size_t live = 0;
+        for (size_t i = 0; i < poll_fds.size(); i++) {
+            if (poll_fds[i].fd != -1) poll_fds[live++] = poll_fds[i];
+        }
+        poll_fds.resize(live);
+    }
+}
+
+void run_epoll_lt_server(int server_fd) {
+    int epoll_fd = epoll_create1(0);
+
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.fd = server_fd;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, server_fd, &ev);
+
+    struct epoll_event events[MAX_EVENTS];
+    char buffer[SERVER_BUFFER];
+
+    while (true) {
+        int nfds = epoll_wait(epoll_fd, events, MAX_EVENTS, -1);
+
+        for (int i = 0; i < nfds; i++) {
+            int fd = events[i].data.fd;
+
+            if (fd == server_fd) {
+                int client_fd = accept(server_fd, nullptr, nullptr);
+                if (client_fd == -1) continue;
+                ev.events = EPOLLIN;
+                ev.data.fd = client_fd;
+                epoll_ctl(epoll_fd, EPOLL_CTL_ADD, client_fd, &ev);
+            } else {
+                // Level-triggered: one read, epoll reports the fd again if more is left
+                ssize_t n = read(fd, buffer, sizeof(buffer));
+                if (n <= 0 || !write_all(fd, buffer, n)) {
+                    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+                    close(fd);
+                }
+            }
+        }
+    }
+}
+
+void run_epoll_et_server(int server_fd) {
+    set_nonblocking(server_fd);
+    int epoll_fd = epoll_create1(0);
+
+    struct epoll_event ev;
+    ev.events = EPOLLIN | EPOLLET;
+    ev.data.fd = server_fd;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, server_fd, &ev);
+
+    // Unsent echo bytes per fd
+    std::vector<std::string> pending(raise_fd_limit());
+    struct epoll_event events[MAX_EVENTS];
+    char buffer[SERVER_BUFFER];
+
+    while (true) {
+        int nfds = epoll_wait(epoll_fd, events, MAX_EVENTS, -1);
+
+        for (int i = 0; i < nfds; i++) {
+            int fd = events[i].data.fd;
+
+            if (fd == server_fd) {
+                while (true) {
+                    int client_fd = accept(server_fd, nullptr, nullptr);
+                    if (client_fd == -1) break;
+                    set_nonblocking(client_fd);
+                    ev.events = EPOLLIN | EPOLLOUT | EPOLLET;
+                    ev.data.fd = client_fd;
+                    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, client_fd, &ev);
+                }
+                continue;
+            }
+
+            bool closed = false;
+            while (true) {
+                ssize_t n = read(fd, buffer, sizeof(buffer));
+                if (n > 0) {
+                    pending[fd].append(buffer, n);
+                    continue;
+                }
+                if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) closed = true;
+                break;
+            }
+
+            // EPOLLOUT stays registered: with edge triggering it only fires on a new edge
+            size_t offset = 0;
+            while (!closed && offset < pending[fd].size()) {
+                ssize_t n = write(fd, pending[fd].data() + offset, pending[fd].size() - offset);
+                if (n == -1) {
+                    if (errno != EAGAIN && errno != EWOULDBLOCK) closed = true;
+                    break;
+                }
+                offset += n;
+            }
+            pending[fd].erase(0, offset);
+
+            if (closed) {
+                pending[fd].clear();
+                close(fd);
+            }
+        }
+    }
+}
+
+#ifdef HAVE_LIBURING
+enum UringOp : uint64_t { OP_ACCEPT = 1, OP_RECV, OP_SEND, OP_CLOSE };
+
+// More completions than SQ entries in one batch: flush and retry
+struct io_uring_sqe* uring_sqe(struct io_uring* ring) {
+    struct io_uring_sqe* sqe = io_uring_get_sqe(ring);
+    while (!sqe) {
+        io_uring_submit(ring);
+        sqe = io_uring_get_sqe(ring);
+    }
+    return sqe;
+}
+
+void uring_recv(struct io_uring* ring, int fd, std::vector<char>& buffer) {
+    struct io_uring_sqe* sqe = uring_sqe(ring);
+    io_uring_prep_recv(sqe, fd, buffer.data(), buffer.size(), 0);
+    io_uring_sqe_set_data64(sqe, OP_RECV << 32 | (uint32_t)fd);
+}
+
+void run_uring_server(int server_fd) {
+    struct io_uring ring;
+    if (io_uring_queue_init(4096, &ring, 0) < 0) {
+        std::cerr << "io_uring_queue_init failed" << std::endl;
+        exit(1);
+    }
+
+    std::vector<std::vector<char>> buffers(raise_fd_limit());
+
+    struct io_uring_sqe* sqe = uring_sqe(&ring);
+    io_uring_prep_multishot_accept(sqe, server_fd, nullptr, nullptr, 0);
+    io_uring_sqe_set_data64(sqe, OP_ACCEPT << 32);
+
+    while (true) {
+        io_uring_submit_and_wait(&ring, 1);
+
+        unsigned head;
+        unsigned count = 0;
+        struct io_uring_cqe* cqe;
+
+        io_uring_for_each_cqe(&ring, head, cqe) {
+            count++;
+            uint64_t op = cqe->user_data >> 32;
+            int fd = (int)(uint32_t)cqe->user_data;
+
+            if (op == OP_ACCEPT) {
+                if (!(cqe->flags & IORING_CQE_F_MORE)) {
+                    sqe = uring_sqe(&ring);
+                    io_uring_prep_multishot_accept(sqe, server_fd, nullptr, nullptr, 0);
+                    io_uring_sqe_set_data64(sqe, OP_ACCEPT << 32);
+                }
+                if (cqe->res < 0) continue;
+                buffers[cqe->res].resize(SERVER_BUFFER);
+                uring_recv(&ring, cqe->res, buffers[cqe->res]);
+            } else if (op == OP_RECV) {
+                if (cqe->res <= 0) {
+                    sqe = uring_sqe(&ring);
+                    io_uring_prep_close(sqe, fd);
+                    io_uring_sqe_set_data64(sqe, OP_CLOSE << 32);
+                    continue;
+                }
+                // Echo the whole read, then read again once it is out
+                sqe = uring_sqe(&ring);
+                io_uring_prep_send(sqe, fd, buffers[fd].data(), cqe->res, MSG_WAITALL | MSG_NOSIGNAL);
+                io_uring_sqe_set_data64(sqe, OP_SEND << 32 | (uint32_t)fd);
+            } else if (op == OP_SEND) {
+                if (cqe->res < 0) {
+                    sqe = uring_sqe(&ring);
+                    io_uring_prep_close(sqe, fd);
+                    io_uring_sqe_set_data64(sqe, OP_CLOSE << 32);
+                    continue;
+                }
+                uring_recv(&ring, fd, buffers[fd]);
+            }
+        }
+        io_uring_cq_advance(&ring, count);
+    }
+}
+#endif
+
+struct Backend {
+    const char* name;
+    void (*run)(int server_fd);
+    int max_conns;  // 0 = only limited by fds
+};
+
+Backend backends[] = {
+    {"blocking", run_blocking_server, BLOCKING_MAX_CONNS},
+    {"select", run_select_server, SELECT_MAX_CONNS},
+    {"poll", run_poll_server, 0},
+    {"epoll-lt", run_epoll_lt_server, 0},
+    {"epoll-et", run_epoll_et_server, 0},
+#ifdef HAVE_LIBURING
+    {"io_uring", run_uring_server, 0},
+#endif
+};
+
+// Fork the backend on a fresh loopback listener, returns its pid and port
+pid_t start_server(const Backend& backend, int* port) {
+    int server_fd = socket(AF_INET, SOCK_STREAM, 0);
+
+    int opt = 1;
+    setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = 0;
+
+    if (bind(server_fd, (struct sockaddr*)&addr, sizeof(addr)) == -1) {
+        perror("bind");
+        exit(1);
+    }
+    listen(server_fd, SOMAXCONN);
+
+    socklen_t len = sizeof(addr);
+    getsockname(server_fd, (struct sockaddr*)&addr, &len);
+    *port = ntohs(addr.sin_port);
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        signal(SIGPIPE, SIG_IGN);
+        backend.run(server_fd);
+        _exit(0);
+    }
+
+    close(server_fd);
+    return pid;
+}
+
+// ---------------------------------------------------------------------------
+// Load generator
+// ---------------------------------------------------------------------------
+
+struct RunConfig {
+    int port;
+    int conns;
+    size_t payload;
+    int depth;
+    int threads;
+    double warmup;
+    double duration;
+};
+
+struct ClientConn {
+    int fd;
+    size_t unsent;    // Queued bytes send() hasn't taken yet
+    size_t received;  // Bytes of the oldest in-flight message received so far
+    bool want_out;
+
+    // Queue times of in-flight messages, oldest first (ring of `depth`)
+    std::vector<uint64_t> stamps;
+    int stamp_head;
+    int stamp_count;
+};
+
+enum Phase { WARMUP, MEASURE, STOP };
+
+struct ClientThread {
+    pthread_t thread;
+    const RunConfig* config;
+    std::atomic<int>* phase;
+    std::vector<ClientConn> conns;
+
+    Histogram hist;
+    uint64_t completed = 0;
+    uint64_t errors = 0;
+};
+
+int connect_loopback(int port, int index) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd == -1) return -1;
+
+    // Beyond one ephemeral port range, spread over 127.0.0.2, 127.0.0.3, ...
+    int no_port = 1;
+    setsockopt(fd, IPPROTO_IP, IP_BIND_ADDRESS_NO_PORT, &no_port, sizeof(no_port));
+
+    struct sockaddr_in src;
+    memset(&src, 0, sizeof(src));
+    src.sin_family = AF_INET;
+    src.sin_addr.s_addr = htonl(INADDR_LOOPBACK + 1 + index / CONNS_PER_SOURCE_IP);
+    bind(fd, (struct sockaddr*)&src, sizeof(src));
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) == -1) {
+        close(fd);
+        return -1;
+    }
+
+    int nodelay = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+    set_nonblocking(fd);
+    return fd;
+}
+
+void queue_message(ClientConn* conn, size_t payload, int depth) {
+    conn->stamps[(conn->stamp_head + conn->stamp_count) % depth] = now_ns();
+    conn->stamp_count++;
+    conn->unsent += payload;
+}
+
+// Push queued bytes; the content doesn't matter, only the byte count
+bool flush_conn(ClientConn* conn, const char* zeros) {
+    while (conn->unsent > 0) {
+        size_t chunk = conn->unsent < CLIENT_BUFFER ? conn->unsent : CLIENT_BUFFER;
+        ssize_t n = send(conn->fd, zeros, chunk, MSG_NOSIGNAL);
+        if (n == -1) {
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+        conn->unsent -= n;
+    }
+    return true;
+}
+
+void* client_thread(void* arg) {
+    ClientThread* self = (ClientThread*)arg;
+    const RunConfig* config = self->config;
+
+    int epoll_fd = epoll_create1(0);
+    static char zeros[CLIENT_BUFFER];
+    std::vector<char> scratch(CLIENT_BUFFER);
+
+    for (size_t i = 0; i < self->conns.size(); i++) {
+        ClientConn* conn = &self->conns[i];
+        for (int d = 0; d < config->depth; d++) queue_message(conn, config->payload, config->depth);
+        flush_conn(conn, zeros);
+
+        conn->want_out = conn->unsent > 0;
+        struct epoll_event ev;
+        ev.events = EPOLLIN | (conn->want_out ? (uint32_t)EPOLLOUT : 0u);
+        ev.data.u32 = i;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, conn->fd, &ev);
+    }
+
+    struct epoll_event events[MAX_EVENTS];
+
+    while (self->phase->load(std::memory_order_relaxed) != STOP) {
+        int nfds = epoll_wait(epoll_fd, events, MAX_EVENTS, 20);
+        bool measuring = self->phase->load(std::memory_order_relaxed) == MEASURE;
+
+        for (int e = 0; e < nfds; e++) {
+            ClientConn* conn = &self->conns[events[e].data.u32];
+            if (conn->fd == -1) continue;
+            bool failed = events[e].events & (EPOLLERR | EPOLLHUP);
+
+            while (!failed) {
+                ssize_t n = recv(conn->fd, scratch.data(), scratch.size(), 0);
+                if (n == -1) {
+                    if (errno != EAGAIN && errno != EWOULDBLOCK) failed = true;
+                    break;
+                }
+                if (n == 0) {
+                    failed = true;
+                    break;
+                }
+
+                conn->received += n;
+                uint64_t now = now_ns();
+
+                // Every full payload retires the oldest in-flight message
+                while (conn->received >= config->payload && conn->stamp_count > 0) {
+                    conn->received -= config->payload;
+
+                    if (measuring) {
+                        hist_record(&self->hist, now - conn->stamps[conn->stamp_head]);
+                        self->completed++;
+                    }
+                    conn->stamp_head = (conn->stamp_head + 1) % config->depth;
+                    conn->stamp_count--;
+
+                    queue_message(conn, config->payload, config->depth);
+                }
+            }
+
+            if (!failed && !flush_conn(conn, zeros)) failed = true;
+
+            if (failed) {
+                self->errors++;
+                epoll_ctl(epoll_fd, EPOLL_CTL_DEL, conn->fd, nullptr);
+                close(conn->fd);
+                conn->fd = -1;
+                continue;
+            }
+
+            bool want_out = conn->unsent > 0;
+            if (want_out != conn->want_out) {
+                conn->want_out = want_out;
+                struct epoll_event ev;
+                ev.events = EPOLLIN | (want_out ? (uint32_t)EPOLLOUT : 0u);
+                ev.data.u32 = events[e].data.u32;
+                epoll_ctl(epoll_fd, EPOLL_CTL_MOD, conn->fd, &ev);
+            }
+        }
+    }
+
+    for (ClientConn& conn : self->conns) {
+        if (conn.fd != -1) close(conn.fd);
+    }
+    close(epoll_fd);
+    return nullptr;
+}
+
+struct RunResult {
+    bool ok;
+    std::string note;
+    int connected;
+    double req_per_sec;
+    double cpu_us_per_req;  // Server side, -1 if unknown
+    uint64_t p50_ns;
+    uint64_t p99_ns;
+    uint64_t p999_ns;
+    uint64_t errors;
+};
+
+RunResult run_load(const RunConfig& config, pid_t server_pid) {
+    RunResult result = {};
+    std::atomic<int> phase(WARMUP);
+
+    std::vector<ClientThread*> threads;
+    for (int t = 0; t < config.threads; t++) {
+        ClientThread* thread = new ClientThread;
+        thread->config = &config;
+        thread->phase = &phase;
+        threads.push_back(thread);
+    }
+
+    // Connect sequentially (a burst of non-blocking connects overflows the accept backlog)
+    for (int i = 0; i < config.conns; i++) {
+        int fd = connect_loopback(config.port, i);
+        if (fd == -1) break;
+
+        ClientConn conn;
+        conn.fd = fd;
+        conn.unsent = 0;
+        conn.received = 0;
+        conn.want_out = false;
+        conn.stamps.resize(config.depth);
+        conn.stamp_head = 0;
+        conn.stamp_count = 0;
+        threads[i % config.threads]->conns.push_back(conn);
+        result.connected++;
+    }
+
+    if (result.connected < config.conns) {
+        result.note = "connected " + std::to_string(result.connected) + "/" + std::to_string(config.conns);
+    }
+
+    for (ClientThread* thread : threads) {
+        pthread_create(&thread->thread, nullptr, client_thread, thread);
+    }
+
+    usleep((useconds_t)(config.warmup * 1e6));
+
+    double cpu_start = process_cpu_us(server_pid);
+    uint64_t start = now_ns();
+    phase.store(MEASURE);
+
+    usleep((useconds_t)(config.duration * 1e6));
+
+    phase.store(STOP);
+    double seconds = (now_ns() - start) / 1e9;
+    double cpu_end = process_cpu_us(server_pid);
+
+    Histogram total;
+    uint64_t completed = 0;
+    for (ClientThread* thread : threads) {
+        pthread_join(thread->thread, nullptr);
+        hist_merge(&total, &thread->hist);
+        completed += thread->completed;
+        result.errors += thread->errors;
+        delete thread;
+    }
+
+    result.ok = completed > 0;
+    if (!result.ok && result.note.empty()) result.note = "no completed requests";
+    result.req_per_sec = completed / seconds;
+    result.cpu_us_per_req = (cpu_start >= 0 && cpu_end >= 0 && completed > 0)
+                                ? (cpu_end - cpu_start) / completed : -1;
+    result.p50_ns = hist_percentile(&total, 50.0);
+    result.p99_ns = hist_percentile(&total, 99.0);
+    result.p999_ns = hist_percentile(&total, 99.9);
+    return result;
+}
+
+// ---------------------------------------------------------------------------
+// Command line + output
+// ---------------------------------------------------------------------------
+
+enum Format { TABLE, CSV, JSON };
+
+struct Options {
+    std::vector<std::string> backends;
+    std::vector<int> conns = {10, 100, 1000, 10000, 50000};
+    std::vector<size_t> payloads = {64};
+    std::vector<int> depths = {1};
+    int threads = 0;
+    double warmup = 0.5;
+    double duration = 2.0;
+    Format format = TABLE;
+    int external_port = 0;
+    pid_t external_pid = 0;
+};
+
+std::vector<std::string> split(const char* list) {
+    std::vector<std::string> items;
+    std::string current;
+    for (const char* p = list; ; p++) {
+        if (*p == ',' || *p == '\0') {
+            if (!current.empty()) items.push_back(current);
+            current.clear();
+            if (*p == '\0') break;
+        } else {
+            current += *p;
+        }
+    }
+    return items;
+}
+
+void usage(const char* prog) {
+    std::cerr << "Usage: " << prog << " [options]\n"
+              << "  --backends LIST   blocking,select,poll,epoll-lt,epoll-et,io_uring (default: all)\n"
+              << "  --conns LIST      connection counts (default 10,100,1000,10000,50000)\n"
+              << "  --payloads LIST   message sizes in bytes (default 64)\n"
+              << "  --depths LIST     messages in flight per connection (default 1)\n"
+              << "  --threads N       client threads (default: cpus, max 8)\n"
+              << "  --warmup S        seconds before measuring (default 0.5)\n"
+              << "  --duration S      measured seconds per run (default 2)\n"
+              << "  --format F        table | csv | json (default table)\n"
+              << "  --connect PORT    drive an already running server on 127.0.0.1:PORT\n"
+              << "  --pid PID         its pid, for CPU per request" << std::endl;
+    exit(1);
+}
+
+Options parse_args(int argc, char* argv[]) {
+    Options options;
+
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+        if (!value) usage(argv[0]);
+        i++;
+
+        if (strcmp(arg, "--backends") == 0) {
+            options.backends = split(value);
+        } else if (strcmp(arg, "--conns") == 0) {
+            options.conns.clear();
+            for (const std::string& s : split(value)) options.conns.push_back(atoi(s.c_str()));
+        } else if (strcmp(arg, "--payloads") == 0) {
+            options.payloads.clear();
+            for (const std::string& s : split(value)) options.payloads.push_back(strtoul(s.c_str(), nullptr, 10));
+        } else if (strcmp(arg, "--depths") == 0) {
+            options.depths.clear();
+            for (const std::string& s : split(value)) options.depths.push_back(atoi(s.c_str()));
+        } else if (strcmp(arg, "--threads") == 0) {
+            options.threads = atoi(value);
+        } else if (strcmp(arg, "--warmup") == 0) {
+            options.warmup = atof(value);
+        } else if (strcmp(arg, "--duration") == 0) {
+            options.duration = atof(value);
+        } else if (strcmp(arg, "--format") == 0) {
+            if (strcmp(value, "csv") == 0) options.format = CSV;
+            else if (strcmp(value, "json") == 0) options.format = JSON;
+            else options.format = TABLE;
+        } else if (strcmp(arg, "--connect") == 0) {
+            options.external_port = atoi(value);
+        } else if (strcmp(arg, "--pid") == 0) {
+            options.external_pid = atoi(value);
+        } else {
+            usage(argv[0]);
+        }
+    }
+
+    if (options.threads <= 0) {
+        options.threads = std::thread::hardware_concurrency();
+        if (options.threads > 8) options.threads = 8;
+        if (options.threads < 1) options.threads = 1;
+    }
+    return options;
+}
+
+void print_header(Format format) {
+    if (format == CSV) {
+        printf("backend,conns,payload,depth,req_per_sec,cpu_us_per_req,p50_us,p99_us,p999_us,errors,note\n");
+    } else if (format == JSON) {
+        printf("[\n");
+    } else {
+        printf("%-9s %7s %8s %5s %12s %10s %10s %10s %10s  %s\n", "backend", "conns", "payload",
+               "depth", "req/s", "cpu us/req", "p50 us", "p99 us", "p99.9 us", "note");
+    }
+    fflush(stdout);
+}
+
+void print_result(Format format, bool first, const std::string& backend, const RunConfig& config,
+                  const RunResult& r) {
+    if (format == CSV) {
+        printf("%s,%d,%zu,%d,%.0f,%.3f,%.1f,%.1f,%.1f,%lu,%s\n", backend.c_str(), config.conns,
+               config.payload, config.depth, r.req_per_sec, r.cpu_us_per_req, r.p50_ns / 1e3,
+               r.p99_ns / 1e3, r.p999_ns / 1e3, (unsigned long)r.errors, r.note.c_str());
+    } else if (format == JSON) {
+        printf("%s  {\"backend\": \"%s\", \"conns\": %d, \"payload\": %zu, \"depth\": %d, "
+               "\"ok\": %s, \"req_per_sec\": %.0f, \"cpu_us_per_req\": %.3f, "
+               "\"p50_us\": %.1f, \"p99_us\": %.1f, \"p999_us\": %.1f, \"errors\": %lu, \"note\": \"%s\"}",
+               first ? "" : ",\n", backend.c_str(), config.conns, config.payload, config.depth,
+               r.ok ? "true" : "false", r.req_per_sec, r.cpu_us_per_req, r.p50_ns / 1e3,
+               r.p99_ns / 1e3, r.p999_ns / 1e3, (unsigned long)r.errors, r.note.c_str());
+    } else if (!r.ok) {
+        printf("%-9s %7d %8zu %5d %12s %10s %10s %10s %10s  %s\n", backend.c_str(), config.conns,
+               config.payload, config.depth, "-", "-", "-", "-", "-", r.note.c_str());
+    } else {
+        printf("%-9s %7d %8zu %5d %12.0f %10.2f %10.1f %10.1f %10.1f  %s\n", backend.c_str(),
+               config.conns, config.payload, config.depth, r.req_per_sec, r.cpu_us_per_req,
+               r.p50_ns / 1e3, r.p99_ns / 1e3, r.p999_ns / 1e3, r.note.c_str());
+    }
+    fflush(stdout);
+}
+
+int main(int argc, char* argv[]) {
+    Options options = parse_args(argc, argv);
+    signal(SIGPIPE, SIG_IGN);
+
+    // Client and (forked) server each get the full fd budget
+    size_t fd_limit = raise_fd_limit();
+
+    std::vector<const Backend*> selected;
+    if (options.external_port == 0) {
+        for (const Backend& backend : backends) {
+            bool wanted = options.backends.empty();
+            for (const std::string& name : options.backends) {
+                if (name == backend.name) wanted = true;
+            }
+            if (wanted) selected.push_back(&backend);
+        }
+        if (selected.empty()) {
+            std::cerr << "No matching backends" << std::endl;
+            return 1;
+        }
+    }
+
+    print_header(options.format);
+    bool first = true;
+    size_t targets = options.external_port ? 1 : selected.size();
+
+    for (size_t b = 0; b < targets; b++) {
+        std::string name = options.external_port ? "external" : selected[b]->name;
+
+        for (int conns : options.conns) {
+            for (size_t payload : options.payloads) {
+                for (int depth : options.depths) {
+                    RunConfig config;
+                    config.conns = conns;
+                    config.payload = payload;
+                    config.depth = depth < 1 ? 1 : depth;
+                    config.threads = options.threads;
+                    config.warmup = options.warmup;
+                    config.duration = options.duration;
+
+                    RunResult result = {};
+
+                    if (!options.external_port && selected[b]->max_conns && conns > selected[b]->max_conns) {
+                        result.note = "skipped: backend limit " + std::to_string(selected[b]->max_conns);
+                    } else if ((size_t)conns + 64 > fd_limit) {
+                        result.note = "skipped: RLIMIT_NOFILE " + std::to_string(fd_limit);
+                    } else if (options.external_port) {
+                        config.port = options.external_port;
+                        result = run_load(config, options.external_pid);
+                    } else {
+                        pid_t pid = start_server(*selected[b], &config.port);
+                        result = run_load(config, pid);
+                        kill(pid, SIGKILL);
+                        waitpid(pid, nullptr, 0);
+                    }
+
+                    print_result(options.format, first, name, config, result);
+                    first = false;
+                }
+            }
+        }
+    }
+
+    if (options.format == JSON) printf("\n]\n");
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,815 @@
+/*
+Goal: drive http_server at a fixed request rate and report latency the way a user sees it.
+
+Why a fixed rate: a closed-loop client (send, wait, send) slows down whenever the server does,
+so a 200 ms stall shows up as one slow request instead of the hundreds that should have been
+sent meanwhile ("coordinated omission"). Here every request has an intended send time from the
+schedule, and its latency is measured from that time, not from when it finally went out.
+
+Load generator:
+- N keep-alive connections over M threads, each thread with its own epoll loop
+- rate R req/s in total: every connection sends one request every conns / R seconds,
+  connections phase-shifted so the aggregate is evenly spaced
+- up to `depth` requests in flight per connection (pipelining); a request that is due while
+  the window is full waits, and its latency still counts from its intended time
+- sockets set TCP_NODELAY, and depth > 1 needs the server to do the same (or write pipelined
+  responses in one batch): with Nagle on the server side, every response after the first waits
+  for the client's delayed ACK (~40 ms), each connection stays one response behind, and the
+  corrected p50 comes out as the per-connection send interval (conns / R), not as latency
+- the loop sleeps on a timerfd armed for the next intended send (ns resolution, not epoll_wait's ms),
+  so the generator's own lateness stays out of the numbers
+- corrected latency = response complete - intended send time
+- uncorrected latency = response complete - actual send time (what a closed-loop tool reports)
+- responses framed by Content-Length, status != 2xx counted
+- "Connection: close" or EOF from the server: reconnect, requests still in flight are resent
+  (their intended times are kept)
+- reconnects are non-blocking connects driven by the loop; one that fails is retried every
+  100 ms, and every send that falls due while the connection has no socket counts as an error
+- log-linear histogram (64 sub-buckets per power of two, ~1.5% error) per thread, merged at the end
+
+Report:
+- summary: requested vs achieved rate, completed, non-2xx, reconnects, errors (sends missed while down)
+- percentile spectrum: 50 / 75 / 90 / 99 / 99.9 / 99.99 / 99.999 / 100, corrected and uncorrected
+- detailed spectrum (--spectrum): 5 steps per halving of the tail, wrk2 / HdrHistogram style
+- timeline: req/s and corrected p50 / p99 / max per --interval seconds of the measured window
+
+Usage: ./http_server &  then  ./http_loadgen --rate 20000 --conns 32 --threads 2 --duration 10
+*/
+
+// http_loadgen.cpp
+#include <iostream>
+#include <chrono>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#define MAX_EVENTS 1024
+#define TIMER_INDEX UINT32_MAX     // epoll data of the thread's send timer
+#define CLIENT_BUFFER 65536
+#define MAX_RESPONSE_HEADER 16384  // A header block longer than this is treated as an error
+#define RECONNECT_DELAY_NS 100000000ULL  // After a failed connect, try again this much later
+
+#define HIST_SUB_BITS 6
+#define HIST_SUB_COUNT (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS ((64 - HIST_SUB_BITS + 1) * HIST_SUB_COUNT)
+
+// ---------------------------------------------------------------------------
+// Latency histogram
+// ---------------------------------------------------------------------------
+
+struct Histogram {
+    uint64_t counts[HIST_BUCKETS] = {};
+    uint64_t total = 0;
+    uint64_t max = 0;
+};
+
+static inline int hist_index(uint64_t value) {
+    if (value < HIST_SUB_COUNT) return (int)value;
+
+    int msb = 63 - __builtin_clzll(value);
+    int shift = msb - HIST_SUB_BITS;
+    return (shift + 1) * HIST_SUB_COUNT + (int)((value >> shift) - HIST_SUB_COUNT);
+}
+
+// Midpoint of the bucket
+static inline uint64_t hist_value(int index) {
+    if (index < HIST_SUB_COUNT) return index;
+
+    int shift = index / HIST_SUB_COUNT - 1;
+    uint64_t sub = index % HIST_SUB_COUNT + HIST_SUB_COUNT;
+    return (sub << shift) + ((1ULL << shift) >> 1);
+}
+
+void hist_record(Histogram* hist, uint64_t value) {
+    hist->counts[hist_index(value)]++;
+    hist->total++;
+    if (value > hist->max) hist->max = value;
+}
+
+void hist_merge(Histogram* into, const Histogram* from) {
+    for (int i = 0; i < HIST_BUCKETS; i++) into->counts[i] += from->counts[i];
+    into->total += from->total;
+    if (from->max > into->max) into->max = from->max;
+}
+
+uint64_t hist_percentile(const Histogram* hist, double percentile) {
+    if (hist->total == 0) return 0;
+    if (percentile >= 100.0) return hist->max;
+
+    uint64_t rank = (uint64_t)(percentile / 100.0 * hist->total);
+    if (rank >= hist->total) rank = hist->total - 1;
+
+    uint64_t seen = 0;
+    for (int i = 0; i < HIST_BUCKETS; i++) {
+        seen += hist->counts[i];
+        if (seen > rank) return std::min(hist_value(i), hist->max);
+    }
+    return hist->max;
+}
+
+// Recorded values in the buckets up to `value`
+uint64_t hist_count_below(const Histogram* hist, uint64_t value) {
+    uint64_t seen = 0;
+    for (int i = 0; i < HIST_BUCKETS && hist_value(i) <= value; i++) seen += hist->counts[i];
+    return seen;
+}
+
+// ---------------------------------------------------------------------------
+// Helpers
+// ---------------------------------------------------------------------------
+
+static inline uint64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void set_nonblocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+size_t raise_fd_limit() {
+    struct rlimit rl;
+    getrlimit(RLIMIT_NOFILE, &rl);
+    rl.rlim_cur = rl.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &rl);
+    getrlimit(RLIMIT_NOFILE, &rl);
+    return rl.rlim_cur;
+}
+
+int connect_server(const struct sockaddr_in& addr) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd == -1) return -1;
+
+    if (connect(fd, (const struct sockaddr*)&addr, sizeof(addr)) == -1) {
+        close(fd);
+        return -1;
+    }
+
+    int nodelay = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+    set_nonblocking(fd);
+    return fd;
+}
+
+// Non-blocking: the socket turns writable once the connect is done, SO_ERROR says how it went
+int start_connect(const struct sockaddr_in& addr) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if (fd == -1) return -1;
+
+    if (connect(fd, (const struct sockaddr*)&addr, sizeof(addr)) == -1 && errno != EINPROGRESS) {
+        close(fd);
+        return -1;
+    }
+
+    int nodelay = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+    return fd;
+}
+
+static bool equals_lowercase(std::string_view a, std::string_view lower) {
+    if (a.size() != lower.size()) return false;
+    for (size_t i = 0; i < a.size(); i++) {
+        char c = a[i];
+        if (c >= 'A' && c <= 'Z') c += 'a' - 'A';
+        if (c != lower[i]) return false;
+    }
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// Load generator
+// ---------------------------------------------------------------------------
+
+struct RunConfig {
+    struct sockaddr_in addr;
+    std::string request;   // One complete request, sent `depth` times back to back at most
+    int conns;
+    int threads;
+    double rate;           // Requests per second, all connections together
+    int depth;
+    double warmup;
+    double duration;
+    double interval;       // Timeline bucket, seconds
+};
+
+enum ResponseState { RESPONSE_HEADERS, RESPONSE_BODY };
+
+struct LoadConn {
+    int fd;                // -1: the last connect failed, the next try is at retry_at
+    bool connecting;       // Non-blocking connect in progress: nothing is sent until it is up
+    bool want_out;
+    uint64_t retry_at;
+    uint64_t next_send;    // Intended time of the next request
+    uint64_t period;       // ns between two requests on this connection
+    size_t unsent;         // Request bytes send() hasn't taken yet
+
+    // In-flight requests, oldest first (ring of `depth`)
+    std::vector<uint64_t> intended;
+    std::vector<uint64_t> sent;
+    int head;
+    int count;
+
+    // Response framing
+    ResponseState state;
+    std::string header;    // Header bytes so far, capacity reused across responses
+    size_t body_left;
+    int status;
+    bool closing;          // Server said "Connection: close"
+};
+
+struct LoadThread {
+    const RunConfig* config;
+    std::atomic<bool>* stop;
+    uint64_t measure_start;
+    uint64_t measure_end;
+    std::vector<LoadConn> conns;
+
+    Histogram corrected;
+    Histogram uncorrected;
+    std::vector<Histogram> timeline;  // Corrected latency per interval of the measured window
+    uint64_t completed = 0;
+    uint64_t non_2xx = 0;
+    uint64_t reconnects = 0;
+    uint64_t errors = 0;
+    uint64_t missed = 0;   // Sends that fell due with no socket to go out on (also in errors)
+};
+
+// Requests whose intended time has come go out, as long as the window has room
+void schedule_requests(LoadThread* self, LoadConn* conn, uint64_t now) {
+    const RunConfig* config = self->config;
+
+    while (conn->next_send <= now && conn->count < config->depth) {
+        int slot = (conn->head + conn->count) % config->depth;
+        conn->intended[slot] = conn->next_send;
+        conn->sent[slot] = now;
+        conn->count++;
+        conn->unsent += config->request.size();
+        conn->next_send += conn->period;
+    }
+}
+
+// Push queued request bytes. The stream is the same request repeated, so the
+// position inside it is all that's needed.
+bool flush_requests(LoadThread* self, LoadConn* conn, const std::string& batch) {
+    size_t request_size = self->config->request.size();
+
+    while (conn->unsent > 0) {
+        size_t offset = (request_size - conn->unsent % request_size) % request_size;
+        size_t chunk = std::min(conn->unsent, batch.size() - offset);
+        ssize_t n = send(conn->fd, batch.data() + offset, chunk, MSG_NOSIGNAL);
+        if (n == -1) {
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+        conn->unsent -= n;
+    }
+    return true;
+}
+
+void complete_request(LoadThread* self, LoadConn* conn, uint64_t now) {
+    const RunConfig* config = self->config;
+    uint64_t intended = conn->intended[conn->head];
+    uint64_t sent = conn->sent[conn->head];
+    conn->head = (conn->head + 1) % config->depth;
+    conn->count--;
+
+    // Only requests scheduled inside the window count, whenever they complete
+    if (intended < self->measure_start || intended >= self->measure_end) return;
+
+    hist_record(&self->corrected, now - intended);
+    hist_record(&self->uncorrected, now - sent);
+    self->completed++;
+    if (conn->status < 200 || conn->status > 299) self->non_2xx++;
+
+    size_t bucket = (size_t)((intended - self->measure_start) / (config->interval * 1e9));
+    if (bucket < self->timeline.size()) hist_record(&self->timeline[bucket], now - intended);
+}
+
+// Status line + headers are complete: pick out what framing needs
+bool parse_response_header(LoadConn* conn) {
+    std::string_view header(conn->header);
+    if (header.size() < 12 || header.substr(0, 7) != "HTTP/1.") return false;
+    conn->status = atoi(header.data() + 9);
+
+    conn->body_left = 0;
+    conn->closing = false;
+    size_t line = header.find("\r\n");
+
+    while (line != std::string_view::npos && line + 2 < header.size()) {
+        size_t start = line + 2;
+        size_t end = header.find("\r\n", start);
+        if (end == std::string_view::npos || end == start) break;
+
+        std::string_view field = header.substr(start, end - start);
+        size_t colon = field.find(':');
+        if (colon != std::string_view::npos) {
+            std::string_view name = field.substr(0, colon);
+            std::string_view value = field.substr(colon + 1);
+            while (!value.empty() && value.front() == ' ') value.remove_prefix(1);
+
+            if (equals_lowercase(name, "content-length")) {
+                conn->body_left = strtoull(std::string(value).c_str(), nullptr, 10);
+            } else if (equals_lowercase(name, "connection") && equals_lowercase(value, "close")) {
+                conn->closing = true;
+            }
+        }
+        line = end;
+    }
+    return true;
+}
+
+// Feed received bytes through the response framing. Returns false on garbage.
+bool consume_responses(LoadThread* self, LoadConn* conn, const char* data, size_t len, uint64_t now) {
+    while (len > 0) {
+        if (conn->state == RESPONSE_BODY) {
+            size_t take = std::min(len, conn->body_left);
+            conn->body_left -= take;
+            data += take;
+            len -= take;
+        } else {
+            // Look for the blank line, including one split across two reads
+            size_t old_size = conn->header.size();
+            size_t scan_from = old_size >= 3 ? old_size - 3 : 0;
+            conn->header.append(data, std::min(len, (size_t)MAX_RESPONSE_HEADER));
+            size_t end = conn->header.find("\r\n\r\n", scan_from);
+
+            if (end == std::string::npos) {
+                if (conn->header.size() >= MAX_RESPONSE_HEADER) return false;
+                return true;  // Need more
+            }
+
+            size_t used = end + 4 - old_size;
+            conn->header.resize(end + 4);
+            if (!parse_response_header(conn)) return false;
+            conn->state = RESPONSE_BODY;
+            data += used;
+            len -= used;
+        }
+
+        if (conn->state == RESPONSE_BODY && conn->body_left == 0) {
+            if (conn->count == 0) return false;  // Response nobody asked for
+            complete_request(self, conn, now);
+            conn->state = RESPONSE_HEADERS;
+            conn->header.clear();
+            if (conn->closing) return true;  // Whatever follows belongs to a dead connection
+        }
+    }
+    return true;
+}
+
+bool wants_output(const LoadConn* conn) {
+    return conn->connecting || conn->unsent > 0;
+}
+
+void watch_conn(int epoll_fd, LoadConn* conn, uint32_t index, int op) {
+    conn->want_out = wants_output(conn);
+    struct epoll_event ev;
+    ev.events = EPOLLIN | (conn->want_out ? (uint32_t)EPOLLOUT : 0u);
+    ev.data.u32 = index;
+    epoll_ctl(epoll_fd, op, conn->fd, &ev);
+}
+
+// The connection has no socket until retry_at
+void drop_conn(LoadThread* self, LoadConn* conn, int epoll_fd, uint64_t now) {
+    if (conn->fd != -1) {
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, conn->fd, nullptr);
+        close(conn->fd);
+    }
+    conn->fd = -1;
+    conn->connecting = false;
+    conn->retry_at = now + RECONNECT_DELAY_NS;
+    self->errors++;
+}
+
+// Server closed (max requests, idle timeout, error): new socket, unanswered requests again
+// once it is up. Never blocks the loop: the connect completes in finish_connect.
+void reconnect(LoadThread* self, LoadConn* conn, int epoll_fd, uint32_t index, uint64_t now) {
+    if (conn->fd != -1) {
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, conn->fd, nullptr);
+        close(conn->fd);
+    }
+
+    conn->fd = start_connect(self->config->addr);
+    if (conn->fd == -1) {
+        drop_conn(self, conn, epoll_fd, now);
+        return;
+    }
+
+    conn->connecting = true;
+    conn->state = RESPONSE_HEADERS;
+    conn->header.clear();
+    conn->closing = false;
+    conn->unsent = conn->count * self->config->request.size();
+    watch_conn(epoll_fd, conn, index, EPOLL_CTL_ADD);
+}
+
+// Writable (or failed) while connecting. Returns false if the connect failed.
+bool finish_connect(LoadThread* self, LoadConn* conn, uint64_t now) {
+    int error = 0;
+    socklen_t len = sizeof(error);
+    if (getsockopt(conn->fd, SOL_SOCKET, SO_ERROR, &error, &len) == -1 || error != 0) return false;
+
+    conn->connecting = false;
+    for (int i = 0; i < conn->count; i++) conn->sent[(conn->head + i) % self->config->depth] = now;
+    self->reconnects++;
+    return true;
+}
+
+// No socket: whatever falls due meanwhile can't be sent. Each one is an error rather
+// than a gap in the histograms; requests already in flight are resent after reconnecting.
+void miss_requests(LoadThread* self, LoadConn* conn, uint64_t now) {
+    while (conn->next_send <= now) {
+        conn->next_send += conn->period;
+        self->missed++;
+        self->errors++;
+    }
+}
+
+void load_thread(LoadThread* self) {
+    const RunConfig* config = self->config;
+    int epoll_fd = epoll_create1(0);
+    std::vector<char> scratch(CLIENT_BUFFER);
+
+    std::string batch;
+    for (int d = 0; d < config->depth; d++) batch += config->request;
+
+    for (size_t i = 0; i < self->conns.size(); i++) {
+        watch_conn(epoll_fd, &self->conns[i], i, EPOLL_CTL_ADD);
+    }
+
+    // steady_clock is CLOCK_MONOTONIC: intended times can be armed as they are
+    int timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    struct epoll_event timer_ev;
+    timer_ev.events = EPOLLIN;
+    timer_ev.data.u32 = TIMER_INDEX;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, timer_fd, &timer_ev);
+
+    struct epoll_event events[MAX_EVENTS];
+
+    while (!self->stop->load(std::memory_order_relaxed)) {
+        uint64_t now = now_ns();
+
+        // Send whatever is due, then sleep until the next request is
+        uint64_t next_due = now + 100000000ULL;
+        for (size_t i = 0; i < self->conns.size(); i++) {
+            LoadConn* conn = &self->conns[i];
+            if (conn->fd == -1) {
+                miss_requests(self, conn, now);
+                if (now >= conn->retry_at) reconnect(self, conn, epoll_fd, i, now);
+                if (conn->fd == -1) {
+                    next_due = std::min(next_due, conn->retry_at);
+                    continue;
+                }
+            }
+
+            schedule_requests(self, conn, now);
+            if (!conn->connecting && !flush_requests(self, conn, batch)) {
+                reconnect(self, conn, epoll_fd, i, now);
+                if (conn->fd == -1) {
+                    next_due = std::min(next_due, conn->retry_at);
+                    continue;
+                }
+            }
+            if (wants_output(conn) != conn->want_out) watch_conn(epoll_fd, conn, i, EPOLL_CTL_MOD);
+            if (conn->count < config->depth && conn->next_send < next_due) next_due = conn->next_send;
+        }
+
+        struct itimerspec due;
+        memset(&due, 0, sizeof(due));
+        due.it_value.tv_sec = next_due / 1000000000ULL;
+        due.it_value.tv_nsec = next_due % 1000000000ULL;
+        timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &due, nullptr);
+
+        int nfds = epoll_wait(epoll_fd, events, MAX_EVENTS, 100);
+        now = now_ns();
+
+        for (int e = 0; e < nfds; e++) {
+            uint32_t index = events[e].data.u32;
+            if (index == TIMER_INDEX) {
+                uint64_t expirations;
+                ssize_t ignored = read(timer_fd, &expirations, sizeof(expirations));
+                (void)ignored;
+                continue;
+            }
+
+            LoadConn* conn = &self->conns[index];
+            if (conn->fd == -1) continue;
+            if (conn->connecting && !finish_connect(self, conn, now)) {
+                drop_conn(self, conn, epoll_fd, now);
+                continue;
+            }
+            bool closed = events[e].events & (EPOLLERR | EPOLLHUP);
+
+            while (!closed) {
+                ssize_t n = recv(conn->fd, scratch.data(), scratch.size(), 0);
+                if (n == -1) {
+                    if (errno != EAGAIN && errno != EWOULDBLOCK) closed = true;
+                    break;
+                }
+                if (n == 0) {
+                    closed = true;
+                    break;
+                }
+                if (!consume_responses(self, conn, scratch.data(), n, now)) {
+                    self->errors++;
+                    closed = true;
+                    break;
+                }
+                if (conn->closing) {
+                    closed = true;
+                    break;
+                }
+            }
+
+            if (closed) {
+                reconnect(self, conn, epoll_fd, index, now);
+                continue;
+            }
+            if (!flush_requests(self, conn, batch)) {
+                reconnect(self, conn, epoll_fd, index, now);
+                continue;
+            }
+            if (wants_output(conn) != conn->want_out) watch_conn(epoll_fd, conn, index, EPOLL_CTL_MOD);
+        }
+    }
+
+    for (LoadConn& conn : self->conns) {
+        if (conn.fd != -1) close(conn.fd);
+    }
+    close(timer_fd);
+    close(epoll_fd);
+}
+
+// ---------------------------------------------------------------------------
+// Command line + report
+// ---------------------------------------------------------------------------
+
+struct Options {
+    std::string host = "127.0.0.1";
+    int port = 8080;
+    std::string path = "/index.html";
+    int conns = 16;
+    int threads = 0;
+    double rate = 10000;
+    int depth = 1;
+    double warmup = 1.0;
+    double duration = 10.0;
+    double interval = 1.0;
+    bool spectrum = false;
+};
+
+void usage(const char* prog) {
+    std::cerr << "Usage: " << prog << " [options]\n"
+              << "  --host IP         server address (default 127.0.0.1)\n"
+              << "  --port N          server port (default 8080)\n"
+              << "  --path P          request path (default /index.html)\n"
+              << "  --conns N         keep-alive connections (default 16)\n"
+              << "  --threads N       client threads, one epoll loop each (default: cpus, max 8)\n"
+              << "  --rate R          requests per second, all connections together (default 10000)\n"
+              << "  --depth D         max requests in flight per connection (default 1; > 1 needs a\n"
+              << "                    server with TCP_NODELAY on, or the numbers show Nagle)\n"
+              << "  --warmup S        seconds at full rate before measuring (default 1)\n"
+              << "  --duration S      measured seconds (default 10)\n"
+              << "  --interval S      timeline resolution (default 1)\n"
+              << "  --spectrum        print the detailed percentile spectrum" << std::endl;
+    exit(1);
+}
+
+Options parse_args(int argc, char* argv[]) {
+    Options options;
+
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        if (strcmp(arg, "--spectrum") == 0) {
+            options.spectrum = true;
+            continue;
+        }
+
+        const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+        if (!value) usage(argv[0]);
+        i++;
+
+        if (strcmp(arg, "--host") == 0) {
+            options.host = value;
+        } else if (strcmp(arg, "--port") == 0) {
+            options.port = atoi(value);
+        } else if (strcmp(arg, "--path") == 0) {
+            options.path = value;
+        } else if (strcmp(arg, "--conns") == 0) {
+            options.conns = atoi(value);
+        } else if (strcmp(arg, "--threads") == 0) {
+            options.threads = atoi(value);
+        } else if (strcmp(arg, "--rate") == 0) {
+            options.rate = atof(value);
+        } else if (strcmp(arg, "--depth") == 0) {
+            options.depth = atoi(value);
+        } else if (strcmp(arg, "--warmup") == 0) {
+            options.warmup = atof(value);
+        } else if (strcmp(arg, "--duration") == 0) {
+            options.duration = atof(value);
+        } else if (strcmp(arg, "--interval") == 0) {
+            options.interval = atof(value);
+        } else {
+            usage(argv[0]);
+        }
+    }
+
+    if (options.threads <= 0) {
+        options.threads = std::thread::hardware_concurrency();
+        if (options.threads > 8) options.threads = 8;
+        if (options.threads < 1) options.threads = 1;
+    }
+    if (options.threads > options.conns) options.threads = options.conns;
+    if (options.conns < 1 || options.rate <= 0 || options.depth < 1 || options.duration <= 0 ||
+        options.interval <= 0) {
+        usage(argv[0]);
+    }
+    return options;
+}
+
+void print_percentiles(const Histogram& corrected, const Histogram& uncorrected) {
+    static const double levels[] = {50, 75, 90, 99, 99.9, 99.99, 99.999, 100};
+
+    printf("\n%-10s %16s %16s\n", "percentile", "corrected ms", "uncorrected ms");
+    for (double p : levels) {
+        printf("%9.3f%% %16.3f %16.3f\n", p, hist_percentile(&corrected, p) / 1e6,
+               hist_percentile(&uncorrected, p) / 1e6);
+    }
+}
+
+// 5 rows per halving of the remaining tail: 0, 10, 20, ... 50%, then 55, 60, ... 75%, ...
+void print_spectrum(const Histogram& hist) {
+    printf("\nDetailed percentile spectrum (corrected):\n");
+    printf("%12s %12s %12s %14s\n", "value ms", "percentile", "total count", "1/(1-p)");
+
+    for (int half = 0; ; half++) {
+        bool last = false;
+        for (int tick = 0; tick < 5; tick++) {
+            double fraction = 1.0 - std::ldexp(1.0, -half) * (1.0 - tick / 10.0);
+            if ((1.0 - fraction) * hist.total < 1.0) {
+                last = true;
+                break;
+            }
+            uint64_t value = hist_percentile(&hist, fraction * 100.0);
+            printf("%12.3f %12.6f %12lu %14.2f\n", value / 1e6, fraction,
+                   (unsigned long)hist_count_below(&hist, value), 1.0 / (1.0 - fraction));
+        }
+        if (last) break;
+    }
+    printf("%12.3f %12.6f %12lu %14s\n", hist.max / 1e6, 1.0, (unsigned long)hist.total, "inf");
+}
+
+int main(int argc, char* argv[]) {
+    Options options = parse_args(argc, argv);
+    signal(SIGPIPE, SIG_IGN);
+
+    size_t fd_limit = raise_fd_limit();
+    if ((size_t)options.conns + 64 > fd_limit) {
+        std::cerr << "RLIMIT_NOFILE " << fd_limit << " is too low for " << options.conns << " connections" << std::endl;
+        return 1;
+    }
+
+    RunConfig config;
+    memset(&config.addr, 0, sizeof(config.addr));
+    config.addr.sin_family = AF_INET;
+    config.addr.sin_port = htons(options.port);
+    if (inet_pton(AF_INET, options.host.c_str(), &config.addr.sin_addr) != 1) {
+        std::cerr << "Bad --host " << options.host << std::endl;
+        return 1;
+    }
+    config.request = "GET " + options.path + " HTTP/1.1\r\nHost: " + options.host + ":" +
+                     std::to_string(options.port) + "\r\n\r\n";
+    config.conns = options.conns;
+    config.threads = options.threads;
+    config.rate = options.rate;
+    config.depth = options.depth;
+    config.warmup = options.warmup;
+    config.duration = options.duration;
+    config.interval = options.interval;
+
+    std::atomic<bool> stop(false);
+    std::vector<LoadThread*> threads;
+    size_t intervals = (size_t)std::ceil(options.duration / options.interval);
+
+    for (int t = 0; t < options.threads; t++) {
+        LoadThread* thread = new LoadThread;
+        thread->config = &config;
+        thread->stop = &stop;
+        thread->timeline.resize(intervals);
+        threads.push_back(thread);
+    }
+
+    // Connect sequentially (a burst of connects overflows the accept backlog)
+    for (int i = 0; i < options.conns; i++) {
+        int fd = connect_server(config.addr);
+        if (fd == -1) {
+            perror("connect failed");
+            return 1;
+        }
+
+        LoadConn conn;
+        conn.fd = fd;
+        conn.connecting = false;
+        conn.want_out = false;
+        conn.retry_at = 0;
+        conn.unsent = 0;
+        conn.intended.resize(options.depth);
+        conn.sent.resize(options.depth);
+        conn.head = 0;
+        conn.count = 0;
+        conn.state = RESPONSE_HEADERS;
+        conn.header.reserve(1024);
+        conn.body_left = 0;
+        conn.status = 0;
+        conn.closing = false;
+        threads[i % options.threads]->conns.push_back(conn);
+    }
+
+    // Connection i starts i / rate seconds in: the aggregate schedule is evenly spaced
+    uint64_t period = (uint64_t)(1e9 * options.conns / options.rate);
+    uint64_t start = now_ns() + 10000000ULL;
+    uint64_t measure_start = start + (uint64_t)(options.warmup * 1e9);
+    uint64_t measure_end = measure_start + (uint64_t)(options.duration * 1e9);
+
+    for (int i = 0; i < options.conns; i++) {
+        LoadConn& conn = threads[i % options.threads]->conns[i / options.threads];
+        conn.period = period;
+        conn.next_send = start + (uint64_t)(i * 1e9 / options.rate);
+    }
+
+    printf("%d connections, %d threads, %.0f req/s, depth %d, %.1f s warmup + %.1f s measured: GET %s\n",
+           options.conns, options.threads, options.rate, options.depth, options.warmup, options.duration,
+           options.path.c_str());
+    fflush(stdout);
+
+    std::vector<std::thread> workers;
+    for (LoadThread* thread : threads) {
+        thread->measure_start = measure_start;
+        thread->measure_end = measure_end;
+        workers.emplace_back(load_thread, thread);
+    }
+
+    // Run past the window so the last scheduled requests can complete (or show how late they are)
+    uint64_t grace = std::max((uint64_t)1000000000ULL, period * options.depth);
+    while (now_ns() < measure_end + grace) usleep(10000);
+    stop.store(true);
+
+    Histogram corrected;
+    Histogram uncorrected;
+    std::vector<Histogram> timeline(intervals);
+    uint64_t completed = 0;
+    uint64_t non_2xx = 0;
+    uint64_t reconnects = 0;
+    uint64_t errors = 0;
+    uint64_t missed = 0;
+
+    for (size_t t = 0; t < threads.size(); t++) {
+        workers[t].join();
+        hist_merge(&corrected, &threads[t]->corrected);
+        hist_merge(&uncorrected, &threads[t]->uncorrected);
+        for (size_t i = 0; i < intervals; i++) hist_merge(&timeline[i], &threads[t]->timeline[i]);
+        completed += threads[t]->completed;
+        non_2xx += threads[t]->non_2xx;
+        reconnects += threads[t]->reconnects;
+        errors += threads[t]->errors;
+        missed += threads[t]->missed;
+        delete threads[t];
+    }
+
+    uint64_t scheduled = (uint64_t)(options.rate * options.duration);
+    printf("\nrequested %.0f req/s, achieved %.0f req/s (%lu of ~%lu scheduled requests completed)\n",
+           options.rate, completed / options.duration, (unsigned long)completed, (unsigned long)scheduled);
+    printf("non-2xx: %lu, reconnects: %lu, errors: %lu (%lu sends missed while disconnected)\n",
+           (unsigned long)non_2xx, (unsigned long)reconnects, (unsigned long)errors, (unsigned long)missed);
+
+    print_percentiles(corrected, uncorrected);
+    if (options.spectrum) print_spectrum(corrected);
+
+    printf("\nTimeline (by intended send time):\n");
+    printf("%8s %12s %10s %10s %10s\n", "t s", "req/s", "p50 ms", "p99 ms", "max ms");
+    for (size_t i = 0; i < intervals; i++) {
+        const Histogram& h = timeline[i];
+        double seconds = std::min(options.interval, options.duration - i * options.interval);
+        printf("%8.1f %12.0f %10.3f %10.3f %10.3f\n", i * options.interval, h.total / seconds,
+               hist_percentile(&h, 50) / 1e6, hist_percentile(&h, 99) / 1e6, h.max / 1e6);
+    }
+    return 0;
+}
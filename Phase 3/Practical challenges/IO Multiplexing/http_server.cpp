@@ -12,9 +12,15 @@ connection struct:
 > int fd 
 > string read_buffer (accumulates bytes from read())
 > bool request_complete (true when \r\n\r\n seen)
-> string method, string path
-> string write_buffer, size_t write_offset
-> enum state: reading, writing, closed
+> HttpParser parser, HttpRequest request (method, path, headers as string_views)
+> HeaderBlock* head (pooled header block), string_view parts[] (what gets sent), size_t write_offset
+> CacheEntry* cached (entry the parts point into)
+> FileHandle* file (open file the body is streamed from), int file_fd (file->fd), off_t file_offset / file_end
+> off_t file_ready (prefetched up to here)
+> IoJob* io_job (disk work in flight for this connection)
+> bool keep_alive (this response leaves the connection open), requests_served
+> bool input_drained (last read() hit EAGAIN), last_active + idle list links
+> enum state: reading, loading (waiting for disk I/O), writing, closed
 
 
 funcs:
@@ -24,32 +30,113 @@ add_fd_to_epoll() - add / modify fd
 
 accept_new_connection - called when epoll signals server_fd readable
 > loop accept until eagain
-> set client socket non blocking
+> set client socket non blocking, TCP_NODELAY (pipelined responses are separate small writes)
 > create connection
-> add client fd to epoll (EPOLLIN)
+> add client fd to epoll (EPOLLIN | EPOLLOUT, edge-triggered: registered once, never modified)
 
 handle_client_read(Connection&) - called when epoll signals EPOLLIN
-> read until EAGAIN
+> read until EAGAIN (or PIPELINE_READ_LIMIT unparsed bytes are buffered)
 > append to read buffer
-> detect \r\n\r\n
-> if request compelte: parse HTTP request, prepare response, switch state to writing, update epoll to EPOLLOUT
+> process_connection: parse -> prepare response -> write inline, for every complete request buffered
 
-parse_http_request(Connection&): extract GET method and path, normalise path
+keep-alive (HTTP/1.1 default, HTTP/1.0 with "Connection: keep-alive"):
+> response says "Connection: keep-alive" or "Connection: close"
+> after a response: next request starts at request.length, pipelined requests are answered in order
+> consumed bytes are dropped from read_buffer before the next read, the parser is rebased
+> closed after --max-requests responses, or after --idle-timeout ms without progress
+> idle list: connections ordered by last activity, the loop sweeps expired ones off the tail
+> malformed requests are answered and closed: after a parse error the framing is lost
+
+parse_http_request(Connection&): resumable HTTP/1.x parser (HttpParser)
+> state machine over read_buffer, each call continues at parser.pos (no rescans)
+> only offsets are stored while parsing, so read_buffer may grow/reallocate between reads
+> on completion: method, path and headers as string_views into read_buffer (no copies)
+> limits: request line 8 KB (414), request line + headers 16 KB / 32 headers (431), body 1 MB (413)
+> Content-Length bodies are waited for and skipped, chunked bodies -> 501
+> request.length = bytes this request used: the next pipelined request starts right after
+> --bench-parser: pipelined wrk-style requests, old find + istringstream vs the parser
 
 build_http_response(Connection&):
-> open requested file
-> if exists: 200 ok
-> else: 404 not found
-> build headers
-> load file contents
-> fill write buffer
+> cache hit: answered right away
+> miss: IO_OPEN job (open + fstat, small files also read whole), state -> loading
+> job done: 404, cache entry, or 200 with the fd kept open as the body (never read into memory)
+> build headers into a pooled HeaderBlock
+
+response headers (no heap, no iostream):
+> HeaderWriter: fixed-capacity appends + std::to_chars into a HeaderBlock from a free list
+> status lines and MIME types: constexpr tables
+> Date: one pre-formatted line, re-rendered by the loop when the second changes
+> every response ends with its own block: Date + Connection + blank line (+ small error page)
+
+precompressed assets (app.js.gz / app.js.br next to app.js, made ahead of time, never compressed here):
+> Accept-Encoding -> bit per coding the client takes (q > 0, "*" = all not listed); br preferred over gzip
+> identity opened on a miss -> the worker also stat()s the siblings, the result (siblings bitmask)
+  is kept with the cached identity, so later requests negotiate without touching the disk
+> variant = its own cache entry / fd cache handle, key = sibling path + NUL: open() stops at the NUL,
+  and a direct request for "/app.js.gz" keeps its own identity entry
+> variant headers: Content-Type of the identity, Content-Encoding, own ETag (own mtime and size)
+> Vary: Accept-Encoding on every response for a file that has siblings, identity included
+> sibling created / changed / removed -> inotify drops the variant and the identity (its bitmask is stale)
+> sibling gone when opened -> identity sent instead
+
+range requests (GET with "Range: bytes=...", cached entries and sendfile files alike):
+> range-specs "a-b", "a-" and "-n", clamped to the file; malformed or more than MAX_RANGES -> plain 200
+> "If-Range" that doesn't match the current ETag / Last-Modified -> plain 200
+> one satisfiable range -> 206 + Content-Range, the body is a slice of the entry or [a, b] via sendfile
+> several -> 206 multipart/byteranges: one part at a time, each part header rendered into the header
+  block once the previous part is sent, so memory doesn't grow with the number of ranges
+> none satisfiable -> 416, Content-Range with "*" for the range and the file size
+> --check-allocations: operator new counted, cache hits / error responses / routes must not allocate;
+  the counting operator new is only compiled in with -DCHECK_ALLOCATIONS, the server keeps the standard one
+
+dynamic endpoints (GET /health, /metrics, /api/status):
+> constexpr route table: {method, path, content type, handler}
+> perfect hash over "method path" (FNV-1a + seed), seed searched at compile time: no collisions
+> lookup: hash, one slot, one compare; query string ignored; checked before the static path
+> handler writes the body straight into a pooled BodyBlock (HeaderWriter), returns the status
+> server adds status line, Content-Length, Content-Type, Cache-Control: no-store
+> --bench-routes: ns per lookup for a hit and two misses
+
+disk I/O offload (--io-threads N, default IO_THREADS; 0 = do it inline on the loop):
+> nothing that can wait on the disk runs on the loop: open, fstat, read of small files, cold sendfile pages
+> submit: mutex + condvar queue of IoJob*, worker threads run them
+> complete: workers push finished jobs on a done list, eventfd written only when the list was empty
+> loop drains the done list on the eventfd (IO_EVENT_TAG) and resumes each connection
+> sendfile: only [file_offset, file_ready) is sent; file_ready moves ahead one --send-window at a time
+> window already in the page cache (preadv2 RWF_NOWAIT probe) -> ready at once, else IO_READAHEAD job reads it in
+> connection closed with a job in flight: job is orphaned, its completion only drops its file reference
+> cache: the worker adds the inotify watch before reading; any inotify event since submit -> result not cached
+
+asset cache (files up to CACHE_MAX_FILE, CACHE_MAX_BYTES in total, --cache-mb):
+> key = normalized file path ("./www/index.html": query dropped, "//" and "/./" collapsed)
+> entry = pre-rendered 200 header block (Content-Length, Content-Type, ETag, Last-Modified) + body in memory
+> hit: parts = {entry header, entry body}, one writev, no open/fstat/read at all
+> miss: open + fstat, small regular file -> read once, insert; bigger -> sendfile path
+> LRU list, least recently used entries evicted to stay under the cap
+> inotify watch on each cached file's directory: modify / delete / rename / attrib -> drop the entry
+> entries are refcounted: a response in flight keeps an evicted entry alive until it is sent
+
+fd cache (files too big for the asset cache, --fd-cache N handles, --fd-ttl MS):
+> FileHandle = open fd + stat + pre-rendered 200 headers, refcounted by every sendfile response using it
+> hit: no open/fstat/close, the IO_OPEN job is skipped and the response starts right away
+> miss: the worker opens and watches the directory as usual, the loop keeps the handle for the next request
+> revalidated by the same inotify watches (modify / delete / rename -> dropped), and after --fd-ttl ms
+  anyway (0 = never; files without a watch are only kept while a TTL is set)
+> LRU, at most --fd-cache handles; an evicted handle is closed when its last response is sent
+> file_syscalls counts open/fstat/close/inotify_add_watch; /metrics reports it and the fd cache hits
+> --bench-fd-cache: file syscalls and us per request for the same sendfile download, cache off vs on
 
-handle_client_write(connection&): called when epoll signals EPOLLOUT
-> write remaining bytes
->update write_offset
-if fully written: close connection
+handle_client_write(connection&): called when epoll signals EPOLLOUT (and inline right after preparing)
+> response parts (header block, in-memory body) with one writev (sendmsg, MSG_MORE when a file follows)
+> then sendfile() the file in --send-window pieces until EAGAIN, file_offset tracks progress
+> memory per download = header block, whatever the file size; the page cache is pulled in one window ahead
+if fully written: close connection, or keep it and move on to the next request
 
-close_connection(connection&): remove fd from epoll, close socket, remove from connection loop
+close_connection(connection&): remove fd from epoll, close socket, release the connection slot
+
+connection table: pre-allocated Connection slots indexed by fd (no map, no new/delete)
+> epoll data.u64 = slot address | generation, so dispatch is a pointer dereference
+> releasing a slot bumps its generation, stale events for a closed fd are dropped
 
 
 
@@ -64,35 +151,345 @@ Success criteria:
 #include <iostream>
 #include <unistd.h>
 #include <sys/socket.h>
+#include <sys/resource.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <sys/epoll.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/inotify.h>
+#include <sys/eventfd.h>
 #include <fcntl.h>
+#include <cstdio>
+#include <cstdlib>
 #include <cstring>
 #include <cerrno>
-#include <map>
+#include <csignal>
+#include <ctime>
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <new>
+#include <random>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 
 #define MAX_EVENTS 100
 #define BUFFER_SIZE 4096
+#define MAX_FDS 65536
+#define GENERATION_MASK 63  // Low bits of a 64-byte aligned slot address
+#define LISTENER_TAG 0
+#define INOTIFY_TAG 1       // Slots are 64-byte aligned, so no connection tag is 1 or 2
+#define IO_EVENT_TAG 2
+
+#define MAX_HEADERS 32
+#define MAX_REQUEST_LINE 8192   // Longer request line -> 414
+#define MAX_HEADER_BYTES 16384  // Request line + headers, more -> 431
+#define MAX_BODY 1048576        // Content-Length above this -> 413
+
+#define SENDFILE_CHUNK (1024 * 1024)  // Default bytes per sendfile() call and readahead window
+#define MAX_RANGES 16                 // More range-specs than this -> the Range header is ignored
+#define MAX_PARTS 4                   // Response pieces per writev
+#define HEADER_BLOCK_SIZE 512         // Largest header block (or generated error page) of a response
+#define BODY_BLOCK_SIZE 4096          // Largest body a dynamic endpoint may produce
+
+#define IDLE_TIMEOUT_MS 5000        // Default keep-alive idle timeout
+#define MAX_KEEPALIVE_REQUESTS 1000 // Default responses per connection before closing
+#define PIPELINE_READ_LIMIT 65536   // Stop reading ahead once this much is unparsed
+
+#define IO_THREADS 2  // Default disk I/O workers
+
+#define CACHE_MAX_FILE (256 * 1024)          // Larger files always go through sendfile
+#define CACHE_MAX_BYTES (64 * 1024 * 1024)   // Default cap for all cached responses
+#define FD_CACHE_MAX 1024                    // Default open files kept for the sendfile path
+#define FD_CACHE_TTL_MS 10000                // Default age at which a cached handle is reopened
 
 enum State {
     READING,
+    LOADING,  // Waiting for an IoJob: open / read on a worker thread
     WRITING,
     CLOSED
 };
 
-struct Connection {
-    int fd;
+enum ParseResult {
+    PARSE_INCOMPLETE,
+    PARSE_DONE,
+    PARSE_ERROR
+};
+
+enum ParseState {
+    P_METHOD,
+    P_PATH,
+    P_VERSION,
+    P_REQUEST_LINE_LF,
+    P_HEADER_START,
+    P_HEADER_NAME,
+    P_HEADER_VALUE_START,
+    P_HEADER_VALUE,
+    P_HEADER_LF,
+    P_HEADERS_END_LF,
+    P_BODY,
+    P_DONE,
+    P_ERROR
+};
+
+struct HttpHeader {
+    std::string_view name;
+    std::string_view value;
+};
+
+// Views into the connection's read_buffer: valid until the buffer is modified
+struct HttpRequest {
+    std::string_view method;
+    std::string_view path;
+    int version_minor;  // HTTP/1.<minor>
+    HttpHeader headers[MAX_HEADERS];
+    size_t header_count;
+    std::string_view body;
+    bool keep_alive;
+    size_t length;      // Bytes used in the buffer, the next request starts after them
+};
+
+// Offsets into the buffer, not pointers: the buffer may reallocate between reads
+struct HeaderSpan {
+    uint32_t name_start;
+    uint32_t name_end;
+    uint32_t value_start;
+    uint32_t value_end;
+};
+
+struct HttpParser {
+    ParseState state = P_METHOD;
+    size_t start = 0;  // First byte of the current request
+    size_t pos = 0;    // Next byte to look at
+    size_t method_end;
+    size_t path_start;
+    size_t path_end;
+    int version_minor;
+    int version_matched;  // Bytes of "HTTP/1." seen so far
+    HeaderSpan spans[MAX_HEADERS];
+    size_t header_count;
+    size_t content_length;
+    size_t body_start;
+    int error_status;     // HTTP status to answer a malformed request with
+};
+
+struct CacheEntry;
+struct FileHandle;
+struct HeaderBlock;
+struct BodyBlock;
+struct IoJob;
+void cache_release(CacheEntry* entry);
+void file_release(FileHandle* file);
+void orphan_io_job(IoJob* job);
+void release_header_block(HeaderBlock* block);
+void release_body_block(BodyBlock* block);
+
+// One pre-allocated slot per fd, fd == -1 when free
+struct alignas(64) Connection {
+    int fd = -1;
+    std::atomic<uint32_t> generation{0};
     std::string read_buffer;
     bool request_complete;
-    std::string method;
-    std::string path;
-    std::string write_buffer;
-    size_t write_offset;
+    HttpParser parser;
+    HttpRequest request;
+    HeaderBlock* head;                  // Pooled block the response's own header bytes live in
+    BodyBlock* body;                    // Pooled block a dynamic endpoint wrote its body into
+    std::string_view parts[MAX_PARTS];  // Response pieces, sent in order with one writev
+    int part_count;
+    size_t write_offset;                // Bytes of parts already sent
+    CacheEntry* cached;                 // Entry the parts point into, nullptr if none
+    FileHandle* file;          // Open file the body is streamed from, nullptr if none
+    int file_fd = -1;          // file->fd, -1 if none
+    off_t file_offset;
+    off_t file_end;
+    off_t file_ready;          // Bytes known to be in the page cache: sendfile won't wait on the disk
+    std::string_view range_list;  // Multipart: range-specs not sent yet (in read_buffer, no reads meanwhile)
+    int range_segments_left;      // Multipart: parts after the current one + the closing delimiter
+    IoJob* io_job;             // Disk work in flight, nullptr if none
+    bool keep_alive;           // Current response leaves the connection open
+    uint8_t accepted_encodings;  // Current request's Accept-Encoding, bit per Encoding
+    bool input_drained;        // Last read() hit EAGAIN: wait for EPOLLIN before reading again
+    uint32_t requests_served;
+    uint64_t last_active;      // Milliseconds, see now_ms
+    Connection* idle_prev;     // Idle list, most recently active first
+    Connection* idle_next;
     State state;
 };
 
-std::map<int, Connection*> connections;
+struct ServerConfig {
+    uint64_t idle_timeout_ms = IDLE_TIMEOUT_MS;
+    uint32_t max_requests = MAX_KEEPALIVE_REQUESTS;
+    off_t send_window = SENDFILE_CHUNK;  // sendfile() chunk and how far ahead of it the file is read
+};
+
+ServerConfig config;
+
+// Counters for /metrics and /api/status, loop thread only
+struct ServerStats {
+    uint64_t start_ms;
+    uint64_t connections_accepted;
+    uint64_t connections_open;
+    uint64_t requests;
+    uint64_t cache_hits;
+    uint64_t cache_misses;
+    uint64_t fd_cache_hits;
+    uint64_t precompressed;  // Responses sent from a .gz / .br sibling
+};
+
+ServerStats stats;
+
+// open/fstat/close/inotify_add_watch calls on the static file path, workers included
+std::atomic<uint64_t> file_syscalls{0};
+
+static void count_file_syscalls(uint64_t n) {
+    file_syscalls.fetch_add(n, std::memory_order_relaxed);
+}
+
+Connection* connections;
+size_t connections_capacity;
+
+// Idle list: open connections by last activity, oldest at the tail
+Connection* idle_head = nullptr;
+Connection* idle_tail = nullptr;
+uint64_t now_ms = 0;  // Refreshed once per epoll_wait return
+
+uint64_t monotonic_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+void idle_unlink(Connection* conn) {
+    if (conn->idle_prev) conn->idle_prev->idle_next = conn->idle_next;
+    else idle_head = conn->idle_next;
+    if (conn->idle_next) conn->idle_next->idle_prev = conn->idle_prev;
+    else idle_tail = conn->idle_prev;
+}
+
+void idle_push_front(Connection* conn) {
+    conn->idle_prev = nullptr;
+    conn->idle_next = idle_head;
+    if (idle_head) idle_head->idle_prev = conn;
+    idle_head = conn;
+    if (!idle_tail) idle_tail = conn;
+}
+
+// Progress on this connection: it goes to the front of the idle list
+void touch_connection(Connection* conn) {
+    conn->last_active = now_ms;
+    if (idle_head != conn) {
+        idle_unlink(conn);
+        idle_push_front(conn);
+    }
+}
+
+void init_connections(size_t capacity) {
+    connections = new Connection[capacity];
+    connections_capacity = capacity;
+}
+
+Connection* acquire_connection(int fd) {
+    if (fd < 0 || (size_t)fd >= connections_capacity) return nullptr;
+
+    Connection* conn = &connections[fd];
+    conn->fd = fd;
+    conn->request_complete = false;
+    conn->parser = HttpParser();
+    conn->state = State::READING;
+    conn->write_offset = 0;
+    conn->part_count = 0;
+    conn->head = nullptr;
+    conn->body = nullptr;
+    conn->cached = nullptr;
+    conn->file = nullptr;
+    conn->file_fd = -1;
+    conn->range_segments_left = 0;
+    conn->io_job = nullptr;
+    conn->keep_alive = false;
+    conn->input_drained = false;
+    conn->requests_served = 0;
+    conn->last_active = now_ms;
+    idle_push_front(conn);
+    stats.connections_accepted++;
+    stats.connections_open++;
+    return conn;
+}
+
+void release_connection(Connection* conn) {
+    // clear() keeps the string capacity for the next connection on this fd
+    conn->read_buffer.clear();
+    conn->part_count = 0;
+    if (conn->head) {
+        release_header_block(conn->head);
+        conn->head = nullptr;
+    }
+    if (conn->body) {
+        release_body_block(conn->body);
+        conn->body = nullptr;
+    }
+    if (conn->cached) {
+        cache_release(conn->cached);
+        conn->cached = nullptr;
+    }
+    if (conn->io_job) {
+        // A worker may be reading file_fd right now: the job holds its own reference
+        orphan_io_job(conn->io_job);
+        conn->io_job = nullptr;
+    }
+    if (conn->file) {
+        file_release(conn->file);
+        conn->file = nullptr;
+        conn->file_fd = -1;
+    }
+    idle_unlink(conn);
+    stats.connections_open--;
+    conn->state = State::CLOSED;
+    conn->fd = -1;
+    conn->generation.store(conn->generation.load(std::memory_order_relaxed) + 1,
+                           std::memory_order_relaxed);
+}
+
+uint64_t connection_tag(Connection* conn) {
+    return (uint64_t)(uintptr_t)conn |
+           (conn->generation.load(std::memory_order_relaxed) & GENERATION_MASK);
+}
+
+Connection* resolve_connection(uint64_t tag) {
+    Connection* conn = (Connection*)(uintptr_t)(tag & ~(uint64_t)GENERATION_MASK);
+    uint32_t generation = conn->generation.load(std::memory_order_relaxed);
+
+    if ((generation & GENERATION_MASK) != (tag & GENERATION_MASK) || conn->fd == -1) {
+        return nullptr;  // Event for a connection that has since been closed
+    }
+    return conn;
+}
+
+size_t raise_fd_limit(size_t wanted) {
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) == -1) return 1024;
+
+    rlim_t target = wanted;
+    if (rl.rlim_max != RLIM_INFINITY && target > rl.rlim_max) target = rl.rlim_max;
+
+    if (target > rl.rlim_cur) {
+        rl.rlim_cur = target;
+        if (setrlimit(RLIMIT_NOFILE, &rl) == -1) {
+            getrlimit(RLIMIT_NOFILE, &rl);
+        }
+    }
+
+    return rl.rlim_cur < wanted ? rl.rlim_cur : wanted;
+}
 
 void set_non_blocking(int fd) {
     int flags = fcntl(fd, F_GETFL, 0);
@@ -106,11 +503,16 @@ int setup_server_socket() {
     setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
 
     struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
     addr.sin_family = AF_INET;
     addr.sin_addr.s_addr = INADDR_ANY;
     addr.sin_port = htons(8080);
 
-    bind(server_fd, (struct sockaddr*)&addr, sizeof(addr));
+    if (bind(server_fd, (struct sockaddr*)&addr, sizeof(addr)) == -1) {
+        perror("bind failed");
+        close(server_fd);
+        return -1;
+    }
     listen(server_fd, SOMAXCONN);
 
     set_non_blocking(server_fd);
@@ -118,15 +520,25 @@ int setup_server_socket() {
     return server_fd;
 }
 
-void add_fd_to_epoll(int fd, int epoll_fd, uint32_t events) {
+bool add_fd_to_epoll(int fd, int epoll_fd, uint32_t events, uint64_t tag) {
     struct epoll_event ev;
     ev.events = events;
-    ev.data.fd = fd;
+    ev.data.u64 = tag;
 
     if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) == -1) {
-        perror("epoll_ctl add failed")
-        close(fd);
+        perror("epoll_ctl add failed");
+        return false;
+    }
+    return true;
+}
+
+void close_connection(Connection* conn, int epoll_fd) {
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_DEL, conn->fd, nullptr) == -1) {
+        perror("epoll del failed");
     }
+
+    close(conn->fd);
+    release_connection(conn);
 }
 
 void accept_new_connections(int server_fd, int epoll_fd) {
@@ -142,146 +554,2425 @@ void accept_new_connections(int server_fd, int epoll_fd) {
             }
         } 
 
+        Connection* conn = acquire_connection(client_fd);
+        if (!conn) {
+            std::cerr << "fd " << client_fd << " exceeds connection table, closing" << std::endl;
+            close(client_fd);
+            continue;
+        }
+
         set_non_blocking(client_fd);
-        Connection* conn = new Connection;
-        conn->fd = client_fd;
-        conn->request_complete = false;
-        conn->state = State::READING;
-        conn->write_offset = 0;
-        
-        add_fd_to_epoll(client_fd, epoll_fd, EPOLLIN | EPOLLET);
 
-        connections[client_fd] = conn;
+        // Pipelined responses go out with one sendmsg each: without this, Nagle holds every
+        // one after the first until the client's (delayed, ~40 ms) ACK. MSG_MORE still
+        // coalesces headers with file data where that is wanted.
+        int nodelay = 1;
+        setsockopt(client_fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+
+        // Both directions, edge-triggered: no epoll_ctl when switching between reading and writing
+        if (!add_fd_to_epoll(client_fd, epoll_fd, EPOLLIN | EPOLLOUT | EPOLLET, connection_tag(conn))) {
+            close(client_fd);
+            release_connection(conn);
+        }
     }
 }
 
-void handle_client_read(Connection* conn, int epoll_fd) {
-    while (true) {
-        char buffer[BUFFER_SIZE];
-        ssize_t bytes_read = read(conn->fd, buffer, sizeof(buffer));
+// ---------------------------------------------------------------------------
+// HTTP/1.x request parser
+// ---------------------------------------------------------------------------
 
-        if (bytes_read == -1) {
-            if (errno == EAGAIN || errno == EWOULDBLOCK) {
-                break;
-            } else {
-                perror("Read failed");
-                close_connection(conn, epoll_fd);
-                return;
+// RFC 9110 tchar: what a method or header name may contain
+struct TokenTable {
+    bool allowed[256];
+
+    constexpr TokenTable() : allowed() {
+        for (int c = '0'; c <= '9'; c++) allowed[c] = true;
+        for (int c = 'a'; c <= 'z'; c++) allowed[c] = true;
+        for (int c = 'A'; c <= 'Z'; c++) allowed[c] = true;
+        for (char c : std::string_view("!#$%&'*+-.^_`|~")) allowed[(unsigned char)c] = true;
+    }
+};
+
+constexpr TokenTable token_table;
+
+static inline bool is_token(char c) {
+    return token_table.allowed[(unsigned char)c];
+}
+
+// Next request starts at `start` (0 for a fresh buffer)
+void http_parser_reset(HttpParser* p, size_t start) {
+    p->state = P_METHOD;
+    p->start = start;
+    p->pos = start;
+    p->header_count = 0;
+    p->content_length = 0;
+    p->version_matched = 0;
+    p->error_status = 0;
+}
+
+// The first `shift` bytes were dropped from the buffer: move every offset back
+void http_parser_rebase(HttpParser* p, size_t shift) {
+    p->start -= shift;
+    p->pos -= shift;
+    p->method_end -= shift;
+    p->path_start -= shift;
+    p->path_end -= shift;
+    p->body_start -= shift;
+    for (size_t i = 0; i < p->header_count; i++) {
+        p->spans[i].name_start -= shift;
+        p->spans[i].name_end -= shift;
+        p->spans[i].value_start -= shift;
+        p->spans[i].value_end -= shift;
+    }
+}
+
+static ParseResult parse_error(HttpParser* p, int status) {
+    p->state = P_ERROR;
+    p->error_status = status;
+    return PARSE_ERROR;
+}
+
+static bool equals_lowercase(std::string_view a, std::string_view lower) {
+    if (a.size() != lower.size()) return false;
+    for (size_t i = 0; i < a.size(); i++) {
+        char c = a[i];
+        if (c >= 'A' && c <= 'Z') c += 'a' - 'A';
+        if (c != lower[i]) return false;
+    }
+    return true;
+}
+
+// Case-insensitive header lookup, `name` in lowercase. Empty view if absent.
+std::string_view find_header(const HttpRequest* req, std::string_view name) {
+    for (size_t i = 0; i < req->header_count; i++) {
+        if (equals_lowercase(req->headers[i].name, name)) return req->headers[i].value;
+    }
+    return std::string_view();
+}
+
+// Content-Length, Transfer-Encoding and Connection need a look before the body
+static ParseResult finish_headers(HttpParser* p, const char* buf) {
+    for (size_t i = 0; i < p->header_count; i++) {
+        std::string_view name(buf + p->spans[i].name_start, p->spans[i].name_end - p->spans[i].name_start);
+        std::string_view value(buf + p->spans[i].value_start, p->spans[i].value_end - p->spans[i].value_start);
+
+        if (equals_lowercase(name, "content-length")) {
+            if (value.empty()) return parse_error(p, 400);
+            size_t length = 0;
+            for (char c : value) {
+                if (c < '0' || c > '9') return parse_error(p, 400);
+                length = length * 10 + (c - '0');
+                if (length > MAX_BODY) return parse_error(p, 413);
             }
-        } else if (bytes_read == 0) {
-            close_connection(conn, epoll_fd);
-            return;
+            p->content_length = length;
+        } else if (equals_lowercase(name, "transfer-encoding")) {
+            return parse_error(p, 501);  // No chunked request bodies
         }
-
-        conn->read_buffer.append(buffer, bytes_read);
     }
-    
-    // Now that we have data, parse the HTTP request if not done yet
-    if (!conn->request_complete) {
-        parse_http_request(conn); // Fill method, path, and mark request_complete
+
+    p->body_start = p->pos;
+    p->state = p->content_length > 0 ? P_BODY : P_DONE;
+    return PARSE_DONE;
+}
+
+static void fill_request(const HttpParser* p, const char* buf, HttpRequest* req) {
+    req->method = std::string_view(buf + p->start, p->method_end - p->start);
+    req->path = std::string_view(buf + p->path_start, p->path_end - p->path_start);
+    req->version_minor = p->version_minor;
+    req->header_count = p->header_count;
+
+    for (size_t i = 0; i < p->header_count; i++) {
+        const HeaderSpan& span = p->spans[i];
+        req->headers[i].name = std::string_view(buf + span.name_start, span.name_end - span.name_start);
+        req->headers[i].value = std::string_view(buf + span.value_start, span.value_end - span.value_start);
     }
 
-    // If request is complete, prepare response and switch to writing
-    if (conn->request_complete && conn->state == READING) {
-        prepare_http_response(conn); // Build write_buffer
+    req->body = std::string_view(buf + p->body_start, p->content_length);
+    req->length = p->body_start + p->content_length - p->start;
 
-        // Update epoll to listen for write events
-        struct epoll_event ev;
-        ev.events = EPOLLOUT | EPOLLET;
-        ev.data.fd = conn->fd;
-        epoll_ctl(epoll_fd, EPOLL_CTL_MOD, conn->fd, &ev);
+    // HTTP/1.1 is persistent unless told otherwise, HTTP/1.0 only if asked
+    std::string_view connection = find_header(req, "connection");
+    if (p->version_minor >= 1) {
+        req->keep_alive = !equals_lowercase(connection, "close");
+    } else {
+        req->keep_alive = equals_lowercase(connection, "keep-alive");
     }
 }
 
-void handle_client_write(Connection* conn, int epoll_fd) {
-    while (!conn->write_buffer.empty()) {
+// Continue parsing buf[0, len) where the last call stopped. PARSE_DONE fills req;
+// call http_parser_reset(p, p->start + req->length) before parsing the next one.
+ParseResult http_parse(HttpParser* p, const char* buf, size_t len, HttpRequest* req) {
+    static const char version_prefix[] = "HTTP/1.";
+    size_t pos = p->pos;
 
-        ssize_t bytes_written = write(conn->fd,
-                                      conn->write_buffer.data() + conn->write_offset, 
-                                      conn->write_buffer.size() - conn->write_offset);
-        
-        if (bytes_written == -1) {
-            if (errno == EAGAIN || errno == EWOULDBLOCK) {
-                return;
-            } else {
-                perror("write failed");
+    while (true) {
+        switch (p->state) {
+        case P_METHOD:
+            while (pos < len && is_token(buf[pos])) pos++;
+            if (pos == len) break;
+            if (buf[pos] != ' ' || pos == p->start) return parse_error(p, 400);
+            p->method_end = pos++;
+            p->path_start = pos;
+            p->state = P_PATH;
+            continue;
+
+        case P_PATH: {
+            const char* space = (const char*)memchr(buf + pos, ' ', len - pos);
+            if (!space) {
+                pos = len;
                 break;
             }
-        } 
+            pos = space - buf;
+            if (pos == p->path_start || buf[p->path_start] != '/') return parse_error(p, 400);
+            for (size_t i = p->path_start; i < pos; i++) {
+                if ((unsigned char)buf[i] < 0x21 || buf[i] == 0x7f) return parse_error(p, 400);
+            }
+            p->path_end = pos++;
+            p->state = P_VERSION;
+            continue;
+        }
 
-        conn->write_offset += bytes_written;
-    }
+        case P_VERSION:
+            while (pos < len && p->version_matched < 7) {
+                if (buf[pos] != version_prefix[p->version_matched]) return parse_error(p, 505);
+                p->version_matched++;
+                pos++;
+            }
+            if (pos == len) break;
+            if (buf[pos] != '0' && buf[pos] != '1') return parse_error(p, 505);
+            p->version_minor = buf[pos++] - '0';
+            p->state = P_REQUEST_LINE_LF;
+            continue;
+
+        case P_REQUEST_LINE_LF:
+            // "\r\n" after the version
+            if (pos == len) break;
+            if (buf[pos] == '\r') {
+                pos++;
+                if (pos == len) break;
+            }
+            if (buf[pos] != '\n') return parse_error(p, 400);
+            pos++;
+            if (pos - p->start > MAX_REQUEST_LINE) return parse_error(p, 414);
+            p->state = P_HEADER_START;
+            continue;
+
+        case P_HEADER_START:
+            if (pos == len) break;
+            if (buf[pos] == '\r') {
+                pos++;
+                p->state = P_HEADERS_END_LF;
+                continue;
+            }
+            if (!is_token(buf[pos])) return parse_error(p, 400);
+            if (p->header_count == MAX_HEADERS) return parse_error(p, 431);
+            p->spans[p->header_count].name_start = pos;
+            p->state = P_HEADER_NAME;
+            continue;
+
+        case P_HEADER_NAME:
+            while (pos < len && is_token(buf[pos])) pos++;
+            if (pos == len) break;
+            if (buf[pos] != ':') return parse_error(p, 400);
+            p->spans[p->header_count].name_end = pos++;
+            p->state = P_HEADER_VALUE_START;
+            continue;
+
+        case P_HEADER_VALUE_START:
+            while (pos < len && (buf[pos] == ' ' || buf[pos] == '\t')) pos++;
+            if (pos == len) break;
+            p->spans[p->header_count].value_start = pos;
+            p->state = P_HEADER_VALUE;
+            continue;
+
+        case P_HEADER_VALUE: {
+            const char* cr = (const char*)memchr(buf + pos, '\r', len - pos);
+            if (!cr) {
+                pos = len;
+                break;
+            }
+            pos = cr - buf;
+
+            // Trailing whitespace is not part of the value
+            size_t end = pos;
+            while (end > p->spans[p->header_count].value_start && (buf[end - 1] == ' ' || buf[end - 1] == '\t')) end--;
+            p->spans[p->header_count].value_end = end;
+            pos++;
+            p->state = P_HEADER_LF;
+            continue;
+        }
 
-    if (conn->write_offset == conn->write_buffer.size()) {
-        conn->write_buffer.clear();
-        conn->write_offset = 0;
-        conn->state = State::READING;
+        case P_HEADER_LF:
+            if (pos == len) break;
+            if (buf[pos] != '\n') return parse_error(p, 400);
+            pos++;
+            p->header_count++;
+            p->state = P_HEADER_START;
+            continue;
 
-        struct epoll_event ev;
-        ev.events = EPOLLIN | EPOLLET;
-        ev.data.fd = conn->fd;
+        case P_HEADERS_END_LF:
+            if (pos == len) break;
+            if (buf[pos] != '\n') return parse_error(p, 400);
+            pos++;
+            if (pos - p->start > MAX_HEADER_BYTES) return parse_error(p, 431);
+            p->pos = pos;
+            if (finish_headers(p, buf) == PARSE_ERROR) return PARSE_ERROR;
+            continue;
 
-        epoll_ctl(epoll_fd, EPOLL_CTL_MOD, conn->fd, &ev);
+        case P_BODY:
+            // Bodies aren't used, just waited for so the next request lines up
+            if (len - p->body_start < p->content_length) {
+                pos = len;
+                break;
+            }
+            p->state = P_DONE;
+            continue;
+
+        case P_DONE:
+            p->pos = pos;
+            fill_request(p, buf, req);
+            return PARSE_DONE;
+
+        case P_ERROR:
+            return PARSE_ERROR;
+        }
+
+        // Out of input: remember where we are and enforce the size limits
+        p->pos = pos;
+        if (p->state <= P_VERSION && pos - p->start > MAX_REQUEST_LINE) return parse_error(p, 414);
+        if (p->state < P_BODY && pos - p->start > MAX_HEADER_BYTES) return parse_error(p, 431);
+        return PARSE_INCOMPLETE;
     }
 }
 
 void parse_http_request(Connection* conn) {
-    // Check if request is complete (look for double CRLF)
-    size_t pos = conn->read_buffer.find("\r\n\r\n");
-    if (pos == std::string::npos) return; // not complete yet
+    ParseResult result = http_parse(&conn->parser, conn->read_buffer.data(),
+                                    conn->read_buffer.size(), &conn->request);
+    if (result == PARSE_INCOMPLETE) return;  // not complete yet
+
+    // Mark request as complete (or failed: parser.error_status says how)
+    conn->request_complete = true;
+}
 
-    // Extract the first line: "GET /path HTTP/1.1"
-    std::string request_line = conn->read_buffer.substr(0, conn->read_buffer.find("\r\n"));
-    std::istringstream iss(request_line);
-    iss >> conn->method >> conn->path;
+// ---------------------------------------------------------------------------
+// Response headers: constexpr tables, pooled fixed-size blocks, std::to_chars
+// ---------------------------------------------------------------------------
 
-    // Default to /index.html if root is requested
-    if (conn->path == "/") conn->path = "/index.html";
+struct StatusLine {
+    int status;
+    std::string_view line;
+};
 
-    // Mark request as complete
-    conn->request_complete = true;
+constexpr StatusLine status_lines[] = {
+    {200, "HTTP/1.1 200 OK\r\n"},
+    {206, "HTTP/1.1 206 Partial Content\r\n"},
+    {400, "HTTP/1.1 400 Bad Request\r\n"},
+    {404, "HTTP/1.1 404 Not Found\r\n"},
+    {413, "HTTP/1.1 413 Content Too Large\r\n"},
+    {414, "HTTP/1.1 414 URI Too Long\r\n"},
+    {416, "HTTP/1.1 416 Range Not Satisfiable\r\n"},
+    {431, "HTTP/1.1 431 Request Header Fields Too Large\r\n"},
+    {500, "HTTP/1.1 500 Internal Server Error\r\n"},
+    {501, "HTTP/1.1 501 Not Implemented\r\n"},
+    {505, "HTTP/1.1 505 HTTP Version Not Supported\r\n"},
+};
+
+constexpr std::string_view status_line(int status) {
+    for (const StatusLine& s : status_lines) {
+        if (s.status == status) return s.line;
+    }
+    return status_line(500);
 }
 
-void prepare_http_response(Connection* conn, const std::string& root_dir = "./www") {
-    std::string file_path = root_dir + conn->path;
-    std::ifstream file(file_path, std::ios::binary);
+// "404 Not Found": the status line without "HTTP/1.1 " and CRLF
+constexpr std::string_view status_text(int status) {
+    std::string_view line = status_line(status);
+    return line.substr(9, line.size() - 11);
+}
 
-    std::string body;
-    std::string status;
+static_assert(status_text(404) == "404 Not Found");
+static_assert(status_line(418) == status_line(500));
 
-    if (file) {
-        // File exists
-        status = "200 OK";
-        std::ostringstream oss;
-        oss << file.rdbuf();
-        body = oss.str();
-    } else {
-        // File not found
-        status = "404 Not Found";
-        body = "<html><body><h1>404 Not Found</h1></body></html>";
+// Request path -> file under root_dir: query dropped, "//" and "/./" collapsed,
+// "/" -> "/index.html". This is also the cache key, so one file has one spelling.
+// Returns false for paths that try to climb out of the root.
+bool resolve_path(std::string_view path, std::string_view root_dir, std::string* file_path) {
+    size_t query = path.find('?');
+    if (query != std::string_view::npos) path = path.substr(0, query);
+    if (path.find("/..") != std::string_view::npos) return false;
+
+    file_path->assign(root_dir);
+    for (size_t i = 0; i < path.size(); i++) {
+        if (path[i] == '/') {
+            if (i + 1 < path.size() && path[i + 1] == '/') continue;
+            if (i + 1 < path.size() && path[i + 1] == '.' && (i + 2 == path.size() || path[i + 2] == '/')) {
+                i++;
+                continue;
+            }
+        }
+        file_path->push_back(path[i]);
     }
+    if (file_path->size() == root_dir.size() || file_path->back() == '/') {
+        file_path->append(file_path->back() == '/' ? "index.html" : "/index.html");
+    }
+    return true;
+}
 
-    // Build HTTP response headers
-    std::ostringstream response;
-    response << "HTTP/1.1 " << status << "\r\n"
-             << "Content-Length: " << body.size() << "\r\n"
-             << "Content-Type: text/html\r\n"
-             << "Connection: close\r\n"
-             << "\r\n"
-             << body;
+struct MimeType {
+    std::string_view extension;
+    std::string_view type;
+};
 
-    conn->write_buffer = response.str();
-    conn->write_offset = 0;
-    conn->state = WRITING;
+constexpr MimeType mime_types[] = {
+    {".html", "text/html"},
+    {".htm", "text/html"},
+    {".css", "text/css"},
+    {".js", "application/javascript"},
+    {".json", "application/json"},
+    {".txt", "text/plain"},
+    {".svg", "image/svg+xml"},
+    {".png", "image/png"},
+    {".jpg", "image/jpeg"},
+    {".jpeg", "image/jpeg"},
+    {".gif", "image/gif"},
+    {".ico", "image/x-icon"},
+    {".webp", "image/webp"},
+    {".woff2", "font/woff2"},
+    {".wasm", "application/wasm"},
+    {".pdf", "application/pdf"},
+};
+
+constexpr std::string_view mime_type(std::string_view path) {
+    size_t dot = path.rfind('.');
+    if (dot == std::string_view::npos) return "application/octet-stream";
+    std::string_view extension = path.substr(dot);
+
+    for (const MimeType& m : mime_types) {
+        if (extension == m.extension) return m.type;
+    }
+    return "application/octet-stream";
 }
 
+static_assert(mime_type("./www/app.js") == "application/javascript");
 
-void close_connection(Connection* conn, int epoll_fd) {
-    if(epoll_ctl(epoll_fd, EPOLL_CTL_DEL, conn->fd, nullptr) == -1) {
-        perror("epoll del failed")
+enum Encoding : uint8_t {
+    ENCODING_IDENTITY,
+    ENCODING_GZIP,
+    ENCODING_BR,
+    ENCODING_COUNT
+};
+
+struct ContentCoding {
+    std::string_view name;    // Accept-Encoding / Content-Encoding token
+    std::string_view suffix;  // Precompressed sibling: "./www/app.js" + suffix
+};
+
+// Indexed by Encoding. Later entries win when the client takes several: brotli files are smaller.
+constexpr ContentCoding codings[] = {
+    {"identity", ""},
+    {"gzip", ".gz"},
+    {"br", ".br"},
+};
+
+static_assert(sizeof(codings) / sizeof(codings[0]) == ENCODING_COUNT);
+
+// Variant keys are the sibling's path + a NUL: open() stops at the NUL, and a request
+// for "/app.js.gz" itself still gets an identity entry of its own
+void variant_key(const std::string& path, Encoding encoding, std::string* key) {
+    key->assign(path);
+    key->append(codings[encoding].suffix);
+    key->push_back('\0');
+}
+
+// The path Content-Type comes from: "./www/app.js" for the key of app.js.gz
+constexpr std::string_view content_path(std::string_view key, Encoding encoding) {
+    if (encoding == ENCODING_IDENTITY) return key;
+    return key.substr(0, key.size() - 1 - codings[encoding].suffix.size());
+}
+
+static_assert(content_path(std::string_view("./www/app.js.br\0", 16), ENCODING_BR) == "./www/app.js");
+
+// Fixed-capacity append-only formatter over caller-owned memory. Everything written
+// into it is bounded (numbers, table entries, dates), so running out is a bug.
+struct HeaderWriter {
+    char* data;
+    size_t capacity;
+    size_t size = 0;
+
+    void append(std::string_view s) {
+        size_t n = std::min(s.size(), capacity - size);
+        memcpy(data + size, s.data(), n);
+        size += n;
     }
 
-    close(conn->fd);
-    connections.erase(conn);
-    delete conn;
-}
\ No newline at end of file
+    void append_number(uint64_t value, int base = 10) {
+        std::to_chars_result r = std::to_chars(data + size, data + capacity, value, base);
+        if (r.ec == std::errc()) size = r.ptr - data;
+    }
+
+    std::string_view view() const { return std::string_view(data, size); }
+};
+
+struct HeaderBlock {
+    HeaderBlock* next;  // Free list link
+    char data[HEADER_BLOCK_SIZE];
+};
+
+HeaderBlock* free_header_blocks = nullptr;
+
+// Allocates only until the pool has as many blocks as responses ever in flight at once
+HeaderBlock* acquire_header_block() {
+    HeaderBlock* block = free_header_blocks;
+    if (!block) return new HeaderBlock;
+    free_header_blocks = block->next;
+    return block;
+}
+
+void release_header_block(HeaderBlock* block) {
+    block->next = free_header_blocks;
+    free_header_blocks = block;
+}
+
+struct BodyBlock {
+    BodyBlock* next;
+    char data[BODY_BLOCK_SIZE];
+};
+
+BodyBlock* free_body_blocks = nullptr;
+
+BodyBlock* acquire_body_block() {
+    BodyBlock* block = free_body_blocks;
+    if (!block) return new BodyBlock;
+    free_body_blocks = block->next;
+    return block;
+}
+
+void release_body_block(BodyBlock* block) {
+    block->next = free_body_blocks;
+    free_body_blocks = block;
+}
+
+// The response's own block, written from the start
+HeaderWriter begin_header_block(Connection* conn) {
+    if (!conn->head) conn->head = acquire_header_block();
+    return HeaderWriter{conn->head->data, HEADER_BLOCK_SIZE};
+}
+
+constexpr std::string_view day_names[] = {"Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"};
+constexpr std::string_view month_names[] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun",
+                                            "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+
+static void append_two_digits(HeaderWriter* w, int value) {
+    char digits[2] = {(char)('0' + value / 10), (char)('0' + value % 10)};
+    w->append(std::string_view(digits, 2));
+}
+
+// IMF-fixdate, "Sun, 06 Nov 1994 08:49:37 GMT": always 29 bytes, no locale involved
+void append_http_date(HeaderWriter* w, time_t t) {
+    struct tm tm;
+    gmtime_r(&t, &tm);
+
+    w->append(day_names[tm.tm_wday]);
+    w->append(", ");
+    append_two_digits(w, tm.tm_mday);
+    w->append(" ");
+    w->append(month_names[tm.tm_mon]);
+    w->append(" ");
+    w->append_number(tm.tm_year + 1900);
+    w->append(" ");
+    append_two_digits(w, tm.tm_hour);
+    w->append(":");
+    append_two_digits(w, tm.tm_min);
+    w->append(":");
+    append_two_digits(w, tm.tm_sec);
+    w->append(" GMT");
+}
+
+// "Date: ...\r\n" rendered once per second, copied into every response
+struct DateHeader {
+    time_t second = -1;
+    char line[64];
+    size_t length = 0;
+};
+
+DateHeader date_header;
+
+void refresh_date_header() {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+    if (ts.tv_sec == date_header.second) return;
+
+    HeaderWriter w{date_header.line, sizeof(date_header.line)};
+    w.append("Date: ");
+    append_http_date(&w, ts.tv_sec);
+    w.append("\r\n");
+    date_header.second = ts.tv_sec;
+    date_header.length = w.size;
+}
+
+// Status line + entity headers of a 200 for this file. Date, Connection and the
+// blank line come from end_headers(): a cached block serves every response.
+// Same shape as nginx: "<mtime hex>-<size hex>"
+void append_etag(HeaderWriter* w, const struct stat& st) {
+    w->append("\"");
+    w->append_number(st.st_mtime, 16);
+    w->append("-");
+    w->append_number(st.st_size, 16);
+    w->append("\"");
+}
+
+// What the asset cache and the fd cache both keep for one file, apart from the body
+struct Representation {
+    std::string key;     // Normalized file path, or variant_key() for a precompressed sibling
+    struct stat st;
+    std::string header;  // Pre-rendered 200 header block, minus Date and Connection
+    Encoding encoding;
+    uint8_t siblings;    // Identity only: bit per Encoding that has a precompressed file next to it
+};
+
+// Content-Encoding, Vary, ETag and Last-Modified, shared by 200 and 206 responses
+void write_representation_headers(HeaderWriter* w, const Representation& r) {
+    if (r.encoding != ENCODING_IDENTITY) {
+        w->append("\r\nContent-Encoding: ");
+        w->append(codings[r.encoding].name);
+    }
+    if (r.encoding != ENCODING_IDENTITY || r.siblings) {
+        w->append("\r\nVary: Accept-Encoding");  // Shared caches must key on it too
+    }
+    w->append("\r\nETag: ");
+    append_etag(w, r.st);
+    w->append("\r\nLast-Modified: ");
+    append_http_date(w, r.st.st_mtime);
+    w->append("\r\n");
+}
+
+void write_file_headers(HeaderWriter* w, const Representation& r) {
+    w->append(status_line(200));
+    w->append("Content-Length: ");
+    w->append_number(r.st.st_size);
+    w->append("\r\nContent-Type: ");
+    w->append(mime_type(content_path(r.key, r.encoding)));
+    w->append("\r\nAccept-Ranges: bytes");
+    write_representation_headers(w, r);
+}
+
+// key, st, encoding and siblings set: render the 200 header block from them
+void render_representation(Representation* r) {
+    char header[HEADER_BLOCK_SIZE];
+    HeaderWriter w{header, sizeof(header)};
+    write_file_headers(&w, *r);
+    r->header.assign(w.view());
+}
+
+// Per-response tail of the header block: Date, Connection and the blank line
+void end_headers(HeaderWriter* w, bool keep_alive) {
+    w->append(std::string_view(date_header.line, date_header.length));
+    w->append(keep_alive ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n");
+}
+
+// ---------------------------------------------------------------------------
+// Static asset cache
+// ---------------------------------------------------------------------------
+
+// One cached file: the complete 200 response, ready for writev
+struct CacheEntry : Representation {
+    std::string body;
+    CacheEntry* prev;    // LRU list, most recently used first
+    CacheEntry* next;
+    int refs;            // 1 for the cache itself + 1 per response in flight
+};
+
+struct AssetCache {
+    std::unordered_map<std::string, CacheEntry*> entries;
+    CacheEntry* lru_head = nullptr;
+    CacheEntry* lru_tail = nullptr;
+    size_t bytes = 0;
+    size_t capacity = CACHE_MAX_BYTES;
+    int inotify_fd = -1;
+    std::unordered_map<int, std::string> watches;  // inotify wd -> watched directory
+    uint64_t epoch = 0;  // Bumped by every inotify event: files read before may be stale
+};
+
+AssetCache cache;
+
+// An open file on the sendfile path, with the 200 headers rendered from its stat
+struct FileHandle : Representation {
+    int fd;
+    uint64_t opened_ms;  // now_ms at open, for the TTL
+    FileHandle* prev;    // LRU list while cached, most recently used first
+    FileHandle* next;
+    int refs;            // 1 while cached + 1 per response (or readahead job) using fd
+};
+
+struct FdCache {
+    std::unordered_map<std::string, FileHandle*> handles;
+    FileHandle* lru_head = nullptr;
+    FileHandle* lru_tail = nullptr;
+    size_t capacity = FD_CACHE_MAX;     // Handles, 0 = every response opens its own
+    uint64_t ttl_ms = FD_CACHE_TTL_MS;  // Reopen after this long even without an event, 0 = never
+};
+
+FdCache fd_cache;
+
+// Without inotify a cached file could go stale forever: no inotify, no asset cache.
+// The fd cache still works if it has a TTL to bound the staleness.
+void cache_init(size_t capacity) {
+    cache.capacity = capacity;
+    if (capacity == 0 && fd_cache.capacity == 0) return;
+
+    cache.inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (cache.inotify_fd == -1) {
+        perror("inotify_init1 failed, asset cache disabled");
+        cache.capacity = 0;
+    }
+}
+
+static size_t entry_size(const CacheEntry* entry) {
+    return sizeof(CacheEntry) + entry->key.size() + entry->header.size() + entry->body.size();
+}
+
+static void lru_unlink(CacheEntry* entry) {
+    if (entry->prev) entry->prev->next = entry->next;
+    else cache.lru_head = entry->next;
+    if (entry->next) entry->next->prev = entry->prev;
+    else cache.lru_tail = entry->prev;
+}
+
+static void lru_push_front(CacheEntry* entry) {
+    entry->prev = nullptr;
+    entry->next = cache.lru_head;
+    if (cache.lru_head) cache.lru_head->prev = entry;
+    cache.lru_head = entry;
+    if (!cache.lru_tail) cache.lru_tail = entry;
+}
+
+void cache_release(CacheEntry* entry) {
+    if (--entry->refs == 0) delete entry;
+}
+
+// Evicted or invalidated: gone from the cache, freed once no response uses it
+void cache_remove(CacheEntry* entry) {
+    cache.entries.erase(entry->key);
+    lru_unlink(entry);
+    cache.bytes -= entry_size(entry);
+    cache_release(entry);
+}
+
+CacheEntry* cache_lookup(const std::string& key) {
+    auto it = cache.entries.find(key);
+    if (it == cache.entries.end()) return nullptr;
+
+    CacheEntry* entry = it->second;
+    if (cache.lru_head != entry) {
+        lru_unlink(entry);
+        lru_push_front(entry);
+    }
+    return entry;
+}
+
+// Watch the directory of `key` before its file is read, so a change racing with the
+// read still invalidates. Only makes a syscall: safe to call from an I/O worker.
+int cache_watch_directory(const std::string& key) {
+    std::string dir = key.substr(0, key.rfind('/'));
+    return inotify_add_watch(cache.inotify_fd, dir.c_str(),
+                             IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB | IN_DELETE | IN_MOVED_FROM |
+                             IN_MOVED_TO | IN_CREATE | IN_DELETE_SELF | IN_MOVE_SELF);
+}
+
+// Keep the whole response for a file read after cache_watch_directory() returned wd.
+// nullptr = serve it uncached.
+CacheEntry* cache_insert(const std::string& key, int wd, const struct stat& st, Encoding encoding,
+                         uint8_t siblings, std::string&& body) {
+    if (cache.capacity == 0 || wd == -1) return nullptr;
+    cache.watches[wd] = key.substr(0, key.rfind('/'));
+
+    // Another miss for the same file got here first
+    CacheEntry* entry = cache_lookup(key);
+    if (entry) return entry;
+
+    entry = new CacheEntry;
+    entry->key = key;
+    entry->st = st;
+    entry->encoding = encoding;
+    entry->siblings = siblings;
+    render_representation(entry);
+    entry->body = std::move(body);
+    entry->refs = 1;
+
+    size_t size = entry_size(entry);
+    if (size > cache.capacity) {
+        delete entry;
+        return nullptr;
+    }
+    while (cache.bytes + size > cache.capacity) {
+        cache_remove(cache.lru_tail);
+    }
+
+    cache.entries[key] = entry;
+    lru_push_front(entry);
+    cache.bytes += size;
+    return entry;
+}
+
+void cache_clear() {
+    while (cache.lru_head) cache_remove(cache.lru_head);
+}
+
+// ---------------------------------------------------------------------------
+// Open file cache: fds kept across requests for the sendfile path
+// ---------------------------------------------------------------------------
+
+FileHandle* new_file_handle(const std::string& key, int fd, const struct stat& st, Encoding encoding,
+                            uint8_t siblings) {
+    FileHandle* file = new FileHandle;
+    file->key = key;
+    file->st = st;
+    file->encoding = encoding;
+    file->siblings = siblings;
+    render_representation(file);
+    file->fd = fd;
+    file->opened_ms = now_ms;
+    file->refs = 0;
+    return file;
+}
+
+void file_release(FileHandle* file) {
+    if (--file->refs == 0) {
+        close(file->fd);
+        count_file_syscalls(1);
+        delete file;
+    }
+}
+
+static void file_lru_unlink(FileHandle* file) {
+    if (file->prev) file->prev->next = file->next;
+    else fd_cache.lru_head = file->next;
+    if (file->next) file->next->prev = file->prev;
+    else fd_cache.lru_tail = file->prev;
+}
+
+static void file_lru_push_front(FileHandle* file) {
+    file->prev = nullptr;
+    file->next = fd_cache.lru_head;
+    if (fd_cache.lru_head) fd_cache.lru_head->prev = file;
+    fd_cache.lru_head = file;
+    if (!fd_cache.lru_tail) fd_cache.lru_tail = file;
+}
+
+// Evicted or invalidated: closed once no response is streaming from it
+void fd_cache_remove(FileHandle* file) {
+    fd_cache.handles.erase(file->key);
+    file_lru_unlink(file);
+    file_release(file);
+}
+
+// nullptr on a miss, or when the handle outlived the TTL and has to be reopened
+FileHandle* fd_cache_lookup(const std::string& key) {
+    auto it = fd_cache.handles.find(key);
+    if (it == fd_cache.handles.end()) return nullptr;
+
+    FileHandle* file = it->second;
+    if (fd_cache.ttl_ms > 0 && now_ms - file->opened_ms >= fd_cache.ttl_ms) {
+        fd_cache_remove(file);
+        return nullptr;
+    }
+    if (fd_cache.lru_head != file) {
+        file_lru_unlink(file);
+        file_lru_push_front(file);
+    }
+    return file;
+}
+
+// Keep a file opened after cache_watch_directory() returned wd (-1: not watched)
+void fd_cache_insert(FileHandle* file, int wd) {
+    if (fd_cache.capacity == 0 || (wd == -1 && fd_cache.ttl_ms == 0)) return;
+    if (wd != -1) cache.watches[wd] = file->key.substr(0, file->key.rfind('/'));
+
+    // Another miss for the same file got here first: this handle is the newer one
+    auto it = fd_cache.handles.find(file->key);
+    if (it != fd_cache.handles.end()) fd_cache_remove(it->second);
+    while (fd_cache.handles.size() >= fd_cache.capacity) {
+        fd_cache_remove(fd_cache.lru_tail);
+    }
+
+    file->refs++;
+    fd_cache.handles[file->key] = file;
+    file_lru_push_front(file);
+}
+
+void fd_cache_clear() {
+    while (fd_cache.lru_head) fd_cache_remove(fd_cache.lru_head);
+}
+
+void invalidate_key(const std::string& key) {
+    auto it = cache.entries.find(key);
+    if (it != cache.entries.end()) cache_remove(it->second);
+    auto handle = fd_cache.handles.find(key);
+    if (handle != fd_cache.handles.end()) fd_cache_remove(handle->second);
+}
+
+// Something changed under a watched directory: drop what it touched from both caches
+void cache_handle_inotify() {
+    alignas(struct inotify_event) char buffer[4096];
+
+    while (true) {
+        ssize_t len = read(cache.inotify_fd, buffer, sizeof(buffer));
+        if (len <= 0) break;  // EAGAIN: all events handled
+
+        for (char* p = buffer; p < buffer + len; ) {
+            struct inotify_event* event = (struct inotify_event*)p;
+            p += sizeof(struct inotify_event) + event->len;
+            cache.epoch++;  // Even for a wd the loop hasn't recorded yet: a worker may have just added it
+
+            if (event->mask & IN_Q_OVERFLOW) {
+                cache_clear();  // Events were lost, anything may be stale
+                fd_cache_clear();
+                continue;
+            }
+
+            auto watch = cache.watches.find(event->wd);
+            if (watch == cache.watches.end()) continue;
+
+            if (event->mask & (IN_IGNORED | IN_DELETE_SELF | IN_MOVE_SELF)) {
+                // The directory itself went away: its files can't be told apart cheaply
+                if (event->mask & IN_IGNORED) cache.watches.erase(watch);
+                cache_clear();
+                fd_cache_clear();
+                continue;
+            }
+
+            if (event->len == 0) continue;
+            std::string key = watch->second + "/" + event->name;
+            invalidate_key(key);
+
+            // A precompressed sibling: its variant, and the identity whose siblings bitmask it's in
+            for (int e = ENCODING_GZIP; e < ENCODING_COUNT; e++) {
+                std::string_view suffix = codings[e].suffix;
+                if (key.size() <= suffix.size() || key.compare(key.size() - suffix.size(), suffix.size(), suffix) != 0) {
+                    continue;
+                }
+                invalidate_key(key + '\0');
+                invalidate_key(key.substr(0, key.size() - suffix.size()));
+            }
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Range requests: 206 for one range, multipart/byteranges for several, 416 for none
+// ---------------------------------------------------------------------------
+
+struct ByteRange {
+    off_t first;
+    off_t last;  // Inclusive, as in Content-Range
+};
+
+enum RangeSpec {
+    RANGE_END,      // List exhausted
+    RANGE_INVALID,  // Malformed: the whole Range header is ignored
+    RANGE_SKIP,     // Well-formed but outside the file
+    RANGE_FOUND
+};
+
+static std::string_view trim_whitespace(std::string_view s) {
+    while (!s.empty() && (s.front() == ' ' || s.front() == '\t')) s.remove_prefix(1);
+    while (!s.empty() && (s.back() == ' ' || s.back() == '\t')) s.remove_suffix(1);
+    return s;
+}
+
+static bool parse_offset(std::string_view s, off_t* out) {
+    if (s.empty() || s[0] < '0' || s[0] > '9') return false;  // from_chars would take a '-'
+    std::from_chars_result r = std::from_chars(s.data(), s.data() + s.size(), *out);
+    return r.ec == std::errc() && r.ptr == s.data() + s.size();
+}
+
+// Take one range-spec off the front of a "bytes=" list, clamped to a file of `size` bytes
+RangeSpec next_range_spec(std::string_view* list, off_t size, ByteRange* out) {
+    while (!list->empty()) {
+        size_t comma = list->find(',');
+        std::string_view spec = trim_whitespace(list->substr(0, comma));
+        *list = comma == std::string_view::npos ? std::string_view() : list->substr(comma + 1);
+        if (spec.empty()) continue;  // "0-1, ,5-6": empty list elements are allowed
+
+        size_t dash = spec.find('-');
+        if (dash == std::string_view::npos) return RANGE_INVALID;
+
+        off_t first, last;
+        if (dash == 0) {
+            // "-n": the last n bytes
+            if (!parse_offset(spec.substr(1), &last)) return RANGE_INVALID;
+            if (last == 0 || size == 0) return RANGE_SKIP;
+            out->first = last >= size ? 0 : size - last;
+            out->last = size - 1;
+            return RANGE_FOUND;
+        }
+
+        if (!parse_offset(spec.substr(0, dash), &first)) return RANGE_INVALID;
+        if (dash + 1 == spec.size()) {
+            last = size - 1;  // "a-": to the end
+        } else if (!parse_offset(spec.substr(dash + 1), &last) || last < first) {
+            return RANGE_INVALID;
+        }
+        if (first >= size) return RANGE_SKIP;
+        out->first = first;
+        out->last = std::min(last, size - 1);
+        return RANGE_FOUND;
+    }
+    return RANGE_END;
+}
+
+// Satisfiable ranges in the list, the first one in *first. -1 = ignore the header
+// and send everything: malformed, empty, or more than MAX_RANGES specs.
+int count_ranges(std::string_view list, off_t size, ByteRange* first) {
+    int specs = 0;
+    int found = 0;
+    ByteRange range;
+
+    while (true) {
+        RangeSpec result = next_range_spec(&list, size, &range);
+        if (result == RANGE_END) break;
+        if (result == RANGE_INVALID || ++specs > MAX_RANGES) return -1;
+        if (result == RANGE_FOUND && found++ == 0) *first = range;
+    }
+    return specs == 0 ? -1 : found;
+}
+
+// If-Range: the ranges only apply to the representation the client already has part of
+static bool if_range_matches(std::string_view condition, const struct stat& st) {
+    char buffer[64];
+    HeaderWriter w{buffer, sizeof(buffer)};
+    if (condition.front() == '"') {
+        append_etag(&w, st);
+    } else {
+        append_http_date(&w, st.st_mtime);
+    }
+    return condition == w.view();
+}
+
+// The range list of a GET with "Range: bytes=...", false if there is none to honor
+static bool requested_ranges(const HttpRequest* req, const struct stat& st, std::string_view* list) {
+    if (req->method != "GET") return false;
+    std::string_view value = find_header(req, "range");
+    if (value.size() < 6 || !equals_lowercase(value.substr(0, 6), "bytes=")) return false;
+
+    std::string_view condition = find_header(req, "if-range");
+    if (!condition.empty() && !if_range_matches(condition, st)) return false;
+
+    *list = value.substr(6);
+    return true;
+}
+
+static void append_content_range(HeaderWriter* w, const ByteRange& range, off_t size) {
+    w->append("bytes ");
+    w->append_number(range.first);
+    w->append("-");
+    w->append_number(range.last);
+    w->append("/");
+    w->append_number(size);
+}
+
+// Unique enough per file version, and never changes while the response is out
+static void append_boundary(HeaderWriter* w, const struct stat& st) {
+    w->append("byteranges_");
+    w->append_number(st.st_ino, 16);
+    w->append("_");
+    w->append_number(st.st_mtime, 16);
+}
+
+static void write_part_header(HeaderWriter* w, const Representation& r, const ByteRange& range) {
+    w->append("\r\n--");
+    append_boundary(w, r.st);
+    w->append("\r\nContent-Type: ");
+    w->append(mime_type(content_path(r.key, r.encoding)));
+    w->append("\r\nContent-Range: ");
+    append_content_range(w, range, r.st.st_size);
+    w->append("\r\n\r\n");
+}
+
+static void write_closing_delimiter(HeaderWriter* w, const struct stat& st) {
+    w->append("\r\n--");
+    append_boundary(w, st);
+    w->append("--\r\n");
+}
+
+// Body = [first, last] of the cached entry (a slice, no copy) or of the open file (sendfile)
+static void set_body_range(Connection* conn, const ByteRange& range) {
+    if (conn->cached) {
+        std::string_view body = conn->cached->body;
+        conn->parts[conn->part_count++] = body.substr(range.first, range.last + 1 - range.first);
+        return;
+    }
+    conn->file_fd = conn->file->fd;
+    conn->file_offset = range.first;
+    conn->file_end = range.last + 1;
+    conn->file_ready = range.first;
+}
+
+// Multipart: header of the next satisfiable range (checked by count_ranges), then its body
+static void start_range_part(Connection* conn, HeaderWriter* w, const Representation& r) {
+    ByteRange range;
+    while (next_range_spec(&conn->range_list, r.st.st_size, &range) != RANGE_FOUND) {}
+    write_part_header(w, r, range);
+    conn->parts[0] = w->view();
+    conn->part_count = 1;
+    set_body_range(conn, range);
+}
+
+// Previous part sent: the next one, or the closing delimiter after the last
+void next_range_segment(Connection* conn) {
+    const Representation& r = conn->cached ? static_cast<const Representation&>(*conn->cached) : *conn->file;
+
+    HeaderWriter w = begin_header_block(conn);  // Its previous contents are all sent
+    conn->write_offset = 0;
+    if (--conn->range_segments_left > 0) {
+        start_range_part(conn, &w, r);
+        return;
+    }
+    write_closing_delimiter(&w, r.st);
+    conn->parts[0] = w.view();
+    conn->part_count = 1;
+}
+
+// Response for the cached entry or open file already in conn->cached / conn->file:
+// the pre-rendered 200 for the whole file, or whatever the Range header selects
+void start_file_response(Connection* conn, const Representation& r) {
+    const struct stat& st = r.st;
+    HeaderWriter w = begin_header_block(conn);
+    conn->part_count = 0;
+    conn->write_offset = 0;
+    conn->state = WRITING;
+
+    std::string_view list;
+    ByteRange first;
+    int count = requested_ranges(&conn->request, st, &list) ? count_ranges(list, st.st_size, &first) : -1;
+
+    if (count == -1) {
+        end_headers(&w, conn->keep_alive);
+        conn->parts[0] = r.header;
+        conn->parts[1] = w.view();
+        conn->part_count = 2;
+        set_body_range(conn, {0, st.st_size - 1});
+        return;
+    }
+
+    if (count == 0) {
+        w.append(status_line(416));
+        w.append("Content-Length: 0\r\nContent-Range: bytes */");
+        w.append_number(st.st_size);
+        w.append("\r\n");
+        end_headers(&w, conn->keep_alive);
+        conn->parts[0] = w.view();
+        conn->part_count = 1;
+        return;
+    }
+
+    w.append(status_line(206));
+    if (count == 1) {
+        w.append("Content-Length: ");
+        w.append_number(first.last + 1 - first.first);
+        w.append("\r\nContent-Type: ");
+        w.append(mime_type(content_path(r.key, r.encoding)));
+        w.append("\r\nContent-Range: ");
+        append_content_range(&w, first, st.st_size);
+        write_representation_headers(&w, r);
+        end_headers(&w, conn->keep_alive);
+        conn->parts[0] = w.view();
+        conn->part_count = 1;
+        set_body_range(conn, first);
+        return;
+    }
+
+    // Content-Length covers every part header: render each once to measure it
+    char scratch[HEADER_BLOCK_SIZE];
+    HeaderWriter m{scratch, sizeof(scratch)};
+    write_closing_delimiter(&m, st);
+    off_t length = m.size;
+    std::string_view rest = list;
+    ByteRange range;
+    for (int i = 0; i < count; ) {
+        if (next_range_spec(&rest, st.st_size, &range) != RANGE_FOUND) continue;
+        m.size = 0;
+        write_part_header(&m, r, range);
+        length += m.size + range.last + 1 - range.first;
+        i++;
+    }
+
+    w.append("Content-Length: ");
+    w.append_number(length);
+    w.append("\r\nContent-Type: multipart/byteranges; boundary=");
+    append_boundary(&w, st);
+    write_representation_headers(&w, r);
+    end_headers(&w, conn->keep_alive);
+
+    conn->range_list = list;
+    conn->range_segments_left = count;  // count - 1 more parts, then the closing delimiter
+    start_range_part(conn, &w, r);  // First part header shares the block with the headers
+}
+
+// Straight from the cache entry: no filesystem syscalls
+void serve_cached(Connection* conn, CacheEntry* entry) {
+    entry->refs++;
+    conn->cached = entry;
+    start_file_response(conn, *entry);
+}
+
+// Headers from the handle, body with sendfile(): no open/fstat/close if the handle was cached
+void serve_file(Connection* conn, FileHandle* file) {
+    file->refs++;
+    conn->file = file;
+    start_file_response(conn, *file);
+}
+
+// Headers and the small HTML page share one block
+void prepare_error_response(Connection* conn, int status) {
+    constexpr std::string_view page_start = "<html><body><h1>";
+    constexpr std::string_view page_end = "</h1></body></html>";
+    std::string_view text = status_text(status);
+
+    HeaderWriter w = begin_header_block(conn);
+    w.append(status_line(status));
+    w.append("Content-Length: ");
+    w.append_number(page_start.size() + text.size() + page_end.size());
+    w.append("\r\nContent-Type: text/html\r\n");
+    end_headers(&w, conn->keep_alive);
+    w.append(page_start);
+    w.append(text);
+    w.append(page_end);
+
+    conn->parts[0] = w.view();
+    conn->part_count = 1;
+    conn->write_offset = 0;
+    conn->state = WRITING;
+}
+
+// ---------------------------------------------------------------------------
+// Disk I/O offload: worker threads run IoJobs, the loop picks up the results
+// ---------------------------------------------------------------------------
+
+enum IoJobType {
+    IO_OPEN,       // open + fstat, small files also read whole for the cache
+    IO_READAHEAD   // pull [offset, offset + length) of file_fd into the page cache
+};
+
+struct IoJob {
+    IoJobType type;
+    Connection* conn;
+    bool orphaned = false;  // Connection closed meanwhile. Loop thread only, workers never look.
+    uint64_t epoch;         // cache.epoch at submit
+    std::string path;       // IO_OPEN: cache key, also what's opened (variant keys end in a NUL)
+    Encoding encoding = ENCODING_IDENTITY;  // IO_OPEN: what path is
+    int file_fd = -1;       // IO_OPEN result, IO_READAHEAD input
+    FileHandle* file = nullptr;  // IO_READAHEAD: reference that keeps file_fd open meanwhile
+    off_t offset = 0;
+    size_t length = 0;
+    int error = 0;          // IO_OPEN: errno, or ENOENT for something that isn't a regular file
+    struct stat st;
+    int watch = -1;         // IO_OPEN: inotify wd of the file's directory, -1 if not watched
+    bool loaded = false;    // IO_OPEN: body holds the whole file, for the asset cache
+    uint8_t siblings = 0;   // IO_OPEN of an identity: precompressed siblings found next to it
+    std::string body;
+};
+
+struct IoPool {
+    std::vector<std::thread> threads;
+    std::mutex submit_mutex;
+    std::condition_variable submit_cv;
+    std::deque<IoJob*> submitted;
+    std::mutex done_mutex;
+    std::vector<IoJob*> done;
+    int event_fd = -1;
+};
+
+IoPool io_pool;
+
+static bool read_whole_file(int fd, size_t size, std::string* out) {
+    out->resize(size);
+    size_t done = 0;
+    while (done < size) {
+        ssize_t n = pread(fd, &(*out)[done], size - done, done);
+        if (n <= 0) return false;  // Shrank or failed under us: not worth caching
+        done += n;
+    }
+    return true;
+}
+
+// The blocking part of a job: runs on a worker (or inline with --io-threads 0)
+void run_io_job(IoJob* job) {
+    if (job->type == IO_OPEN) {
+        job->file_fd = open(job->path.c_str(), O_RDONLY | O_CLOEXEC);
+        count_file_syscalls(1);
+        if (job->file_fd == -1) {
+            job->error = errno;
+            return;
+        }
+        count_file_syscalls(1);
+        if (fstat(job->file_fd, &job->st) == -1 || !S_ISREG(job->st.st_mode)) {
+            close(job->file_fd);
+            count_file_syscalls(1);
+            job->file_fd = -1;
+            job->error = ENOENT;
+            return;
+        }
+
+        // Watched before reading: a change racing with the read still invalidates
+        bool small = cache.capacity > 0 && job->st.st_size <= CACHE_MAX_FILE;
+        if (cache.inotify_fd != -1 && (small || fd_cache.capacity > 0)) {
+            job->watch = cache_watch_directory(job->path);
+            count_file_syscalls(1);
+        }
+
+        // Small file: read it once, every later request is a cache hit
+        if (small && job->watch != -1) {
+            job->loaded = read_whole_file(job->file_fd, job->st.st_size, &job->body);
+        }
+
+        // Which precompressed siblings exist: cached with the identity, so negotiation is free later
+        if (job->encoding == ENCODING_IDENTITY) {
+            for (int e = ENCODING_GZIP; e < ENCODING_COUNT; e++) {
+                std::string sibling = job->path + std::string(codings[e].suffix);
+                struct stat st;
+                count_file_syscalls(1);
+                if (stat(sibling.c_str(), &st) == 0 && S_ISREG(st.st_mode)) job->siblings |= 1 << e;
+            }
+        }
+        return;
+    }
+
+    // readahead() may just queue the I/O: reading the window is what makes it resident
+    thread_local std::vector<char> scratch(SENDFILE_CHUNK);
+    size_t done = 0;
+    while (done < job->length) {
+        ssize_t n = pread(job->file_fd, scratch.data(), std::min(job->length - done, scratch.size()),
+                          job->offset + done);
+        if (n <= 0) break;  // sendfile() will see the same problem and report it
+        done += n;
+    }
+}
+
+void io_worker() {
+    while (true) {
+        IoJob* job;
+        {
+            std::unique_lock<std::mutex> lock(io_pool.submit_mutex);
+            io_pool.submit_cv.wait(lock, [] { return !io_pool.submitted.empty(); });
+            job = io_pool.submitted.front();
+            io_pool.submitted.pop_front();
+        }
+
+        run_io_job(job);
+
+        bool was_empty;
+        {
+            std::lock_guard<std::mutex> lock(io_pool.done_mutex);
+            was_empty = io_pool.done.empty();
+            io_pool.done.push_back(job);
+        }
+        // One wakeup per batch: the loop takes the whole list on each eventfd read
+        if (was_empty) {
+            uint64_t one = 1;
+            ssize_t ignored = write(io_pool.event_fd, &one, sizeof(one));
+            (void)ignored;
+        }
+    }
+}
+
+bool start_io_pool(int threads) {
+    if (threads <= 0) return true;
+
+    io_pool.event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (io_pool.event_fd == -1) {
+        perror("eventfd failed");
+        return false;
+    }
+    for (int i = 0; i < threads; i++) {
+        io_pool.threads.emplace_back(io_worker);
+    }
+    return true;
+}
+
+void complete_io_job(IoJob* job);
+
+// Hand the job to a worker; without workers run it here and finish it right away
+void submit_io_job(Connection* conn, IoJob* job) {
+    job->conn = conn;
+    job->epoch = cache.epoch;
+    conn->io_job = job;
+
+    if (io_pool.threads.empty()) {
+        run_io_job(job);
+        complete_io_job(job);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(io_pool.submit_mutex);
+        io_pool.submitted.push_back(job);
+    }
+    io_pool.submit_cv.notify_one();
+}
+
+void orphan_io_job(IoJob* job) {
+    job->orphaned = true;
+}
+
+// Window [file_ready, +send_window) resident already? Checked at both ends, which
+// is what sequential readahead leaves behind. RWF_NOWAIT fails instead of reading.
+static bool window_cached(int fd, off_t offset, size_t length) {
+    char byte;
+    struct iovec iov = {&byte, 1};
+    return preadv2(fd, &iov, 1, offset, RWF_NOWAIT) == 1 &&
+           preadv2(fd, &iov, 1, offset + length - 1, RWF_NOWAIT) == 1;
+}
+
+// Keep file_ready one window ahead of what's been sent, without waiting on the disk
+void prefetch_file(Connection* conn) {
+    if (io_pool.threads.empty()) {
+        conn->file_ready = conn->file_end;  // Inline mode: sendfile() does its own reads
+        return;
+    }
+
+    while (!conn->io_job && conn->file_ready < conn->file_end &&
+           conn->file_ready - conn->file_offset < config.send_window) {
+        size_t window = std::min(config.send_window, conn->file_end - conn->file_ready);
+        if (window_cached(conn->file_fd, conn->file_ready, window)) {
+            conn->file_ready += window;
+            continue;
+        }
+
+        IoJob* job = new IoJob;
+        job->type = IO_READAHEAD;
+        job->file = conn->file;
+        job->file->refs++;
+        job->file_fd = conn->file_fd;
+        job->offset = conn->file_ready;
+        job->length = window;
+        submit_io_job(conn, job);
+    }
+}
+
+bool serve_variant(Connection* conn, const std::string& path, uint8_t siblings);
+void serve_static(Connection* conn, const std::string& path);
+
+// Whole response straight from the cache entry or an open file
+void apply_open_result(Connection* conn, IoJob* job) {
+    if (job->error) {
+        if (job->encoding != ENCODING_IDENTITY) {
+            // Sibling removed since the identity was looked at: send the identity after all
+            conn->accepted_encodings = 0;
+            serve_static(conn, std::string(content_path(job->path, job->encoding)));
+            return;
+        }
+        prepare_error_response(conn, 404);
+        return;
+    }
+
+    // Cache it only if nothing in any watched directory changed since the lookup missed
+    bool fresh = job->epoch == cache.epoch;
+    CacheEntry* entry = nullptr;
+    FileHandle* file = nullptr;
+    if (job->loaded && fresh) {
+        entry = cache_insert(job->path, job->watch, job->st, job->encoding, job->siblings, std::move(job->body));
+    }
+    if (entry) {
+        close(job->file_fd);
+        count_file_syscalls(1);
+    } else {
+        file = new_file_handle(job->path, job->file_fd, job->st, job->encoding, job->siblings);
+        file->refs++;  // Until this function is done with it
+        if (fresh) fd_cache_insert(file, job->watch);
+    }
+
+    if (job->encoding != ENCODING_IDENTITY) stats.precompressed++;
+
+    // First look at this identity, and the client takes one of the siblings it turned up
+    if (job->encoding == ENCODING_IDENTITY && serve_variant(conn, job->path, job->siblings)) {
+        // Identity stays cached for the next request
+    } else if (entry) {
+        serve_cached(conn, entry);
+    } else {
+        serve_file(conn, file);
+        if (job->loaded) conn->file_ready = conn->file_end;  // Just read whole: it's resident
+    }
+    if (file) file_release(file);
+}
+
+void process_connection(Connection* conn, int epoll_fd);
+
+// Loop side of a finished job
+void complete_io_job(IoJob* job) {
+    Connection* conn = job->conn;
+
+    if (job->orphaned) {
+        if (job->file) {
+            file_release(job->file);
+        } else if (job->file_fd != -1) {
+            close(job->file_fd);  // Opened for nobody
+            count_file_syscalls(1);
+        }
+        delete job;
+        return;
+    }
+
+    conn->io_job = nullptr;
+    if (job->type == IO_OPEN) {
+        apply_open_result(conn, job);
+    } else {
+        conn->file_ready = job->offset + job->length;
+        file_release(job->file);
+    }
+    delete job;
+}
+
+// eventfd readable: resume every connection whose job finished
+void drain_io_completions(int epoll_fd) {
+    uint64_t count;
+    ssize_t ignored = read(io_pool.event_fd, &count, sizeof(count));
+    (void)ignored;
+
+    std::vector<IoJob*> finished;
+    {
+        std::lock_guard<std::mutex> lock(io_pool.done_mutex);
+        finished.swap(io_pool.done);
+    }
+
+    for (IoJob* job : finished) {
+        Connection* conn = job->orphaned ? nullptr : job->conn;
+        complete_io_job(job);
+        if (conn) {
+            touch_connection(conn);
+            process_connection(conn, epoll_fd);
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Dynamic endpoints: constexpr routes behind a compile-time perfect hash
+// ---------------------------------------------------------------------------
+
+// Writes the body into `body`, returns the HTTP status
+typedef int (*RouteHandler)(const HttpRequest& request, HeaderWriter* body);
+
+struct Route {
+    std::string_view method;
+    std::string_view path;
+    std::string_view content_type;
+    RouteHandler handler;
+};
+
+int handle_health(const HttpRequest&, HeaderWriter* body) {
+    body->append("ok\n");
+    return 200;
+}
+
+static void append_metric(HeaderWriter* body, std::string_view type, std::string_view name, uint64_t value) {
+    body->append("# TYPE ");
+    body->append(name);
+    body->append(" ");
+    body->append(type);
+    body->append("\n");
+    body->append(name);
+    body->append(" ");
+    body->append_number(value);
+    body->append("\n");
+}
+
+// Prometheus text format
+int handle_metrics(const HttpRequest&, HeaderWriter* body) {
+    append_metric(body, "counter", "http_connections_accepted_total", stats.connections_accepted);
+    append_metric(body, "gauge", "http_connections_open", stats.connections_open);
+    append_metric(body, "counter", "http_requests_total", stats.requests);
+    append_metric(body, "counter", "http_cache_hits_total", stats.cache_hits);
+    append_metric(body, "counter", "http_cache_misses_total", stats.cache_misses);
+    append_metric(body, "gauge", "http_cache_entries", cache.entries.size());
+    append_metric(body, "gauge", "http_cache_bytes", cache.bytes);
+    append_metric(body, "counter", "http_fd_cache_hits_total", stats.fd_cache_hits);
+    append_metric(body, "gauge", "http_fd_cache_handles", fd_cache.handles.size());
+    append_metric(body, "counter", "http_precompressed_responses_total", stats.precompressed);
+    append_metric(body, "counter", "http_file_syscalls_total", file_syscalls.load(std::memory_order_relaxed));
+    append_metric(body, "gauge", "http_io_threads", io_pool.threads.size());
+    return 200;
+}
+
+int handle_status(const HttpRequest&, HeaderWriter* body) {
+    body->append("{\"uptime_ms\": ");
+    body->append_number(now_ms - stats.start_ms);
+    body->append(", \"connections\": ");
+    body->append_number(stats.connections_open);
+    body->append(", \"requests\": ");
+    body->append_number(stats.requests);
+    body->append(", \"cache_entries\": ");
+    body->append_number(cache.entries.size());
+    body->append(", \"fd_cache_handles\": ");
+    body->append_number(fd_cache.handles.size());
+    body->append("}\n");
+    return 200;
+}
+
+constexpr Route routes[] = {
+    {"GET", "/health", "text/plain", handle_health},
+    {"GET", "/metrics", "text/plain; version=0.0.4", handle_metrics},
+    {"GET", "/api/status", "application/json", handle_status},
+};
+
+constexpr size_t ROUTE_COUNT = sizeof(routes) / sizeof(routes[0]);
+constexpr size_t ROUTE_SLOTS = 8;  // Power of two, at least 2x the routes so a seed is found fast
+
+static_assert(ROUTE_SLOTS >= ROUTE_COUNT && (ROUTE_SLOTS & (ROUTE_SLOTS - 1)) == 0);
+
+// FNV-1a over "METHOD path", mixed with the table's seed
+constexpr uint32_t route_hash(std::string_view method, std::string_view path, uint32_t seed) {
+    uint32_t h = 2166136261u ^ seed;
+    for (char c : method) h = (h ^ (uint8_t)c) * 16777619u;
+    h = (h ^ ' ') * 16777619u;
+    for (char c : path) h = (h ^ (uint8_t)c) * 16777619u;
+    return h ^ (h >> 15);
+}
+
+struct RouteTable {
+    uint32_t seed;
+    int8_t slots[ROUTE_SLOTS];  // Index into routes[], -1 if empty
+};
+
+// First seed under which every route lands in its own slot
+constexpr RouteTable build_route_table() {
+    for (uint32_t seed = 0; seed < 100000; seed++) {
+        RouteTable table = {seed, {}};
+        for (size_t i = 0; i < ROUTE_SLOTS; i++) table.slots[i] = -1;
+
+        bool collision = false;
+        for (size_t r = 0; r < ROUTE_COUNT && !collision; r++) {
+            size_t slot = route_hash(routes[r].method, routes[r].path, seed) & (ROUTE_SLOTS - 1);
+            if (table.slots[slot] != -1) collision = true;
+            table.slots[slot] = (int8_t)r;
+        }
+        if (!collision) return table;
+    }
+    return RouteTable{UINT32_MAX, {}};
+}
+
+constexpr RouteTable route_table = build_route_table();
+
+static_assert(route_table.seed != UINT32_MAX, "no collision-free seed: raise ROUTE_SLOTS");
+
+// One hash, one slot, one compare. The query string doesn't take part.
+constexpr const Route* find_route(std::string_view method, std::string_view path) {
+    size_t query = path.find('?');
+    if (query != std::string_view::npos) path = path.substr(0, query);
+
+    int index = route_table.slots[route_hash(method, path, route_table.seed) & (ROUTE_SLOTS - 1)];
+    if (index < 0) return nullptr;
+
+    const Route& route = routes[index];
+    return route.method == method && route.path == path ? &route : nullptr;
+}
+
+static_assert(find_route("GET", "/metrics?x=1") == &routes[1]);
+static_assert(find_route("POST", "/health") == nullptr);
+static_assert(find_route("GET", "/index.html") == nullptr);
+
+// Body from the handler, then the header block around it
+void serve_route(Connection* conn, const Route* route) {
+    conn->body = acquire_body_block();
+    HeaderWriter body{conn->body->data, BODY_BLOCK_SIZE};
+    int status = route->handler(conn->request, &body);
+
+    HeaderWriter w = begin_header_block(conn);
+    w.append(status_line(status));
+    w.append("Content-Length: ");
+    w.append_number(body.size);
+    w.append("\r\nContent-Type: ");
+    w.append(route->content_type);
+    w.append("\r\nCache-Control: no-store\r\n");
+    end_headers(&w, conn->keep_alive);
+
+    conn->parts[0] = w.view();
+    conn->parts[1] = body.view();
+    conn->part_count = 2;
+    conn->write_offset = 0;
+    conn->state = WRITING;
+}
+
+// ---------------------------------------------------------------------------
+// Static files: cache lookups and precompressed sibling negotiation
+// ---------------------------------------------------------------------------
+
+// "q=0" in an Accept-Encoding item's parameters: the coding is refused
+static bool refuses(std::string_view params) {
+    params = trim_whitespace(params);
+    if (params.size() < 3 || (params[0] != 'q' && params[0] != 'Q') || params[1] != '=') return false;
+    std::string_view value = trim_whitespace(params.substr(2));
+    if (value.empty() || value[0] != '0') return false;
+    for (size_t i = 1; i < value.size(); i++) {
+        if (value[i] != '.' && value[i] != '0') return false;
+    }
+    return true;
+}
+
+// Codings the client takes, bit per Encoding. "*" takes everything not listed explicitly.
+uint8_t accepted_encodings(std::string_view value) {
+    uint8_t listed = 0;
+    uint8_t taken = 0;
+    bool star = false;
+
+    while (!value.empty()) {
+        size_t comma = value.find(',');
+        std::string_view item = value.substr(0, comma);
+        value = comma == std::string_view::npos ? std::string_view() : value.substr(comma + 1);
+
+        size_t semicolon = item.find(';');
+        std::string_view coding = trim_whitespace(item.substr(0, semicolon));
+        bool refused = semicolon != std::string_view::npos && refuses(item.substr(semicolon + 1));
+
+        if (coding == "*") {
+            star = !refused;
+            continue;
+        }
+        for (int e = ENCODING_GZIP; e < ENCODING_COUNT; e++) {
+            if (!equals_lowercase(coding, codings[e].name)) continue;
+            listed |= 1 << e;
+            if (!refused) taken |= 1 << e;
+        }
+    }
+    uint8_t all = ((1 << ENCODING_COUNT) - 1) & ~(1 << ENCODING_IDENTITY);
+    return taken | (star ? all & ~listed : 0);
+}
+
+// open() and the first read may wait on the disk: a worker does them
+void submit_open_job(Connection* conn, const std::string& key, Encoding encoding) {
+    IoJob* job = new IoJob;
+    job->type = IO_OPEN;
+    job->path = key;
+    job->encoding = encoding;
+    conn->state = LOADING;
+    submit_io_job(conn, job);
+}
+
+// The client takes a precompressed sibling of `path`: send it, or start opening it.
+// false = no usable sibling, send the identity.
+bool serve_variant(Connection* conn, const std::string& path, uint8_t siblings) {
+    uint8_t usable = conn->accepted_encodings & siblings;
+    if (!usable) return false;
+
+    Encoding encoding = ENCODING_IDENTITY;
+    for (int e = ENCODING_GZIP; e < ENCODING_COUNT; e++) {
+        if (usable & (1 << e)) encoding = (Encoding)e;
+    }
+
+    // Reused across requests: after warm-up, building the key doesn't allocate
+    static std::string key;
+    variant_key(path, encoding, &key);
+
+    CacheEntry* entry = cache_lookup(key);
+    if (entry) {
+        stats.precompressed++;
+        serve_cached(conn, entry);
+        return true;
+    }
+    FileHandle* file = fd_cache_lookup(key);
+    if (file) {
+        stats.precompressed++;
+        serve_file(conn, file);
+        return true;
+    }
+    // Counted in apply_open_result, once the sibling has opened: it may be gone by then
+    submit_open_job(conn, key, encoding);
+    return true;
+}
+
+// Identity first: it's what knows which siblings exist
+void serve_static(Connection* conn, const std::string& path) {
+    CacheEntry* entry = cache_lookup(path);
+    if (entry) {
+        stats.cache_hits++;
+        if (!serve_variant(conn, path, entry->siblings)) serve_cached(conn, entry);
+        return;
+    }
+    stats.cache_misses++;
+
+    FileHandle* file = fd_cache_lookup(path);
+    if (file) {
+        stats.fd_cache_hits++;
+        if (!serve_variant(conn, path, file->siblings)) serve_file(conn, file);
+        return;
+    }
+    submit_open_job(conn, path, ENCODING_IDENTITY);
+}
+
+void prepare_http_response(Connection* conn, const std::string& root_dir = "./www") {
+    if (conn->parser.state == P_ERROR) {
+        // Where the next request would start is unknown: answer and close
+        conn->keep_alive = false;
+        prepare_error_response(conn, conn->parser.error_status);
+        return;
+    }
+
+    conn->keep_alive = conn->request.keep_alive &&
+                       conn->requests_served + 1 < config.max_requests;
+    stats.requests++;
+
+    const Route* route = find_route(conn->request.method, conn->request.path);
+    if (route) {
+        serve_route(conn, route);
+        return;
+    }
+
+    // Reused across requests: after warm-up, building the key doesn't allocate
+    static std::string file_path;
+    if (!resolve_path(conn->request.path, root_dir, &file_path)) {
+        prepare_error_response(conn, 400);
+        return;
+    }
+
+    conn->accepted_encodings = accepted_encodings(find_header(&conn->request, "accept-encoding"));
+    serve_static(conn, file_path);
+}
+
+// Read until EAGAIN, or until enough is buffered that parsing should catch up first.
+// Returns false if the connection was closed.
+bool read_input(Connection* conn, int epoll_fd) {
+    // Requests already answered are dropped, so the buffer only holds what's left
+    if (conn->parser.start > 0) {
+        size_t consumed = conn->parser.start;
+        conn->read_buffer.erase(0, consumed);
+        http_parser_rebase(&conn->parser, consumed);
+    }
+
+    while (conn->read_buffer.size() - conn->parser.pos < PIPELINE_READ_LIMIT) {
+        char buffer[BUFFER_SIZE];
+        ssize_t bytes_read = read(conn->fd, buffer, sizeof(buffer));
+
+        if (bytes_read == -1) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                conn->input_drained = true;
+                break;
+            } else {
+                perror("Read failed");
+                close_connection(conn, epoll_fd);
+                return false;
+            }
+        } else if (bytes_read == 0) {
+            close_connection(conn, epoll_fd);
+            return false;
+        }
+
+        conn->read_buffer.append(buffer, bytes_read);
+        touch_connection(conn);
+    }
+    return true;
+}
+
+enum WriteResult {
+    WRITE_DONE,
+    WRITE_BLOCKED,  // Socket buffer full, EPOLLOUT resumes
+    WRITE_WAITING,  // Next file window still being read, its IoJob completion resumes
+    WRITE_FAILED
+};
+
+// In-memory parts with one writev, then the file with sendfile()
+WriteResult write_response(Connection* conn) {
+    size_t memory_size = 0;
+    for (int i = 0; i < conn->part_count; i++) memory_size += conn->parts[i].size();
+
+    while (conn->write_offset < memory_size) {
+        struct iovec iov[MAX_PARTS];
+        int iovcnt = 0;
+        size_t skip = conn->write_offset;
+
+        for (int i = 0; i < conn->part_count; i++) {
+            std::string_view part = conn->parts[i];
+            if (skip >= part.size()) {
+                skip -= part.size();
+                continue;
+            }
+            iov[iovcnt].iov_base = (void*)(part.data() + skip);
+            iov[iovcnt].iov_len = part.size() - skip;
+            iovcnt++;
+            skip = 0;
+        }
+
+        // writev with flags: MSG_MORE lets the headers share a segment with the file's first bytes
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = iovcnt;
+        bool file_follows = conn->file_fd != -1 && conn->file_offset < conn->file_end;
+        ssize_t bytes_written = sendmsg(conn->fd, &msg, MSG_NOSIGNAL | (file_follows ? MSG_MORE : 0));
+
+        if (bytes_written == -1) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return WRITE_BLOCKED;
+            } else {
+                perror("write failed");
+                return WRITE_FAILED;
+            }
+        }
+
+        conn->write_offset += bytes_written;
+        touch_connection(conn);
+    }
+
+    // File body: kernel copies page cache -> socket, one bounded chunk per call,
+    // never past file_ready so a cold page can't stall the loop
+    while (conn->file_fd != -1 && conn->file_offset < conn->file_end) {
+        prefetch_file(conn);
+        if (conn->file_offset == conn->file_ready) return WRITE_WAITING;
+
+        size_t chunk = conn->file_ready - conn->file_offset;
+        if (chunk > (size_t)config.send_window) chunk = config.send_window;
+
+        ssize_t bytes_sent = sendfile(conn->fd, conn->file_fd, &conn->file_offset, chunk);
+
+        if (bytes_sent == -1) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return WRITE_BLOCKED;  // file_offset remembers where
+            } else {
+                perror("sendfile failed");
+                return WRITE_FAILED;
+            }
+        }
+        if (bytes_sent == 0) return WRITE_FAILED;  // File shrank since fstat: Content-Length is a lie now
+        touch_connection(conn);
+    }
+
+    return WRITE_DONE;
+}
+
+// Response sent: drop its resources, the next request starts right after this one
+void finish_response(Connection* conn) {
+    conn->part_count = 0;
+    release_header_block(conn->head);  // Idle keep-alive connections hold no block
+    conn->head = nullptr;
+    if (conn->body) {
+        release_body_block(conn->body);
+        conn->body = nullptr;
+    }
+    conn->write_offset = 0;
+    if (conn->cached) {
+        cache_release(conn->cached);
+        conn->cached = nullptr;
+    }
+    if (conn->file) {
+        file_release(conn->file);
+        conn->file = nullptr;
+        conn->file_fd = -1;
+    }
+    conn->range_segments_left = 0;
+
+    conn->requests_served++;
+    conn->request_complete = false;
+    http_parser_reset(&conn->parser, conn->parser.start + conn->request.length);
+    conn->state = READING;
+}
+
+// Drive a connection as far as it goes without blocking: answer every complete
+// request in read_buffer in order, reading more only when the parser runs dry
+void process_connection(Connection* conn, int epoll_fd) {
+    while (true) {
+        if (conn->state == LOADING) return;  // Another job was needed: its completion resumes
+        if (conn->state == WRITING) {
+            WriteResult result = write_response(conn);
+            if (result == WRITE_BLOCKED || result == WRITE_WAITING) return;
+            if (result == WRITE_DONE && conn->range_segments_left > 0) {
+                next_range_segment(conn);  // Multipart: same response, next part
+                continue;
+            }
+            if (result == WRITE_FAILED || !conn->keep_alive) {
+                close_connection(conn, epoll_fd);
+                return;
+            }
+            finish_response(conn);
+        }
+
+        parse_http_request(conn); // Fill method, path, and mark request_complete
+        if (!conn->request_complete) {
+            if (conn->input_drained) return;  // EPOLLIN brings the rest
+            if (!read_input(conn, epoll_fd)) return;
+            continue;
+        }
+
+        prepare_http_response(conn); // Fill parts, state -> WRITING (or LOADING until a worker is done)
+        if (conn->state == LOADING) return;
+    }
+}
+
+void handle_client_read(Connection* conn, int epoll_fd) {
+    conn->input_drained = false;
+
+    // Mid-response or waiting for the disk: the data waits in the socket until the response is out
+    if (conn->state != READING) return;
+
+    if (!read_input(conn, epoll_fd)) return;
+    process_connection(conn, epoll_fd);
+}
+
+void handle_client_write(Connection* conn, int epoll_fd) {
+    if (conn->state != WRITING) return;  // Edge from registration or after a finished response
+    process_connection(conn, epoll_fd);
+}
+
+// Close connections with no progress for idle_timeout_ms, oldest first.
+// Returns the epoll_wait timeout until the next one would expire.
+int expire_idle_connections(int epoll_fd) {
+    while (idle_tail && now_ms - idle_tail->last_active >= config.idle_timeout_ms) {
+        close_connection(idle_tail, epoll_fd);
+    }
+    if (!idle_tail) return -1;
+    return (int)(idle_tail->last_active + config.idle_timeout_ms - now_ms);
+}
+
+// ---------------------------------------------------------------------------
+// --bench-parser: BENCH_REQUESTS pipelined requests in one buffer,
+// the old find("\r\n\r\n") + istringstream path vs http_parse
+// ---------------------------------------------------------------------------
+#define BENCH_REQUESTS 100000
+#define BENCH_ROUNDS 20
+
+double elapsed_ns(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::nano>(
+        std::chrono::steady_clock::now() - start).count();
+}
+
+void benchmark_parser() {
+    const std::string request =
+        "GET /index.html HTTP/1.1\r\n"
+        "Host: localhost:8080\r\n"
+        "User-Agent: wrk/4.2.0\r\n"
+        "Accept: */*\r\n"
+        "Accept-Encoding: gzip, deflate\r\n"
+        "Connection: keep-alive\r\n"
+        "\r\n";
+
+    std::string buffer;
+    buffer.reserve(request.size() * BENCH_REQUESTS);
+    for (int i = 0; i < BENCH_REQUESTS; i++) buffer += request;
+
+    std::cout << "=== HTTP request parser: " << BENCH_REQUESTS << " pipelined requests of "
+              << request.size() << " bytes ===" << std::endl;
+
+    // --- old: find the blank line, copy the request line, istringstream it ---
+    size_t checksum = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int round = 0; round < BENCH_ROUNDS; round++) {
+        size_t offset = 0;
+        while (true) {
+            size_t end = buffer.find("\r\n\r\n", offset);
+            if (end == std::string::npos) break;
+
+            std::string request_line = buffer.substr(offset, buffer.find("\r\n", offset) - offset);
+            std::istringstream iss(request_line);
+            std::string method, path;
+            iss >> method >> path;
+            checksum += path.size();
+            offset = end + 4;
+        }
+    }
+    double old_ns = elapsed_ns(start) / ((double)BENCH_REQUESTS * BENCH_ROUNDS);
+
+    // --- parser: one pass, views into the buffer ---
+    HttpParser parser;
+    HttpRequest req;
+    size_t parsed = 0;
+    start = std::chrono::steady_clock::now();
+    for (int round = 0; round < BENCH_ROUNDS; round++) {
+        http_parser_reset(&parser, 0);
+        while (http_parse(&parser, buffer.data(), buffer.size(), &req) == PARSE_DONE) {
+            checksum += req.path.size() + req.header_count;
+            parsed++;
+            http_parser_reset(&parser, parser.start + req.length);
+        }
+    }
+    double new_ns = elapsed_ns(start) / ((double)BENCH_REQUESTS * BENCH_ROUNDS);
+
+    // --- same stream in random 1..64 byte reads: resumes must give identical results ---
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<size_t> read_size(1, 64);
+    size_t available = 0;
+    size_t split_parsed = 0;
+    bool split_ok = true;
+    http_parser_reset(&parser, 0);
+    while (available < buffer.size()) {
+        available = std::min(buffer.size(), available + read_size(rng));
+        while (http_parse(&parser, buffer.data(), available, &req) == PARSE_DONE) {
+            if (req.path != "/index.html" || req.header_count != 5 || !req.keep_alive ||
+                req.length != request.size()) {
+                split_ok = false;
+            }
+            split_parsed++;
+            http_parser_reset(&parser, parser.start + req.length);
+        }
+        if (parser.state == P_ERROR) split_ok = false;
+    }
+
+    std::cout << "find + istringstream: " << old_ns << " ns/request ("
+              << 1e3 / old_ns << " M requests/s)" << std::endl;
+    std::cout << "http_parse:           " << new_ns << " ns/request ("
+              << 1e3 / new_ns << " M requests/s, "
+              << request.size() / new_ns * 1e9 / (1024 * 1024) << " MB/s)" << std::endl;
+    std::cout << "split reads: " << split_parsed << "/" << BENCH_REQUESTS << " requests"
+              << (split_ok && split_parsed == BENCH_REQUESTS ? " (ok)" : " (MISMATCH)") << std::endl;
+    (void)checksum;
+}
+
+// ---------------------------------------------------------------------------
+// --check-allocations: every operator new is counted. Requests go through a
+// socketpair into the real read/parse/respond/write path; once warm, cache hits
+// and error responses must not touch the heap. The counting operator new replaces
+// the global one for the whole program, so it is only in a -DCHECK_ALLOCATIONS build.
+// ---------------------------------------------------------------------------
+#define CHECK_WARMUP 100
+#define CHECK_REQUESTS 10000
+
+#ifdef CHECK_ALLOCATIONS
+std::atomic<uint64_t> heap_allocations{0};
+
+void* operator new(size_t size) {
+    heap_allocations.fetch_add(1, std::memory_order_relaxed);
+    void* p = malloc(size ? size : 1);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void* p) noexcept { free(p); }
+void operator delete[](void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+void operator delete[](void* p, size_t) noexcept { free(p); }
+#endif
+
+// One request in, the whole response drained from the peer. Returns its size.
+size_t run_check_request(Connection* conn, int peer, int epoll_fd, std::string_view request) {
+    static char sink[65536];
+
+    if (write(peer, request.data(), request.size()) != (ssize_t)request.size()) return 0;
+    handle_client_read(conn, epoll_fd);
+
+    size_t received = 0;
+    while (true) {
+        ssize_t n = read(peer, sink, sizeof(sink));
+        if (n > 0) {
+            received += n;
+            continue;
+        }
+        if (conn->state != WRITING) break;
+        handle_client_write(conn, epoll_fd);  // Peer drained: room for the rest
+    }
+    return received;
+}
+
+static bool write_check_file(const char* path, size_t size) {
+    std::string content(size, 'x');
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd == -1) return false;
+    bool ok = write(fd, content.data(), content.size()) == (ssize_t)content.size();
+    close(fd);
+    return ok;
+}
+
+// Scratch ./www with a cacheable and a sendfile-sized file, one connection on a socketpair
+struct CheckHarness {
+    char dir[32] = "/tmp/http_check.XXXXXX";
+    int epoll_fd;
+    int peer;
+    Connection* conn;
+};
+
+bool check_setup(CheckHarness* h) {
+    if (!mkdtemp(h->dir) || chdir(h->dir) == -1 || mkdir("www", 0755) == -1 ||
+        !write_check_file("www/index.html", 1024) || !write_check_file("www/index.html.gz", 256) ||
+        !write_check_file("www/large.bin", CACHE_MAX_FILE + 1)) {
+        perror("check setup failed");
+        return false;
+    }
+
+    init_connections(1024);
+    cache_init(CACHE_MAX_BYTES);
+    config.max_requests = UINT32_MAX;
+    now_ms = monotonic_ms();
+    refresh_date_header();
+
+    h->epoll_fd = epoll_create1(0);
+    int sv[2];
+    if (h->epoll_fd == -1 || socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, sv) == -1) {
+        perror("check setup failed");
+        return false;
+    }
+    h->conn = acquire_connection(sv[0]);
+    h->peer = sv[1];
+    add_fd_to_epoll(sv[0], h->epoll_fd, EPOLLIN | EPOLLOUT | EPOLLET, connection_tag(h->conn));
+    return true;
+}
+
+void check_teardown(CheckHarness* h) {
+    close_connection(h->conn, h->epoll_fd);
+    close(h->peer);
+    unlink("www/index.html");
+    unlink("www/index.html.gz");
+    unlink("www/large.bin");
+    rmdir("www");
+    rmdir(h->dir);
+}
+
+#ifdef CHECK_ALLOCATIONS
+int check_allocations() {
+    CheckHarness h;
+    if (!check_setup(&h)) return 1;
+
+    struct {
+        const char* name;
+        std::string_view request;
+        bool must_be_zero;
+    } cases[] = {
+        {"cache hit", "GET /index.html HTTP/1.1\r\nHost: check\r\n\r\n", true},
+        {"precompressed (gzip) hit", "GET /index.html HTTP/1.1\r\nHost: check\r\nAccept-Encoding: gzip, br\r\n\r\n", true},
+        {"error response (400)", "GET /../etc/passwd HTTP/1.1\r\nHost: check\r\n\r\n", true},
+        {"dynamic route (/metrics)", "GET /metrics HTTP/1.1\r\nHost: check\r\n\r\n", true},
+        {"fd cache hit -> sendfile", "GET /large.bin HTTP/1.1\r\nHost: check\r\n\r\n", true},
+        {"multipart ranges (cache hit)", "GET /index.html HTTP/1.1\r\nHost: check\r\nRange: bytes=0-9,100-199,-10\r\n\r\n", true},
+        {"range -> sendfile", "GET /large.bin HTTP/1.1\r\nHost: check\r\nRange: bytes=1000-\r\n\r\n", true},
+        {"fd cache off -> open + sendfile", "GET /large.bin HTTP/1.1\r\nHost: check\r\n\r\n", false},
+    };
+
+    std::cout << "=== Heap allocations per response (" << CHECK_REQUESTS
+              << " keep-alive requests each, after " << CHECK_WARMUP << " warm-up) ===" << std::endl;
+
+    bool ok = true;
+    for (const auto& c : cases) {
+        if (!c.must_be_zero) {
+            fd_cache.capacity = 0;  // Every response opens the file itself
+            fd_cache_clear();
+        }
+        for (int i = 0; i < CHECK_WARMUP; i++) run_check_request(h.conn, h.peer, h.epoll_fd, c.request);
+
+        size_t bytes = 0;
+        uint64_t before = heap_allocations.load(std::memory_order_relaxed);
+        for (int i = 0; i < CHECK_REQUESTS; i++) {
+            bytes += run_check_request(h.conn, h.peer, h.epoll_fd, c.request);
+        }
+        uint64_t allocations = heap_allocations.load(std::memory_order_relaxed) - before;
+
+        bool case_ok = bytes > 0 && (!c.must_be_zero || allocations == 0);
+        ok = ok && case_ok;
+        std::cout << c.name << ": " << (double)allocations / CHECK_REQUESTS << " allocations/request, "
+                  << bytes / CHECK_REQUESTS << " bytes/response"
+                  << (c.must_be_zero ? (case_ok ? " (ok)" : " (FAIL)") : " (IoJob + FileHandle, disk-bound anyway)")
+                  << std::endl;
+    }
+
+    check_teardown(&h);
+    return ok ? 0 : 1;
+}
+#else
+int check_allocations() {
+    std::cerr << "--check-allocations: built without the counting operator new (compile with -DCHECK_ALLOCATIONS)"
+              << std::endl;
+    return 1;
+}
+#endif
+
+// ---------------------------------------------------------------------------
+// --bench-fd-cache: the same sendfile download with every response opening the
+// file, then with the handle kept open. file_syscalls counts what's saved.
+// ---------------------------------------------------------------------------
+#define BENCH_FD_REQUESTS 5000
+
+int benchmark_fd_cache() {
+    CheckHarness h;
+    if (!check_setup(&h)) return 1;
+
+    constexpr std::string_view request = "GET /large.bin HTTP/1.1\r\nHost: bench\r\n\r\n";
+    std::cout << "=== " << BENCH_FD_REQUESTS << " keep-alive requests for a " << CACHE_MAX_FILE + 1
+              << " byte file (sendfile path, inline I/O) ===" << std::endl;
+
+    double syscalls_off = 0;
+    for (size_t capacity : {(size_t)0, (size_t)FD_CACHE_MAX}) {
+        fd_cache.capacity = capacity;
+        for (int i = 0; i < CHECK_WARMUP; i++) run_check_request(h.conn, h.peer, h.epoll_fd, request);
+
+        uint64_t before = file_syscalls.load(std::memory_order_relaxed);
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < BENCH_FD_REQUESTS; i++) {
+            run_check_request(h.conn, h.peer, h.epoll_fd, request);
+        }
+        double us = elapsed_ns(start) / 1000 / BENCH_FD_REQUESTS;
+        double syscalls = (double)(file_syscalls.load(std::memory_order_relaxed) - before) / BENCH_FD_REQUESTS;
+
+        std::cout << "fd cache " << (capacity ? "on: " : "off: ") << syscalls << " file syscalls per request, "
+                  << us << " us/request";
+        if (capacity) {
+            std::cout << " (" << syscalls_off - syscalls << " syscalls saved per request)";
+        } else {
+            syscalls_off = syscalls;
+        }
+        std::cout << std::endl;
+    }
+
+    fd_cache_clear();
+    check_teardown(&h);
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// --bench-routes: find_route for a route, a static file and a near miss
+// ---------------------------------------------------------------------------
+#define BENCH_LOOKUPS 10000000
+
+void benchmark_routes() {
+    struct {
+        const char* name;
+        std::string_view method;
+        std::string_view path;
+    } cases[] = {
+        {"hit /metrics", "GET", "/metrics"},
+        {"miss /index.html", "GET", "/index.html"},
+        {"miss POST /health", "POST", "/health"},
+    };
+
+    std::cout << "=== Route lookup: " << ROUTE_COUNT << " routes in " << ROUTE_SLOTS
+              << " slots, seed " << route_table.seed << " ===" << std::endl;
+
+    for (const auto& c : cases) {
+        std::string_view method = c.method;
+        std::string_view path = c.path;
+        size_t found = 0;
+
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < BENCH_LOOKUPS; i++) {
+            // Hide the inputs from the optimizer so the constexpr lookup isn't folded away
+            const char* method_data = method.data();
+            const char* path_data = path.data();
+            asm volatile("" : "+r"(method_data), "+r"(path_data));
+            found += find_route(std::string_view(method_data, method.size()),
+                                std::string_view(path_data, path.size())) != nullptr;
+        }
+        double ns = elapsed_ns(start) / BENCH_LOOKUPS;
+
+        std::cout << c.name << ": " << ns << " ns/lookup (" << (found ? "found" : "not found") << ")"
+                  << std::endl;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    if (argc > 1 && strcmp(argv[1], "--bench-routes") == 0) {
+        benchmark_routes();
+        return 0;
+    }
+    if (argc > 1 && strcmp(argv[1], "--bench-parser") == 0) {
+        benchmark_parser();
+        return 0;
+    }
+    if (argc > 1 && strcmp(argv[1], "--check-allocations") == 0) {
+        return check_allocations();
+    }
+    if (argc > 1 && strcmp(argv[1], "--bench-fd-cache") == 0) {
+        return benchmark_fd_cache();
+    }
+
+    size_t cache_bytes = CACHE_MAX_BYTES;
+    int io_threads = IO_THREADS;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--cache-mb") == 0 && i + 1 < argc) {
+            cache_bytes = strtoul(argv[++i], nullptr, 10) * 1024 * 1024;
+        } else if (strcmp(argv[i], "--idle-timeout") == 0 && i + 1 < argc) {
+            config.idle_timeout_ms = strtoul(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "--max-requests") == 0 && i + 1 < argc) {
+            config.max_requests = strtoul(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "--io-threads") == 0 && i + 1 < argc) {
+            io_threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--fd-cache") == 0 && i + 1 < argc) {
+            fd_cache.capacity = strtoul(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "--fd-ttl") == 0 && i + 1 < argc) {
+            fd_cache.ttl_ms = strtoul(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "--send-window") == 0 && i + 1 < argc) {
+            config.send_window = std::max(1UL, strtoul(argv[++i], nullptr, 10)) * 1024;
+        } else {
+            std::cerr << "Usage: " << argv[0]
+                      << " [--cache-mb N] [--fd-cache N] [--fd-ttl MS] [--idle-timeout MS] [--max-requests N]"
+                      << " [--io-threads N] [--send-window KB] | --bench-parser | --bench-routes | --bench-fd-cache"
+                      << " | --check-allocations (-DCHECK_ALLOCATIONS build)" << std::endl;
+            return 1;
+        }
+    }
+    // sendfile() has no MSG_NOSIGNAL: a client that resets mid-download must not kill the server
+    signal(SIGPIPE, SIG_IGN);
+
+    now_ms = monotonic_ms();
+    stats.start_ms = now_ms;
+    refresh_date_header();
+
+    size_t table_size = raise_fd_limit(MAX_FDS);
+    init_connections(table_size);
+    cache_init(cache_bytes);
+    if (!start_io_pool(io_threads)) return 1;
+
+    int server_fd = setup_server_socket();
+    if (server_fd == -1) return 1;
+
+    int epoll_fd = epoll_create1(0);
+    if (epoll_fd == -1) {
+        perror("epoll_create1 failed");
+        return 1;
+    }
+
+    if (!add_fd_to_epoll(server_fd, epoll_fd, EPOLLIN | EPOLLET, LISTENER_TAG)) return 1;
+    if (cache.inotify_fd != -1 && !add_fd_to_epoll(cache.inotify_fd, epoll_fd, EPOLLIN | EPOLLET, INOTIFY_TAG)) return 1;
+    if (io_pool.event_fd != -1 && !add_fd_to_epoll(io_pool.event_fd, epoll_fd, EPOLLIN | EPOLLET, IO_EVENT_TAG)) return 1;
+
+    std::cout << "HTTP server on port 8080, serving ./www (" 
+              << table_size << " connection slots, "
+              << cache.capacity / (1024 * 1024) << " MB asset cache, "
+              << fd_cache.capacity << " open files cached for " << fd_cache.ttl_ms << " ms)" << std::endl;
+    std::cout << "Disk I/O: " << (io_threads > 0 ? std::to_string(io_threads) + " worker threads" : "inline")
+              << ", " << config.send_window / 1024 << " KB send window" << std::endl;
+    std::cout << "Keep-alive: " << config.max_requests << " requests per connection, "
+              << config.idle_timeout_ms << " ms idle timeout" << std::endl;
+
+    struct epoll_event events[MAX_EVENTS];
+    int timeout = -1;
+
+    while (true) {
+        int nfds = epoll_wait(epoll_fd, events, MAX_EVENTS, timeout);
+        now_ms = monotonic_ms();
+        refresh_date_header();
+
+        for (int i = 0; i < nfds; i++) {
+            if (events[i].data.u64 == LISTENER_TAG) {
+                accept_new_connections(server_fd, epoll_fd);
+                continue;
+            }
+            if (events[i].data.u64 == INOTIFY_TAG) {
+                cache_handle_inotify();
+                continue;
+            }
+            if (events[i].data.u64 == IO_EVENT_TAG) {
+                drain_io_completions(epoll_fd);
+                continue;
+            }
+
+            Connection* conn = resolve_connection(events[i].data.u64);
+            if (!conn) continue;
+
+            if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+                close_connection(conn, epoll_fd);
+                continue;
+            }
+
+            if (events[i].events & EPOLLIN) {
+                handle_client_read(conn, epoll_fd);
+                if (conn->fd == -1) continue;
+            }
+
+            if (events[i].events & EPOLLOUT) {
+                handle_client_write(conn, epoll_fd);
+            }
+        }
+
+        timeout = expire_idle_connections(epoll_fd);
+    }
+
+    close(epoll_fd);
+    close(server_fd);
+    return 0;
+}